@@ -1,11 +1,14 @@
 #define _GNU_SOURCE
 
 #include <errno.h>
+#include <fcntl.h>
 #include <fts.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "common.h"
 #include "f12.h"
@@ -27,31 +30,102 @@ char *_f12_format_bytes(size_t bytes)
 	return out;
 }
 
-static int evasprintf(char **strp, const char *fmt, va_list ap)
+// Capacity of a buffer after the first append
+#define BUFFER_MIN_CAPACITY 256
+
+static int buffer_vprintf(struct f12_buffer *buffer, const char *fmt,
+			  va_list ap)
 {
-	char *tmp = *strp;
-	int ret = vasprintf(strp, fmt, ap);
-	if (tmp) {
-		free(tmp);
+	char *end = NULL, *data;
+	size_t available = 0, capacity;
+	va_list aq;
+	int length;
+
+	if (NULL != buffer->data) {
+		end = buffer->data + buffer->length;
+		available = buffer->capacity - buffer->length;
+	}
+
+	va_copy(aq, ap);
+	length = vsnprintf(end, available, fmt, aq);
+	va_end(aq);
+	if (length < 0) {
+		if (NULL != end) {
+			*end = '\0';
+		}
+
+		return -1;
+	}
+	if ((size_t) length < available) {
+		buffer->length += length;
+
+		return length;
 	}
 
+	capacity = buffer->capacity ? buffer->capacity : BUFFER_MIN_CAPACITY;
+	while (capacity <= buffer->length + length) {
+		capacity *= 2;
+	}
+	data = realloc(buffer->data, capacity);
+	if (NULL == data) {
+		// Drop the truncated text
+		if (NULL != end) {
+			*end = '\0';
+		}
+
+		return -1;
+	}
+	buffer->data = data;
+	buffer->capacity = capacity;
+
+	vsnprintf(data + buffer->length, capacity - buffer->length, fmt, ap);
+	buffer->length += length;
+
+	return length;
+}
+
+int buffer_printf(struct f12_buffer *buffer, const char *fmt, ...)
+{
+	int ret;
+	va_list ap;
+
+	va_start(ap, fmt);
+	ret = buffer_vprintf(buffer, fmt, ap);
+	va_end(ap);
+
 	return ret;
 }
 
+void buffer_clear(struct f12_buffer *buffer)
+{
+	buffer->length = 0;
+	if (NULL != buffer->data) {
+		buffer->data[0] = '\0';
+	}
+}
+
+void buffer_free(struct f12_buffer *buffer)
+{
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->length = 0;
+	buffer->capacity = 0;
+}
+
 static char *convert_path(char *restrict path)
 {
-	char *final_path = NULL;
+	struct f12_buffer final_path = { 0 };
 	char delimiter[2] = "/";
 	char *part = NULL;
 	char *converted_part = NULL;
 	char *temp = NULL;
-	struct lf12_directory_entry entry = { 0 };
+	int res;
 
 	part = strtok(path, delimiter);
 	while (NULL != part) {
 		converted_part = lf12_convert_name(part);
 		if (NULL == converted_part) {
-			free(final_path);
+			buffer_free(&final_path);
 
 			return NULL;
 		}
@@ -60,22 +134,23 @@ static char *convert_path(char *restrict path)
 		converted_part = lf12_get_file_name(temp, temp + 8);
 		free(temp);
 		if (NULL == converted_part) {
-			free(final_path);
+			buffer_free(&final_path);
 
 			return NULL;
 		}
 
-		if (!final_path) {
-			final_path = converted_part;
-		} else {
-			esprintf(&final_path, "%s/%s", final_path,
-				 converted_part);
-			free(converted_part);
+		res = buffer_printf(&final_path, final_path.length ? "/%s" :
+				    "%s", converted_part);
+		free(converted_part);
+		if (-1 == res) {
+			buffer_free(&final_path);
+
+			return NULL;
 		}
 		part = strtok(NULL, delimiter);
 	}
 
-	return final_path;
+	return final_path.data;
 }
 
 static char *destination_path(const char *source, const char *destination)
@@ -88,7 +163,7 @@ static char *destination_path(const char *source, const char *destination)
 	char *restrict path = NULL;
 	char *converted_path = NULL;
 
-	if ('/' != destination[dest_len - 1]) {
+	if (0 == dest_len || '/' != destination[dest_len - 1]) {
 		dest_has_delim = 0;
 		path_len++;
 		src_offset++;
@@ -112,9 +187,9 @@ static char *destination_path(const char *source, const char *destination)
 	return converted_path;
 }
 
-int _f12_walk_dir(FILE * fp, struct f12_put_arguments *args,
+int _f12_walk_dir(struct lf12_device *device, struct f12_put_arguments *args,
 		  struct lf12_metadata *f12_meta, suseconds_t created,
-		  char **output)
+		  struct f12_buffer *output)
 {
 	enum lf12_error err;
 	char *source_dir_path = args->source;
@@ -129,7 +204,9 @@ int _f12_walk_dir(FILE * fp, struct f12_put_arguments *args,
 	FTSENT *ent;
 
 	if (ftsp == NULL) {
-		esprintf(output, _("fts_open error: %s\n"), strerror(errno));
+		buffer_clear(output);
+		buffer_printf(output, _("fts_open error: %s\n"),
+			      strerror(errno));
 
 		return -1;
 	}
@@ -141,8 +218,9 @@ int _f12_walk_dir(FILE * fp, struct f12_put_arguments *args,
 				// No more items, leave
 				break;
 			}
-			esprintf(output, _("fts_read error: %s\n"),
-				 strerror(errno));
+			buffer_clear(output);
+			buffer_printf(output, _("fts_read error: %s\n"),
+				      strerror(errno));
 
 			return -1;
 		}
@@ -154,13 +232,14 @@ int _f12_walk_dir(FILE * fp, struct f12_put_arguments *args,
 		putpath = destination_path(src_path, dest);
 
 		if (args->verbose) {
-			esprintf(output, "%s'%s' -> '%s'\n", *output,
-				 src_path, putpath);
+			buffer_printf(output, "'%s' -> '%s'\n", src_path,
+				      putpath);
 		}
 
 		if (NULL == (src = fopen(ent->fts_path, "r"))) {
-			esprintf(output, _("%s\nCannot open source file %s\n"),
-				 *output, ent->fts_path);
+			buffer_printf(output,
+				      _("\nCannot open source file %s\n"),
+				      ent->fts_path);
 
 			return -1;
 		}
@@ -169,25 +248,24 @@ int _f12_walk_dir(FILE * fp, struct f12_put_arguments *args,
 		err = lf12_parse_path(putpath, &dest);
 		free(putpath);
 		if (F12_SUCCESS != err) {
-			esprintf(output, "%s\n%s\n", *output,
-				 lf12_strerror(err));
+			buffer_printf(output, "\n%s\n", lf12_strerror(err));
 
 			return -1;
 		}
 
-		err = lf12_create_file(fp, f12_meta, dest, src, created);
+		err = lf12_create_file(device, f12_meta, dest, src, created);
 		lf12_free_path(dest);
 		if (F12_SUCCESS != err) {
-			esprintf(output, _("%s\nError : %s\n"), *output,
-				 lf12_strerror(err));
+			buffer_printf(output, _("\nError : %s\n"),
+				      lf12_strerror(err));
 
 			return -1;
 		}
 	}
 
 	if (fts_close(ftsp) == -1) {
-		esprintf(output, _("%s\nfts_close error: %s\n"), *output,
-			 strerror(errno));
+		buffer_printf(output, _("\nfts_close error: %s\n"),
+			      strerror(errno));
 
 		return -1;
 	}
@@ -195,23 +273,73 @@ int _f12_walk_dir(FILE * fp, struct f12_put_arguments *args,
 	return 0;
 }
 
-int esprintf(char **strp, const char *fmt, ...)
+struct lf12_device *open_device(const char *path, int flags)
 {
-	int ret;
-	va_list ap;
+	struct lf12_device *backing, *device;
+	int fd, saved_errno;
 
-	va_start(ap, fmt);
-	ret = evasprintf(strp, fmt, ap);
-	va_end(ap);
+	fd = open(path, flags, 0666);
+	if (-1 == fd) {
+		return NULL;
+	}
 
-	return ret;
+	if (F12_SUCCESS != lf12_open_fd_device(fd, &backing)) {
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+
+		return NULL;
+	}
+
+	if (F12_SUCCESS != lf12_open_cached_device(backing,
+						   F12_CACHE_BLOCK_SIZE,
+						   F12_CACHE_BLOCK_COUNT,
+						   &device)) {
+		saved_errno = errno;
+		lf12_close_device(backing);
+		errno = saved_errno;
+
+		return NULL;
+	}
+
+	return device;
+}
+
+struct lf12_device *open_mapped_device(const char *path)
+{
+	struct lf12_device *device;
+	int fd, saved_errno;
+
+	fd = open(path, O_RDONLY);
+	if (-1 == fd) {
+		return NULL;
+	}
+
+	if (F12_SUCCESS == lf12_open_mmap_device(fd, 0, &device)) {
+		return device;
+	}
+
+	// Files that can not be mapped are read through the file descriptor
+	if (F12_SUCCESS != lf12_open_fd_device(fd, &device)) {
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+
+		return NULL;
+	}
+
+	return device;
 }
 
-int open_image(FILE * fp, struct lf12_metadata **f12_meta, char **output)
+static int load_image(struct lf12_device *device,
+		      struct lf12_metadata **f12_meta,
+		      struct f12_buffer *output,
+		      enum lf12_error (*read)(struct lf12_device *,
+					      struct lf12_metadata **))
 {
 	enum lf12_error err;
 
-	if (NULL == fp) {
+	if (NULL == device) {
 		return print_error(NULL, NULL, output,
 				   _("Error opening image: %s\n"),
 				   strerror(errno));
@@ -221,8 +349,8 @@ int open_image(FILE * fp, struct lf12_metadata **f12_meta, char **output)
 		return EXIT_SUCCESS;
 	}
 
-	if (F12_SUCCESS != (err = lf12_read_metadata(fp, f12_meta))) {
-		return print_error(fp, *f12_meta, output,
+	if (F12_SUCCESS != (err = read(device, f12_meta))) {
+		return print_error(device, *f12_meta, output,
 				   _("Error loading image: %s\n"),
 				   lf12_strerror(err));
 	}
@@ -230,20 +358,157 @@ int open_image(FILE * fp, struct lf12_metadata **f12_meta, char **output)
 	return EXIT_SUCCESS;
 }
 
-int print_error(FILE * fp, struct lf12_metadata *f12_meta, char **strp,
-		char *fmt, ...)
+int open_image(struct lf12_device *device, struct lf12_metadata **f12_meta,
+	       struct f12_buffer *output)
+{
+	return load_image(device, f12_meta, output, lf12_read_metadata);
+}
+
+int open_image_lazy(struct lf12_device *device,
+		    struct lf12_metadata **f12_meta, struct f12_buffer *output)
+{
+	return load_image(device, f12_meta, output, lf12_read_metadata_lazy);
+}
+
+int open_image_fat(struct lf12_device *device,
+		   struct lf12_metadata **f12_meta, struct f12_buffer *output)
+{
+	return load_image(device, f12_meta, output, lf12_read_fat_metadata);
+}
+
+static int index_enabled(void)
+{
+	const char *value = getenv(F12_INDEX_VARIABLE);
+
+	return NULL != value && '\0' != value[0] && 0 != strcmp(value, "0");
+}
+
+static int image_key(const char *path, struct lf12_index_key *key)
+{
+	struct stat sb;
+
+	if (0 != stat(path, &sb)) {
+		return -1;
+	}
+
+	key->device = sb.st_dev;
+	key->inode = sb.st_ino;
+	key->size = sb.st_size;
+	key->mtime_sec = sb.st_mtim.tv_sec;
+	key->mtime_nsec = sb.st_mtim.tv_nsec;
+
+	return 0;
+}
+
+static enum lf12_error read_index(const char *path,
+				  struct lf12_metadata **f12_meta)
+{
+	enum lf12_error err;
+	struct lf12_index_key key;
+	char *index_path = NULL;
+	int fd;
+
+	if (0 != image_key(path, &key)) {
+		return F12_IO_ERROR;
+	}
+
+	if (-1 == asprintf(&index_path, "%s%s", path, F12_INDEX_SUFFIX)) {
+		return F12_ALLOCATION_ERROR;
+	}
+	fd = open(index_path, O_RDONLY);
+	free(index_path);
+	if (-1 == fd) {
+		return F12_FILE_NOT_FOUND;
+	}
+
+	err = lf12_read_index(fd, &key, f12_meta);
+	close(fd);
+
+	return err;
+}
+
+int open_indexed_image(const char *path, struct lf12_device *device,
+		       struct lf12_metadata **f12_meta,
+		       struct f12_buffer *output,
+		       int (*load)(struct lf12_device *,
+				   struct lf12_metadata **,
+				   struct f12_buffer *))
+{
+	int res;
+
+	if (NULL == device || !index_enabled()) {
+		return load(device, f12_meta, output);
+	}
+
+	// The index is always written from the complete metadata
+	if (F12_SUCCESS == read_index(path, f12_meta)) {
+		return EXIT_SUCCESS;
+	}
+
+	res = open_image(device, f12_meta, output);
+	if (EXIT_SUCCESS == res) {
+		update_index(path, *f12_meta);
+	}
+
+	return res;
+}
+
+void update_index(const char *path, struct lf12_metadata *f12_meta)
+{
+	enum lf12_error err;
+	struct lf12_index_key key;
+	char *index_path = NULL, *temp_path = NULL;
+	int fd;
+
+	if (!index_enabled()) {
+		return;
+	}
+
+	if (-1 == asprintf(&index_path, "%s%s", path, F12_INDEX_SUFFIX)) {
+		return;
+	}
+	if (0 != image_key(path, &key) ||
+	    -1 == asprintf(&temp_path, "%s.tmp", index_path)) {
+		// An outdated index is detected by its key anyway
+		free(index_path);
+
+		return;
+	}
+
+	fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (-1 != fd) {
+		err = lf12_write_index(fd, &key, f12_meta);
+		if (0 != close(fd)) {
+			err = F12_IO_ERROR;
+		}
+		// Replace the old index at once, so that no reader sees a
+		// partially written index
+		if (F12_SUCCESS != err || 0 != rename(temp_path, index_path)) {
+			unlink(temp_path);
+		}
+	}
+
+	free(temp_path);
+	free(index_path);
+}
+
+int print_error(struct lf12_device *device, struct lf12_metadata *f12_meta,
+		struct f12_buffer *output, char *fmt, ...)
 {
 	va_list ap;
 
 	va_start(ap, fmt);
-	if (NULL != fp) {
-		fclose(fp);
+	if (NULL != device) {
+		// Do not write the changes of the failed operation to the image
+		lf12_device_drop(device);
 	}
+	lf12_close_device(device);
 	if (NULL != f12_meta) {
 		lf12_free_metadata(f12_meta);
 	}
 
-	evasprintf(strp, fmt, ap);
+	buffer_clear(output);
+	buffer_vprintf(output, fmt, ap);
 	va_end(ap);
 
 	return EXIT_FAILURE;
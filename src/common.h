@@ -7,6 +7,27 @@
 #include "f12.h"
 #include "libfat12/libfat12.h"
 
+// Geometry of the block cache of images opened for writing
+#define F12_CACHE_BLOCK_SIZE 4096
+#define F12_CACHE_BLOCK_COUNT 256
+
+// Name of the environment variable, that enables the index of the metadata
+#define F12_INDEX_VARIABLE "F12_INDEX"
+// Suffix of the name of the index file next to an image
+#define F12_INDEX_SUFFIX ".f12idx"
+
+/**
+ * A string, that grows by doubling its capacity. Appending to it takes
+ * amortized time linear in the length of the appended text, independent of
+ * the length of the string.
+ */
+struct f12_buffer {
+	// The null terminated string or NULL if nothing was appended yet
+	char *data;
+	size_t length;
+	size_t capacity;
+};
+
 /**
  * Formats the bytes human readable.
  *
@@ -19,25 +40,129 @@ char *_f12_format_bytes(size_t bytes);
 /**
  *
  */
-int _f12_walk_dir(FILE * fp, struct f12_put_arguments *args,
+int _f12_walk_dir(struct lf12_device *device, struct f12_put_arguments *args,
 		  struct lf12_metadata *f12_meta, suseconds_t created,
-		  char **output);
+		  struct f12_buffer *output);
+
+/**
+ * Append formatted text to a buffer.
+ *
+ * Check the manual of printf for information about the format.
+ *
+ * @param buffer a pointer to the buffer
+ * @param fmt the format of the text to append
+ * @return the number of appended characters or -1 if the allocation failed
+ */
+int buffer_printf(struct f12_buffer *buffer, const char *fmt, ...);
 
 /**
- * Enhanced sprintf. This is essentially the same as asprintf, except if strp
- * already points to an existing string pointer, it is freed.
- * 
- * Check the manual of asprintf for information about the parameters.
+ * Discard the contents of a buffer, but keep its memory for further text.
+ *
+ * @param buffer a pointer to the buffer
+ */
+void buffer_clear(struct f12_buffer *buffer);
+
+/**
+ * Release the memory of a buffer.
+ *
+ * @param buffer a pointer to the buffer
  */
-int esprintf(char **strp, const char *fmt, ...);
+void buffer_free(struct f12_buffer *buffer);
 
-int open_image(FILE * fp, struct lf12_metadata **f12_meta, char **output);
+/**
+ * Open an image file and create a device for it. All accesses to the image go
+ * through a write back cache, that is written out when the device is closed.
+ *
+ * @param path the path of the image file
+ * @param flags the flags passed to open(2)
+ * @return a pointer to the device or NULL on failure, with errno set
+ */
+struct lf12_device *open_device(const char *path, int flags);
+
+/**
+ * Open an image file read only and map it into the memory.
+ *
+ * @param path the path of the image file
+ * @return a pointer to the device or NULL on failure, with errno set
+ */
+struct lf12_device *open_mapped_device(const char *path);
+
+int open_image(struct lf12_device *device, struct lf12_metadata **f12_meta,
+	       struct f12_buffer *output);
+
+/**
+ * Like open_image, but only the root directory is loaded. Subdirectories are
+ * loaded on demand with lf12_load_directory and lf12_load_entry_from_path.
+ *
+ * @param device a pointer to the device with the image or NULL if the image
+ * could not be opened
+ * @param f12_meta a pointer to the pointer to the metadata
+ * @param output a pointer to the output for the user
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int open_image_lazy(struct lf12_device *device,
+		    struct lf12_metadata **f12_meta, struct f12_buffer *output);
+
+/**
+ * Like open_image, but only the bios parameter block and the file allocation
+ * table are loaded.
+ *
+ * @param device a pointer to the device with the image or NULL if the image
+ * could not be opened
+ * @param f12_meta a pointer to the pointer to the metadata
+ * @param output a pointer to the output for the user
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int open_image_fat(struct lf12_device *device,
+		   struct lf12_metadata **f12_meta, struct f12_buffer *output);
+
+/**
+ * Like open_image, but the metadata is restored from the index next to the
+ * image, if the environment variable F12_INDEX is set to a non zero value and
+ * the index matches the image. If the index is missing or outdated, the
+ * complete metadata is read and a new index is written for the next
+ * invocation.
+ *
+ * @param path the path of the image file
+ * @param device a pointer to the device with the image or NULL if the image
+ * could not be opened
+ * @param f12_meta a pointer to the pointer to the metadata
+ * @param output a pointer to the output for the user
+ * @param load the function to open the image with, if the index is disabled
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int open_indexed_image(const char *path, struct lf12_device *device,
+		       struct lf12_metadata **f12_meta,
+		       struct f12_buffer *output,
+		       int (*load)(struct lf12_device *,
+				   struct lf12_metadata **,
+				   struct f12_buffer *));
+
+/**
+ * Write the index for the metadata of an image, if the index is enabled. This
+ * must be called after the metadata was written and the device was closed, so
+ * that the index matches the final state of the image file. Failures are
+ * ignored, because an index, that was not updated, does not match the image
+ * anymore.
+ *
+ * @param path the path of the image file
+ * @param f12_meta a pointer to the complete metadata of the image
+ */
+void update_index(const char *path, struct lf12_metadata *f12_meta);
 
 /**
+ * Close the device and free the metadata of an image and replace the output
+ * with an error message. Changes to the image, that are still buffered by the
+ * device, are dropped instead of written back.
  *
+ * @param device a pointer to the device or NULL
+ * @param f12_meta a pointer to the metadata or NULL
+ * @param output a pointer to the output for the user
+ * @param fmt the format of the error message
+ * @return EXIT_FAILURE
  */
-int print_error(FILE * fp, struct lf12_metadata *f12_meta, char **strp,
-		char *fmt, ...);
+int print_error(struct lf12_device *device, struct lf12_metadata *f12_meta,
+		struct f12_buffer *output, char *fmt, ...);
 
 /**
  * Returns the current time in microseconds
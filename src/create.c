@@ -1,3 +1,4 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -245,9 +246,10 @@ _f12_initialize_bpb(struct bios_parameter_block *bpb,
 }
 
 static enum lf12_error
-install_simple_bootloader(FILE * fp,
+install_simple_bootloader(struct lf12_device *device,
 			  struct lf12_metadata *f12_meta,
-			  const char *boot_name, char **output)
+			  const char *boot_name,
+			  struct f12_buffer *output)
 {
 	struct lf12_directory_entry *root_dir = f12_meta->root_dir;
 	unsigned char file_exists = 0;
@@ -274,31 +276,35 @@ install_simple_bootloader(FILE * fp,
 	sibolo_set_8_3_name(boot_name_8_3);
 	free(boot_name_8_3);
 
-	return lf12_install_bootloader(fp, f12_meta, boot_simple_bootloader);
+	return lf12_install_bootloader(device, f12_meta,
+				       boot_simple_bootloader);
 }
 
-int f12_create(struct f12_create_arguments *args, char **output)
+int f12_create(struct f12_create_arguments *args,
+	       struct f12_buffer *output)
 {
 	struct bios_parameter_block *bpb;
 	suseconds_t created = time_usec();
 	enum lf12_error err;
-	FILE *fp = NULL;
+	struct lf12_device *device = NULL;
 	struct lf12_metadata *f12_meta = NULL;
 	int ret;
 	struct stat sb;
 
-	fp = fopen(args->device_path, "w");
-	ret = open_image(fp, NULL, output);
+	device = open_device(args->device_path,
+			     O_RDWR | O_CREAT | O_TRUNC);
+	ret = open_image(device, NULL, output);
 	if (ret != EXIT_SUCCESS) {
 		return ret;
 	}
 
 	if (F12_SUCCESS != (err = lf12_create_metadata(&f12_meta))) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("Error while creating the metadata: %s\n"),
 				   lf12_strerror(err));
 	}
 
+	f12_meta->allocation_policy = args->allocation_policy;
 	bpb = f12_meta->bpb;
 	_f12_initialize_bpb(bpb, args);
 	f12_meta->root_dir_offset = bpb->SectorSize *
@@ -307,48 +313,57 @@ int f12_create(struct f12_create_arguments *args, char **output)
 
 	err = lf12_create_root_dir_meta(f12_meta);
 	if (F12_SUCCESS != err) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("Error while creating root directory "
 				     "metadata: %s\n"), lf12_strerror(err));
 	}
 
-	if (F12_SUCCESS != (err = lf12_create_image(fp, f12_meta))) {
-		return print_error(fp, f12_meta, output,
+	err = lf12_create_image(device, f12_meta, args->preallocate ?
+				F12_CREATE_PREALLOCATED : F12_CREATE_SPARSE);
+	if (F12_SUCCESS != err) {
+		return print_error(device, f12_meta, output,
 				   _("Error while creating the image: %s\n"),
 				   lf12_strerror(err));
 	}
 
 	if (args->boot_file == NULL) {
-		err = lf12_install_bootloader(fp, f12_meta,
+		err = lf12_install_bootloader(device, f12_meta,
 					      boot_default_bootcode_bin);
 		if (F12_SUCCESS != err) {
-			return print_error(fp, f12_meta, output,
+			return print_error(device, f12_meta, output,
 					   _("Error while installing the "
 					     "default bootcode: %s\n"),
 					   lf12_strerror(err));
 		}
 	} else if (args->root_dir_path == NULL) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("Error: Can not use the boot-file option "
 				     "without also specifying a root "
 				     "directory\n"));
 	}
 
 	if (NULL == args->root_dir_path) {
+		err = lf12_device_flush(device);
+		if (F12_SUCCESS != err) {
+			return print_error(device, f12_meta, output,
+					   _("Error while creating the image: "
+					     "%s\n"), lf12_strerror(err));
+		}
+		lf12_close_device(device);
+		update_index(args->device_path, f12_meta);
 		lf12_free_metadata(f12_meta);
-		fclose(fp);
 
 		return EXIT_SUCCESS;
 	}
 
 	if (0 != stat(args->root_dir_path, &sb)) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("Can not open the root directory %s\n"),
 				   args->root_dir_path);
 	}
 
 	if (!S_ISDIR(sb.st_mode)) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("Expected the root dir to be a "
 				     "directory\n"));
 	}
@@ -359,33 +374,34 @@ int f12_create(struct f12_create_arguments *args, char **output)
 		.destination = "",
 		.verbose = args->verbose,
 		.recursive = 1,
+		.allocation_policy = args->allocation_policy,
 	};
 
-	err = _f12_walk_dir(fp, &put_args, f12_meta, created, output);
+	err = _f12_walk_dir(device, &put_args, f12_meta, created, output);
 	if (err) {
-		return print_error(fp, f12_meta, output, "%s\n",
+		return print_error(device, f12_meta, output, "%s\n",
 				   lf12_strerror(err));
 	}
 
 	if (args->boot_file) {
 		if (strchr(args->boot_file, '/')) {
-			return print_error(fp, f12_meta, output,
+			return print_error(device, f12_meta, output,
 					   _("Error: The boot file can not be "
 					     "in a subdirectory\n"));
 		}
 
-		err = install_simple_bootloader(fp, f12_meta, args->boot_file,
-						output);
+		err = install_simple_bootloader(device, f12_meta,
+						args->boot_file, output);
 		switch (err) {
 		case F12_SUCCESS:
 			break;
 		case F12_FILE_NOT_FOUND:
-			return print_error(fp, f12_meta, output,
+			return print_error(device, f12_meta, output,
 					   _("Error: Could not find %s in the "
 					     "root directory\n"),
 					   args->boot_file);
 		default:
-			return print_error(fp, f12_meta, output,
+			return print_error(device, f12_meta, output,
 					   _
 					   ("Error while installing the simple "
 					    "bootloader: %s\n"),
@@ -393,14 +409,21 @@ int f12_create(struct f12_create_arguments *args, char **output)
 		}
 	}
 
-	err = lf12_write_metadata(fp, f12_meta);
+	err = lf12_write_metadata(device, f12_meta);
+	if (F12_SUCCESS != err) {
+		return print_error(device, f12_meta, output,
+				   _("Error while writing the metadata to the "
+				     "image: %s\n"), lf12_strerror(err));
+	}
+	err = lf12_device_flush(device);
 	if (F12_SUCCESS != err) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("Error while writing the metadata to the "
 				     "image: %s\n"), lf12_strerror(err));
 	}
+	lf12_close_device(device);
+	update_index(args->device_path, f12_meta);
 	lf12_free_metadata(f12_meta);
-	fclose(fp);
 
 	return EXIT_SUCCESS;
 }
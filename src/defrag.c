@@ -0,0 +1,69 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "f12.h"
+#include "libfat12/libfat12.h"
+
+int f12_defrag(struct f12_defrag_arguments *args, struct f12_buffer *output)
+{
+	enum lf12_error err;
+	struct lf12_device *device = NULL;
+	struct lf12_metadata *f12_meta = NULL;
+	struct lf12_defrag_stats stats;
+	int res;
+
+	if (args->dry_run) {
+		device = open_mapped_device(args->device_path);
+	} else {
+		device = open_device(args->device_path, O_RDWR);
+	}
+	res = open_indexed_image(args->device_path, device, &f12_meta, output,
+				 open_image);
+	if (EXIT_SUCCESS != res) {
+		return res;
+	}
+
+	err = lf12_defragment(device, f12_meta, args->dry_run, &stats);
+	if (F12_SUCCESS != err) {
+		return print_error(device, f12_meta, output, "%s\n",
+				   lf12_strerror(err));
+	}
+
+	if (args->dry_run || args->verbose) {
+		buffer_printf(output,
+			      _("Cluster chains:\t\t%u\n"
+				"Extents before:\t\t%u\n"
+				"Extents after:\t\t%u\n"
+				"Extents saved:\t\t%u\n"
+				"Clusters moved:\t\t%u\n"),
+			      stats.chain_count, stats.extents_before,
+			      stats.extents_after,
+			      stats.extents_before - stats.extents_after,
+			      stats.moved_clusters);
+	}
+	if (args->dry_run) {
+		lf12_close_device(device);
+		lf12_free_metadata(f12_meta);
+
+		return EXIT_SUCCESS;
+	}
+
+	// The file allocation table and all directory tables are written once.
+	// If that fails, the relocated clusters must not reach the image either,
+	// as the metadata on the image still describes the old layout
+	err = lf12_write_metadata(device, f12_meta);
+	if (F12_SUCCESS == err) {
+		err = lf12_device_flush(device);
+	}
+	if (F12_SUCCESS != err) {
+		return print_error(device, f12_meta, output, _("Error: %s\n"),
+				   lf12_strerror(err));
+	}
+	lf12_close_device(device);
+	update_index(args->device_path, f12_meta);
+	lf12_free_metadata(f12_meta);
+
+	return EXIT_SUCCESS;
+}
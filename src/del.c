@@ -1,3 +1,4 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -6,10 +7,10 @@
 #include "libfat12/libfat12.h"
 
 static enum lf12_error
-recursive_del_entry(FILE * fp,
+recursive_del_entry(struct lf12_device *device,
 		    struct lf12_metadata *f12_meta,
 		    struct lf12_directory_entry *entry,
-		    struct f12_del_arguments *args, char **output)
+		    struct f12_del_arguments *args, struct f12_buffer *output)
 {
 	struct lf12_directory_entry *child;
 	enum lf12_error err;
@@ -24,7 +25,7 @@ recursive_del_entry(FILE * fp,
 				continue;
 			}
 
-			err = recursive_del_entry(fp, f12_meta, child, args,
+			err = recursive_del_entry(device, f12_meta, child, args,
 						  output);
 			if (F12_SUCCESS != err) {
 				return err;
@@ -35,58 +36,79 @@ recursive_del_entry(FILE * fp,
 		if (F12_SUCCESS != err) {
 			return err;
 		}
-		esprintf(output, "%s%s\n", *output, entry_path);
+		buffer_printf(output, "%s\n", entry_path);
 		free(entry_path);
 	}
 
-	return lf12_del_entry(fp, f12_meta, entry, args->soft_delete);
+	if (args->soft_delete) {
+		return F12_SUCCESS;
+	}
+
+	return lf12_unlink_entry(device, f12_meta, entry);
 }
 
-int f12_del(struct f12_del_arguments *args, char **output)
+int f12_del(struct f12_del_arguments *args, struct f12_buffer *output)
 {
 	struct lf12_directory_entry *entry;
 	enum lf12_error err;
 	struct lf12_metadata *f12_meta = NULL;
-	FILE *fp = NULL;
+	struct lf12_device *device = NULL;
 	struct lf12_path *path;
 	int res;
 
-	fp = fopen(args->device_path, "r+");
-	if (EXIT_SUCCESS != (res = open_image(fp, &f12_meta, output))) {
+	device = open_device(args->device_path, O_RDWR);
+	res = open_indexed_image(args->device_path, device, &f12_meta, output,
+				 open_image);
+	if (EXIT_SUCCESS != res) {
 		return res;
 	}
 
 	err = lf12_parse_path(args->path, &path);
 	if (F12_SUCCESS != err) {
-		return print_error(fp, f12_meta, output, "%s\n",
+		return print_error(device, f12_meta, output, "%s\n",
 				   lf12_strerror(err));
 	}
 
 	entry = lf12_entry_from_path(f12_meta->root_dir, path);
 	lf12_free_path(path);
 	if (NULL == entry) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("The file %s was not found on the "
 				     "device\n"), args->path);
 	}
 
 	if (lf12_is_directory(entry) && entry->child_count > 2
 	    && !args->recursive) {
-		return print_error(fp, f12_meta, output, _("Error: %s\n"),
+		return print_error(device, f12_meta, output, _("Error: %s\n"),
 				   lf12_strerror(F12_IS_DIR));
 	}
 
-	err = recursive_del_entry(fp, f12_meta, entry, args, output);
+	err = recursive_del_entry(device, f12_meta, entry, args, output);
 	if (err != F12_SUCCESS) {
-		lf12_free_path(path);
+		return print_error(device, f12_meta, output,
+				   _("Error while deletion: %s\n"),
+				   lf12_strerror(err));
+	}
 
-		return print_error(fp, f12_meta, output,
+	// Write the metadata once for all deleted entries
+	err = lf12_write_metadata(device, f12_meta);
+	if (F12_SUCCESS != err) {
+		return print_error(device, f12_meta, output,
+				   _("Error while deletion: %s\n"),
+				   lf12_strerror(err));
+	}
+
+	// Write the cached blocks back to the image
+	err = lf12_device_flush(device);
+	if (F12_SUCCESS != err) {
+		return print_error(device, f12_meta, output,
 				   _("Error while deletion: %s\n"),
 				   lf12_strerror(err));
 	}
 
+	lf12_close_device(device);
+	update_index(args->device_path, f12_meta);
 	lf12_free_metadata(f12_meta);
-	fclose(fp);
 
 	return EXIT_SUCCESS;
 }
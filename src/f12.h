@@ -5,14 +5,19 @@
 #include <libintl.h>
 #include <locale.h>
 
+#include "libfat12/libfat12.h"
+
 #define _(STRING) gettext(STRING)
 #define gettext_noop(STRING) STRING
 
+struct f12_buffer;
+
 struct f12_create_arguments {
 	char *device_path;
 	char *root_dir_path;
 	char *volume_label;
 	char *boot_file;
+	int preallocate;
 	int verbose;
 	unsigned int volume_size;
 	uint16_t sector_size;
@@ -21,6 +26,13 @@ struct f12_create_arguments {
 	uint8_t number_of_fats;
 	uint16_t root_dir_entries;
 	uint8_t drive_number;
+	enum lf12_allocation_policy allocation_policy;
+};
+
+struct f12_defrag_arguments {
+	char *device_path;
+	int dry_run;
+	int verbose;
 };
 
 struct f12_del_arguments {
@@ -42,6 +54,7 @@ struct f12_get_arguments {
 struct f12_info_arguments {
 	char *device_path;
 	int dump_bpb;
+	int counts;
 };
 
 struct f12_list_arguments {
@@ -51,6 +64,7 @@ struct f12_list_arguments {
 	int modification_date;
 	int access_date;
 	int with_size;
+	int extents;
 	int recursive;
 };
 
@@ -68,69 +82,80 @@ struct f12_put_arguments {
 	char *destination;
 	int recursive;
 	int verbose;
+	enum lf12_allocation_policy allocation_policy;
 };
 
 /**
  * Create a new fat12 image
  *
  * @param args the arguments for the function
- * @param output the output to show the user.
+ * @param output a pointer to the output to show the user
+ * @return EXIT_SUCCESS on success and EXIT_FAILURE on failure
+ */
+int f12_create(struct f12_create_arguments *, struct f12_buffer *output);
+
+/**
+ * Move the files and directories on a fat12 image into contiguous runs of
+ * clusters
+ *
+ * @param args the arguments for the function
+ * @param output a pointer to the output to show the user
  * @return EXIT_SUCCESS on success and EXIT_FAILURE on failure
  */
-int f12_create(struct f12_create_arguments *, char **output);
+int f12_defrag(struct f12_defrag_arguments *args, struct f12_buffer *output);
 
 /**
  * Deletes a file or directory on a fat12 image
  *
  * @param args the arguments for the function
- * @param output the output to show the user.
+ * @param output a pointer to the output to show the user
  * @return EXIT_SUCCESS on success and EXIT_FAILURE on failure
  */
-int f12_del(struct f12_del_arguments *args, char **output);
+int f12_del(struct f12_del_arguments *args, struct f12_buffer *output);
 
 /**
  * Dump a file or directory from a fat12 image
  *
  * @param args the arguments for the function
- * @param output the output to show the user.
+ * @param output a pointer to the output to show the user
  * @return EXIT_SUCCESS on success and EXIT_FAILURE on failure
  */
-int f12_get(struct f12_get_arguments *args, char **output);
+int f12_get(struct f12_get_arguments *args, struct f12_buffer *output);
 
 /**
  * Get information about a fat12 image
  *
  * @param args the arguments for the function
- * @param output the output to show the user.
+ * @param output a pointer to the output to show the user
  * @return EXIT_SUCCESS on success and EXIT_FAILURE on failure
  */
-int f12_info(struct f12_info_arguments *args, char **output);
+int f12_info(struct f12_info_arguments *args, struct f12_buffer *output);
 
 /**
  * List the contents of a directory on a fat12 image
  *
  * @param args the arguments for the function
- * @param output the output to show the user.
+ * @param output a pointer to the output to show the user
  * @return EXIT_SUCCESS on success and EXIT_FAILURE on failure
  */
-int f12_list(struct f12_list_arguments *args, char **output);
+int f12_list(struct f12_list_arguments *args, struct f12_buffer *output);
 
 /**
  * Move a file on directory on a fat12 image
  *
  * @param args the arguments for the function
- * @param output the output to show the user.
+ * @param output a pointer to the output to show the user
  * @return EXIT_SUCCESS on success and EXIT_FAILURE on failure
  */
-int f12_move(struct f12_move_arguments *args, char **output);
+int f12_move(struct f12_move_arguments *args, struct f12_buffer *output);
 
 /**
  * Put a file or directory onto a fat12 image
  *
  * @param args the arguments for the function
- * @param output the output to show the user.
+ * @param output a pointer to the output to show the user
  * @return EXIT_SUCCESS on success and EXIT_FAILURE on failure
  */
-int f12_put(struct f12_put_arguments *args, char **output);
+int f12_put(struct f12_put_arguments *args, struct f12_buffer *output);
 
 #endif
@@ -7,23 +7,25 @@
 #include "f12.h"
 #include "libfat12/libfat12.h"
 
-static int _f12_dump_f12_structure(FILE * fp, struct lf12_metadata *f12_meta,
+static int _f12_dump_f12_structure(struct lf12_device *device,
+				   struct lf12_metadata *f12_meta,
 				   struct lf12_directory_entry *entry,
 				   char *dest_path,
 				   struct f12_get_arguments *args,
-				   char **output)
+				   struct f12_buffer *output)
 {
 	int verbose = args->verbose, recursive = args->recursive;
 	enum lf12_error err;
 	struct lf12_directory_entry *child_entry;
-	char *entry_path = NULL;
-	int res;
+	struct f12_buffer entry_path = { 0 };
+	int res = 0;
 
 	if (!lf12_is_directory(entry)) {
 		FILE *dest_fp = fopen(dest_path, "w");
-		err = lf12_dump_file(fp, f12_meta, entry, dest_fp);
+		err = lf12_dump_file(device, f12_meta, entry, dest_fp);
 		if (F12_SUCCESS != err) {
-			esprintf(output, "%s\n", lf12_strerror(err));
+			buffer_clear(output);
+			buffer_printf(output, "%s\n", lf12_strerror(err));
 			fclose(dest_fp);
 			return -1;
 		}
@@ -33,7 +35,8 @@ static int _f12_dump_f12_structure(FILE * fp, struct lf12_metadata *f12_meta,
 	}
 
 	if (!recursive) {
-		esprintf(output, "%s\n", lf12_strerror(F12_IS_DIR));
+		buffer_clear(output);
+		buffer_printf(output, "%s\n", lf12_strerror(F12_IS_DIR));
 
 		return -1;
 	}
@@ -44,6 +47,14 @@ static int _f12_dump_f12_structure(FILE * fp, struct lf12_metadata *f12_meta,
 		}
 	}
 
+	err = lf12_load_directory(device, f12_meta, entry, 0);
+	if (F12_SUCCESS != err) {
+		buffer_clear(output);
+		buffer_printf(output, "%s\n", lf12_strerror(err));
+
+		return -1;
+	}
+
 	for (int i = 0; i < entry->child_count; i++) {
 		child_entry = &entry->children[i];
 
@@ -55,62 +66,76 @@ static int _f12_dump_f12_structure(FILE * fp, struct lf12_metadata *f12_meta,
 		char *child_name = lf12_get_entry_file_name(child_entry);
 
 		if (NULL == child_name) {
-			return -1;
+			res = -1;
+			break;
 		}
 
-		esprintf(&entry_path, "%s/%s", dest_path, child_name);
+		// The memory of the path is reused for all children
+		buffer_clear(&entry_path);
+		res = buffer_printf(&entry_path, "%s/%s", dest_path,
+				    child_name);
+		free(child_name);
+		if (-1 == res) {
+			break;
+		}
 
 		if (verbose) {
-			esprintf(output, "%s%s\n", *output, entry_path);
+			buffer_printf(output, "%s\n", entry_path.data);
 		}
 
-		free(child_name);
-		res = _f12_dump_f12_structure(fp, f12_meta, child_entry,
-					      entry_path, args, output);
-		free(entry_path);
-
+		res = _f12_dump_f12_structure(device, f12_meta, child_entry,
+					      entry_path.data, args, output);
 		if (res) {
-			return res;
+			break;
 		}
 	}
+	buffer_free(&entry_path);
 
-	return 0;
+	return res;
 }
 
-int f12_get(struct f12_get_arguments *args, char **output)
+int f12_get(struct f12_get_arguments *args, struct f12_buffer *output)
 {
 	struct lf12_directory_entry *entry;
 	enum lf12_error err;
 	struct lf12_metadata *f12_meta = NULL;
-	FILE *fp = NULL;
+	struct lf12_device *device = NULL;
 	int res;
 	struct lf12_path *src_path;
 
-	fp = fopen(args->device_path, "r+");
-	if (EXIT_SUCCESS != (res = open_image(fp, &f12_meta, output))) {
+	device = open_mapped_device(args->device_path);
+	res = open_indexed_image(args->device_path, device, &f12_meta, output,
+				 open_image_lazy);
+	if (EXIT_SUCCESS != res) {
 		return res;
 	}
 
 	err = lf12_parse_path(args->path, &src_path);
 	if (F12_SUCCESS != err) {
-		return print_error(fp, f12_meta, output, "%s\n",
+		return print_error(device, f12_meta, output, "%s\n",
 				   lf12_strerror(err));
 	}
 
-	entry = lf12_entry_from_path(f12_meta->root_dir, src_path);
-	if (NULL == entry) {
+	err = lf12_load_entry_from_path(device, f12_meta, src_path, &entry);
+	if (F12_FILE_NOT_FOUND == err) {
 		lf12_free_path(src_path);
 
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("The file %s was not found on the "
 				     "device\n"), args->path);
 	}
+	if (F12_SUCCESS != err) {
+		lf12_free_path(src_path);
+
+		return print_error(device, f12_meta, output, "%s\n",
+				   lf12_strerror(err));
+	}
 
-	res = _f12_dump_f12_structure(fp, f12_meta, entry, args->dest, args,
+	res = _f12_dump_f12_structure(device, f12_meta, entry, args->dest, args,
 				      output);
 	lf12_free_path(src_path);
 	lf12_free_metadata(f12_meta);
-	fclose(fp);
+	lf12_close_device(device);
 
 	if (res) {
 		return EXIT_FAILURE;
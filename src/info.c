@@ -10,13 +10,14 @@
  * readable string.
  *
  * @param f12_meta a pointer to the metadata of an fat 12 image
- * @param output a pointer to the string pointer with the output
+ * @param output a pointer to the output
  */
-static void _f12_info_dump_bpb(struct lf12_metadata *f12_meta, char **output)
+static void _f12_info_dump_bpb(struct lf12_metadata *f12_meta,
+			       struct f12_buffer *output)
 {
 	struct bios_parameter_block *bpb = f12_meta->bpb;
 
-	char *text = _("%s\n"
+	char *text = _("\n"
 		       "Bios Parameter Block\n"
 		       "  OEMLabel:\t\t\t%s\n"
 		       "  Sector size:\t\t\t%d bytes\n"
@@ -37,47 +38,100 @@ static void _f12_info_dump_bpb(struct lf12_metadata *f12_meta, char **output)
 		       "  VolumeID:\t\t\t0x%08x\n"
 		       "  Volume label:\t\t\t%s\n  File system:\t\t\t%s\n");
 
-	esprintf(output, text, *output, bpb->OEMLabel, bpb->SectorSize,
-		 bpb->SectorsPerCluster,
-		 bpb->ReservedForBoot, bpb->NumberOfFats,
-		 bpb->RootDirEntries, bpb->LogicalSectors, bpb->MediumByte,
-		 bpb->SectorsPerFat, bpb->SectorsPerTrack,
-		 bpb->NumberOfHeads, bpb->HiddenSectors, bpb->LargeSectors,
-		 bpb->DriveNumber, bpb->Flags, bpb->Signature, bpb->VolumeID,
-		 bpb->VolumeLabel, bpb->FileSystem);
+	buffer_printf(output, text, bpb->OEMLabel, bpb->SectorSize,
+		      bpb->SectorsPerCluster,
+		      bpb->ReservedForBoot, bpb->NumberOfFats,
+		      bpb->RootDirEntries, bpb->LogicalSectors, bpb->MediumByte,
+		      bpb->SectorsPerFat, bpb->SectorsPerTrack,
+		      bpb->NumberOfHeads, bpb->HiddenSectors, bpb->LargeSectors,
+		      bpb->DriveNumber, bpb->Flags, bpb->Signature,
+		      bpb->VolumeID, bpb->VolumeLabel, bpb->FileSystem);
 }
 
-int f12_info(struct f12_info_arguments *args, char **output)
+int f12_info(struct f12_info_arguments *args, struct f12_buffer *output)
 {
 	enum lf12_error err;
 	struct lf12_metadata *f12_meta = NULL;
-	char *formatted_size, *formatted_used_bytes;
-	FILE *fp = NULL;
-	int res;
+	struct lf12_cluster_stats stats;
+	char *formatted_size, *formatted_used_bytes, *formatted_free_bytes,
+		*formatted_largest_free_extent;
+	struct lf12_device *device = NULL;
+	size_t cluster_size;
+	int res, file_count, dir_count;
 
-	fp = fopen(args->device_path, "r+");
-	if (EXIT_SUCCESS != (res = open_image(fp, &f12_meta, output))) {
+	device = open_mapped_device(args->device_path);
+	// The directory tables are only counted in their raw form
+	res = open_indexed_image(args->device_path, device, &f12_meta, output,
+				 open_image_fat);
+	if (EXIT_SUCCESS != res) {
 		return res;
 	}
-	fclose(fp);
-	fp = NULL;
+	if (args->counts) {
+		err = lf12_count_entries(device, f12_meta, &file_count,
+					 &dir_count);
+		if (F12_SUCCESS != err) {
+			return print_error(device, f12_meta, output, "%s\n",
+					   lf12_strerror(err));
+		}
+	}
+	lf12_close_device(device);
+	device = NULL;
+
+	err = lf12_get_cluster_stats(f12_meta, &stats);
+	if (F12_SUCCESS != err) {
+		return print_error(device, f12_meta, output, "%s\n",
+				   lf12_strerror(err));
+	}
+	cluster_size = f12_meta->bpb->SectorSize *
+		f12_meta->bpb->SectorsPerCluster;
 
 	formatted_size = _f12_format_bytes(lf12_get_partition_size(f12_meta));
 	formatted_used_bytes = _f12_format_bytes(lf12_get_used_bytes(f12_meta));
+	formatted_free_bytes =
+		_f12_format_bytes(stats.free_clusters * cluster_size);
+	formatted_largest_free_extent =
+		_f12_format_bytes(stats.largest_free_extent * cluster_size);
 
-	esprintf(output,
-		 _("F12 info\n"
-		   "  Partition size:\t\t%s\n"
-		   "  Used bytes:\t\t\t%s\n"
-		   "  Files:\t\t\t%d\n"
-		   "  Directories:\t\t\t%d\n"),
-		 formatted_size,
-		 formatted_used_bytes,
-		 lf12_get_file_count(f12_meta->root_dir),
-		 lf12_get_directory_count(f12_meta->root_dir));
+	buffer_printf(output,
+		      _("F12 info\n"
+			"  Partition size:\t\t%s\n"
+			"  Used bytes:\t\t\t%s\n"
+			"  Free bytes:\t\t\t%s\n"
+			"  Cluster size:\t\t\t%zu bytes\n"
+			"  Clusters:\t\t\t%u\n"
+			"  Used clusters:\t\t%u\n"
+			"  Free clusters:\t\t%u\n"
+			"  Bad clusters:\t\t\t%u\n"
+			"  Cluster chains:\t\t%u\n"
+			"  Fragmented chains:\t\t%u\n"
+			"  Extents:\t\t\t%u\n"
+			"  Free extents:\t\t\t%u\n"
+			"  Largest free extent:\t\t%s\n"),
+		      formatted_size,
+		      formatted_used_bytes,
+		      formatted_free_bytes,
+		      cluster_size,
+		      stats.cluster_count,
+		      stats.used_clusters,
+		      stats.free_clusters,
+		      stats.bad_clusters,
+		      stats.chain_count,
+		      stats.fragmented_chains,
+		      stats.extent_count,
+		      stats.free_extent_count,
+		      formatted_largest_free_extent);
 
 	free(formatted_size);
 	free(formatted_used_bytes);
+	free(formatted_free_bytes);
+	free(formatted_largest_free_extent);
+
+	if (args->counts) {
+		buffer_printf(output,
+			      _("  Files:\t\t\t%d\n"
+				"  Directories:\t\t\t%d\n"),
+			      file_count, dir_count);
+	}
 
 	if (args->dump_bpb) {
 		_f12_info_dump_bpb(f12_meta, output);
@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocation_p.h"
+#include "libfat12.h"
+#include "metadata_p.h"
+
+/**
+ * A run of consecutive free clusters.
+ */
+struct free_extent {
+	uint16_t start;
+	uint16_t length;
+};
+
+/**
+ * Index of the free clusters of a partition.
+ */
+struct lf12_free_space {
+	// One bit for every cluster of the data area, set if the cluster is
+	// free
+	uint8_t *bitmap;
+	// The cluster behind the data area. Entries of the file allocation
+	// table behind it have no cluster and are never free
+	uint16_t end;
+	unsigned int free_count;
+	// The runs of free clusters ordered by their first cluster
+	struct free_extent *extents;
+	size_t extent_count;
+	// The cluster, that was allocated last
+	uint16_t last_allocated;
+};
+
+static int is_free(struct lf12_free_space *free_space, uint16_t cluster)
+{
+	return free_space->bitmap[cluster / 8] & (1 << (cluster % 8));
+}
+
+/**
+ * Get the position of the first free extent, that starts behind a cluster.
+ *
+ * @param free_space a pointer to the index of the free clusters
+ * @param cluster the number of the cluster
+ * @return the position of the extent or the number of extents if there is none
+ */
+static size_t extent_behind(struct lf12_free_space *free_space,
+			    uint16_t cluster)
+{
+	size_t low = 0, high = free_space->extent_count, middle;
+
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (free_space->extents[middle].start > cluster) {
+			high = middle;
+		} else {
+			low = middle + 1;
+		}
+	}
+
+	return low;
+}
+
+static void insert_extent(struct lf12_free_space *free_space, size_t position,
+			  uint16_t start, uint16_t length)
+{
+	struct free_extent *extents = free_space->extents;
+
+	memmove(&extents[position + 1], &extents[position],
+		(free_space->extent_count - position) *
+		sizeof(struct free_extent));
+	extents[position].start = start;
+	extents[position].length = length;
+	free_space->extent_count++;
+}
+
+static void remove_extent(struct lf12_free_space *free_space, size_t position)
+{
+	struct free_extent *extents = free_space->extents;
+
+	free_space->extent_count--;
+	memmove(&extents[position], &extents[position + 1],
+		(free_space->extent_count - position) *
+		sizeof(struct free_extent));
+}
+
+static void mark_free(struct lf12_free_space *free_space, uint16_t cluster)
+{
+	struct free_extent *extents = free_space->extents;
+	size_t next = extent_behind(free_space, cluster);
+	int joins_previous, joins_next;
+
+	if (is_free(free_space, cluster)) {
+		return;
+	}
+	free_space->bitmap[cluster / 8] |= 1 << (cluster % 8);
+	free_space->free_count++;
+
+	joins_previous = next > 0 &&
+		extents[next - 1].start + extents[next - 1].length == cluster;
+	joins_next = next < free_space->extent_count &&
+		extents[next].start == cluster + 1;
+
+	if (joins_previous && joins_next) {
+		extents[next - 1].length += 1 + extents[next].length;
+		remove_extent(free_space, next);
+	} else if (joins_previous) {
+		extents[next - 1].length++;
+	} else if (joins_next) {
+		extents[next].start--;
+		extents[next].length++;
+	} else {
+		insert_extent(free_space, next, cluster, 1);
+	}
+}
+
+static void mark_used(struct lf12_free_space *free_space, uint16_t cluster)
+{
+	struct free_extent *extent;
+	size_t position;
+	uint16_t end;
+
+	if (!is_free(free_space, cluster)) {
+		return;
+	}
+	free_space->bitmap[cluster / 8] &= ~(1 << (cluster % 8));
+	free_space->free_count--;
+	free_space->last_allocated = cluster;
+
+	// The cluster is free, so it is inside the extent before the next one
+	position = extent_behind(free_space, cluster) - 1;
+	extent = &free_space->extents[position];
+	end = extent->start + extent->length;
+
+	if (1 == extent->length) {
+		remove_extent(free_space, position);
+	} else if (cluster == extent->start) {
+		extent->start++;
+		extent->length--;
+	} else if (cluster == end - 1) {
+		extent->length--;
+	} else {
+		extent->length = cluster - extent->start;
+		insert_extent(free_space, position + 1, cluster + 1,
+			      end - cluster - 1);
+	}
+}
+
+/**
+ * Get the index of the free clusters of a partition and build it, if it does
+ * not exist yet.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @return a pointer to the index or NULL if the allocation failed
+ */
+static struct lf12_free_space *get_free_space(struct lf12_metadata *f12_meta)
+{
+	struct lf12_free_space *free_space;
+	struct free_extent *last = NULL;
+	uint16_t end = _lf12_clusters_end(f12_meta);
+
+	if (NULL != f12_meta->free_space) {
+		return f12_meta->free_space;
+	}
+
+	free_space = calloc(1, sizeof(struct lf12_free_space));
+	if (NULL == free_space) {
+		return NULL;
+	}
+	free_space->end = end;
+	free_space->bitmap = calloc(end / 8 + 1, 1);
+	// Free extents are separated by at least one used cluster
+	free_space->extents = malloc((end / 2 + 1) *
+				     sizeof(struct free_extent));
+	if (NULL == free_space->bitmap || NULL == free_space->extents) {
+		free(free_space->bitmap);
+		free(free_space->extents);
+		free(free_space);
+
+		return NULL;
+	}
+
+	for (uint16_t cluster = 2; cluster < end; cluster++) {
+		if (0 != f12_meta->fat_entries[cluster]) {
+			continue;
+		}
+		free_space->bitmap[cluster / 8] |= 1 << (cluster % 8);
+		free_space->free_count++;
+
+		if (NULL != last && last->start + last->length == cluster) {
+			last->length++;
+			continue;
+		}
+		insert_extent(free_space, free_space->extent_count, cluster,
+			      1);
+		last = &free_space->extents[free_space->extent_count - 1];
+	}
+	f12_meta->free_space = free_space;
+
+	return free_space;
+}
+
+void _lf12_update_free_space(struct lf12_metadata *f12_meta, uint16_t cluster,
+			     uint16_t value)
+{
+	struct lf12_free_space *free_space = f12_meta->free_space;
+
+	if (NULL == free_space || cluster < 2 || cluster >= free_space->end) {
+		return;
+	}
+
+	if (0 == value) {
+		mark_free(free_space, cluster);
+	} else {
+		mark_used(free_space, cluster);
+	}
+}
+
+unsigned int _lf12_get_free_cluster_count(struct lf12_metadata *f12_meta)
+{
+	struct lf12_free_space *free_space = get_free_space(f12_meta);
+	unsigned int free_count = 0;
+	uint16_t end;
+
+	if (NULL != free_space) {
+		return free_space->free_count;
+	}
+
+	end = _lf12_clusters_end(f12_meta);
+	for (int cluster = 2; cluster < end; cluster++) {
+		if (0 == f12_meta->fat_entries[cluster]) {
+			free_count++;
+		}
+	}
+
+	return free_count;
+}
+
+uint16_t _lf12_next_free_cluster(struct lf12_metadata *f12_meta,
+				 uint16_t cluster)
+{
+	struct lf12_free_space *free_space = get_free_space(f12_meta);
+	struct free_extent *extent;
+	size_t position;
+	uint16_t end;
+
+	if (NULL == free_space) {
+		end = _lf12_clusters_end(f12_meta);
+		for (int i = 2; i < end; i++) {
+			cluster++;
+			if (cluster < 2 || cluster >= end) {
+				cluster = 2;
+			}
+			if (0 == f12_meta->fat_entries[cluster]) {
+				return cluster;
+			}
+		}
+
+		return 0;
+	}
+
+	if (0 == free_space->extent_count) {
+		return 0;
+	}
+
+	// The cluster behind may be inside the extent before the next one
+	position = extent_behind(free_space, cluster);
+	if (position > 0) {
+		extent = &free_space->extents[position - 1];
+		if (cluster + 1 < extent->start + extent->length) {
+			return cluster + 1;
+		}
+	}
+	if (position < free_space->extent_count) {
+		return free_space->extents[position].start;
+	}
+
+	return free_space->extents[0].start;
+}
+
+/**
+ * Find the smallest free extent, that holds a number of clusters. The largest
+ * free extent is used, if none is large enough or the number is not known.
+ *
+ * @param free_space a pointer to the index of the free clusters
+ * @param cluster_count the number of clusters or 0 if it is not known
+ * @return a pointer to the free extent
+ */
+static struct free_extent *best_fit(struct lf12_free_space *free_space,
+				    unsigned int cluster_count)
+{
+	struct free_extent *extent, *best = NULL,
+		*largest = &free_space->extents[0];
+
+	for (size_t i = 0; i < free_space->extent_count; i++) {
+		extent = &free_space->extents[i];
+		if (extent->length > largest->length) {
+			largest = extent;
+		}
+		if (0 == cluster_count || extent->length < cluster_count) {
+			continue;
+		}
+		if (NULL == best || extent->length < best->length) {
+			best = extent;
+		}
+	}
+
+	return NULL == best ? largest : best;
+}
+
+uint16_t _lf12_choose_free_cluster(struct lf12_metadata *f12_meta,
+				   uint16_t last_cluster,
+				   unsigned int cluster_count)
+{
+	struct lf12_free_space *free_space = get_free_space(f12_meta);
+	uint16_t next_cluster = last_cluster + 1;
+
+	if (NULL == free_space) {
+		return _lf12_next_free_cluster(f12_meta, last_cluster);
+	}
+	if (0 == free_space->extent_count) {
+		return 0;
+	}
+
+	// Keep the chain contiguous
+	if (0 != last_cluster && next_cluster < free_space->end &&
+	    is_free(free_space, next_cluster)) {
+		return next_cluster;
+	}
+
+	switch (f12_meta->allocation_policy) {
+	case F12_ALLOC_NEXT_FIT:
+		if (0 == last_cluster) {
+			last_cluster = free_space->last_allocated;
+		}
+		break;
+	case F12_ALLOC_BEST_FIT:
+		return best_fit(free_space, cluster_count)->start;
+	default:
+		break;
+	}
+
+	return _lf12_next_free_cluster(f12_meta, last_cluster);
+}
+
+void _lf12_drop_free_space(struct lf12_metadata *f12_meta)
+{
+	if (NULL == f12_meta->free_space) {
+		return;
+	}
+
+	free(f12_meta->free_space->bitmap);
+	free(f12_meta->free_space->extents);
+	free(f12_meta->free_space);
+	f12_meta->free_space = NULL;
+}
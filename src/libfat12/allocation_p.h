@@ -0,0 +1,63 @@
+#ifndef LF12_ALLOCATION_P_H
+#define LF12_ALLOCATION_P_H
+
+#include "libfat12.h"
+
+/**
+ * Update the index of the free clusters after an entry of the file allocation
+ * table was set. Nothing happens, if the index was not built yet.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param cluster the number of the entry, that was set
+ * @param value the new value of the entry
+ */
+void _lf12_update_free_space(struct lf12_metadata *f12_meta, uint16_t cluster,
+			     uint16_t value);
+
+/**
+ * Get the number of free clusters of a partition.
+ *
+ * The index of the free clusters is built from the file allocation table on
+ * the first call and kept up to date by _lf12_set_fat_entry afterwards.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @return the number of free clusters
+ */
+unsigned int _lf12_get_free_cluster_count(struct lf12_metadata *f12_meta);
+
+/**
+ * Find the next free cluster behind a cluster. The search wraps around to the
+ * start of the data area.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param cluster the number of the cluster to start the search behind
+ * @return the number of the next free cluster or zero if the partition is full
+ */
+uint16_t _lf12_next_free_cluster(struct lf12_metadata *f12_meta,
+				 uint16_t cluster);
+
+/**
+ * Choose the next cluster of a cluster chain according to the allocation
+ * policy of the partition. A chain is always continued with the cluster behind
+ * its last cluster, if that one is free.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param last_cluster the last cluster of the chain or 0 for a new chain
+ * @param cluster_count the number of clusters the chain still needs or 0 if it
+ * is not known
+ * @return the number of a free cluster or zero if the partition is full
+ */
+uint16_t _lf12_choose_free_cluster(struct lf12_metadata *f12_meta,
+				   uint16_t last_cluster,
+				   unsigned int cluster_count);
+
+/**
+ * Release the index of the free clusters. It is built again on the next use.
+ * This must be called, when the file allocation table is replaced without
+ * _lf12_set_fat_entry.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ */
+void _lf12_drop_free_space(struct lf12_metadata *f12_meta);
+
+#endif
@@ -0,0 +1,92 @@
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "arena_p.h"
+#include "libfat12.h"
+
+// Size of the blocks the arena takes from the heap. Larger allocations get a
+// block of their own.
+#define ARENA_BLOCK_SIZE (128 * 1024)
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+
+/**
+ * A block of memory of an arena.
+ */
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	// The memory handed out, aligned for any type
+	_Alignas(max_align_t) char data[];
+};
+
+struct lf12_arena {
+	// The block memory is allocated from, followed by all full blocks
+	struct arena_block *blocks;
+};
+
+static struct arena_block *create_block(size_t size)
+{
+	struct arena_block *block = calloc(1, sizeof(struct arena_block) +
+					   size);
+
+	if (NULL == block) {
+		return NULL;
+	}
+	block->size = size;
+
+	return block;
+}
+
+struct lf12_arena *_lf12_create_arena(void)
+{
+	return calloc(1, sizeof(struct lf12_arena));
+}
+
+void *_lf12_arena_alloc(struct lf12_arena *arena, size_t size)
+{
+	struct arena_block *block = arena->blocks;
+	void *memory;
+
+	size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+	if (NULL != block && block->size - block->used >= size) {
+		memory = block->data + block->used;
+		block->used += size;
+
+		return memory;
+	}
+
+	block = create_block(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+	if (NULL == block) {
+		return NULL;
+	}
+	block->used = size;
+
+	// Keep allocating from the current block, if it has more room left
+	if (NULL != arena->blocks && block->size - block->used <
+	    arena->blocks->size - arena->blocks->used) {
+		block->next = arena->blocks->next;
+		arena->blocks->next = block;
+	} else {
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+
+	return block->data;
+}
+
+void _lf12_free_arena(struct lf12_arena *arena)
+{
+	struct arena_block *block, *next;
+
+	if (NULL == arena) {
+		return;
+	}
+
+	for (block = arena->blocks; NULL != block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(arena);
+}
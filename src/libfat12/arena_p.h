@@ -0,0 +1,32 @@
+#ifndef LF12_ARENA_P_H
+#define LF12_ARENA_P_H
+
+#include <stddef.h>
+
+#include "libfat12.h"
+
+/**
+ * Create an arena, that hands out memory from a few large blocks. The memory
+ * can not be released piece by piece, but only all at once with the arena.
+ *
+ * @return a pointer to the new arena or NULL if the allocation failed
+ */
+struct lf12_arena *_lf12_create_arena(void);
+
+/**
+ * Allocate zeroed memory from an arena. The memory is aligned for any type.
+ *
+ * @param arena a pointer to the arena
+ * @param size the number of bytes to allocate
+ * @return a pointer to the memory or NULL if the allocation failed
+ */
+void *_lf12_arena_alloc(struct lf12_arena *arena, size_t size);
+
+/**
+ * Release an arena and all memory allocated from it.
+ *
+ * @param arena a pointer to the arena or NULL
+ */
+void _lf12_free_arena(struct lf12_arena *arena);
+
+#endif
@@ -0,0 +1,597 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "libfat12.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+struct cache_block {
+	// Number of the block on the backing device
+	off_t number;
+	// Contents of the block
+	char *data;
+	// Non zero if the block holds data of the backing device
+	int valid;
+	// Non zero if the block was modified since it was written back
+	int dirty;
+	// Neighbours in the list of blocks ordered by their last use
+	struct cache_block *newer;
+	struct cache_block *older;
+	// Next block in the same bucket of the hash table
+	struct cache_block *hash_next;
+};
+
+struct cache_device_data {
+	struct lf12_device *backing;
+	size_t block_size;
+	size_t block_count;
+	// Size of the backing device including all cached writes
+	off_t size;
+	struct cache_block *blocks;
+	// Most and least recently used blocks
+	struct cache_block *newest;
+	struct cache_block *oldest;
+	struct cache_block **buckets;
+};
+
+static size_t bucket_of(struct cache_device_data *data, off_t number)
+{
+	return (size_t) number % data->block_count;
+}
+
+static struct cache_block *find_block(struct cache_device_data *data,
+				      off_t number)
+{
+	struct cache_block *block = data->buckets[bucket_of(data, number)];
+
+	while (NULL != block) {
+		if (block->valid && block->number == number) {
+			return block;
+		}
+		block = block->hash_next;
+	}
+
+	return NULL;
+}
+
+static void unhash_block(struct cache_device_data *data,
+			 struct cache_block *block)
+{
+	struct cache_block **link = &data->buckets[bucket_of(data,
+							     block->number)];
+
+	while (NULL != *link) {
+		if (*link == block) {
+			*link = block->hash_next;
+			break;
+		}
+		link = &(*link)->hash_next;
+	}
+	block->hash_next = NULL;
+}
+
+/**
+ * Mark a block as the most recently used one.
+ *
+ * @param data a pointer to the private data of the cache
+ * @param block a pointer to the block
+ */
+static void touch_block(struct cache_device_data *data,
+			struct cache_block *block)
+{
+	if (data->newest == block) {
+		return;
+	}
+
+	// Unlink the block
+	if (NULL != block->newer) {
+		block->newer->older = block->older;
+	}
+	if (NULL != block->older) {
+		block->older->newer = block->newer;
+	}
+	if (data->oldest == block) {
+		data->oldest = block->newer;
+	}
+
+	block->newer = NULL;
+	block->older = data->newest;
+	data->newest->newer = block;
+	data->newest = block;
+}
+
+/**
+ * Get the number of bytes of a block, that lie within the device.
+ *
+ * @param data a pointer to the private data of the cache
+ * @param number the number of the block
+ * @return the number of bytes of the block on the device
+ */
+static size_t block_extent(struct cache_device_data *data, off_t number)
+{
+	off_t start = number * data->block_size;
+
+	if (start >= data->size) {
+		return 0;
+	}
+	if (data->size - start < (off_t) data->block_size) {
+		return data->size - start;
+	}
+
+	return data->block_size;
+}
+
+static enum lf12_error write_back_block(struct cache_device_data *data,
+					struct cache_block *block)
+{
+	enum lf12_error err;
+
+	err = lf12_device_write(data->backing, block->data,
+				block_extent(data, block->number),
+				block->number * data->block_size);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+	block->dirty = 0;
+
+	return F12_SUCCESS;
+}
+
+/**
+ * Get the cache block for a block of the backing device. The least recently
+ * used block is evicted if the block is not cached yet.
+ *
+ * @param data a pointer to the private data of the cache
+ * @param number the number of the block on the backing device
+ * @param load if non zero, the contents of the block are read from the backing
+ * device if the block is not cached yet
+ * @param block a pointer to the pointer, that is set to the cache block
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error get_block(struct cache_device_data *data, off_t number,
+				 int load, struct cache_block **block)
+{
+	enum lf12_error err;
+	struct cache_block *victim;
+	size_t extent;
+
+	*block = find_block(data, number);
+	if (NULL != *block) {
+		touch_block(data, *block);
+
+		return F12_SUCCESS;
+	}
+
+	victim = data->oldest;
+	if (victim->valid) {
+		if (victim->dirty) {
+			err = write_back_block(data, victim);
+			if (F12_SUCCESS != err) {
+				return err;
+			}
+		}
+		unhash_block(data, victim);
+		victim->valid = 0;
+	}
+
+	if (load) {
+		extent = block_extent(data, number);
+		err = lf12_device_read(data->backing, victim->data, extent,
+				       number * data->block_size);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+		memset(victim->data + extent, 0, data->block_size - extent);
+	}
+
+	victim->number = number;
+	victim->valid = 1;
+	victim->hash_next = data->buckets[bucket_of(data, number)];
+	data->buckets[bucket_of(data, number)] = victim;
+	touch_block(data, victim);
+	*block = victim;
+
+	return F12_SUCCESS;
+}
+
+/**
+ * Write back the modified cached blocks in a range of the device, so that
+ * the range can be accessed on the backing device directly.
+ *
+ * @param data a pointer to the private data of the cache
+ * @param count the number of bytes in the range
+ * @param offset the offset of the range
+ * @param drop if non zero, the blocks are removed from the cache
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error write_back_range(struct cache_device_data *data,
+					size_t count, off_t offset, int drop)
+{
+	struct cache_block *block;
+	enum lf12_error err;
+	off_t first = offset / data->block_size;
+	off_t last = (offset + count - 1) / data->block_size;
+
+	if (0 == count) {
+		return F12_SUCCESS;
+	}
+
+	for (off_t number = first; number <= last; number++) {
+		block = find_block(data, number);
+		if (NULL == block) {
+			continue;
+		}
+		if (block->dirty) {
+			err = write_back_block(data, block);
+			if (F12_SUCCESS != err) {
+				return err;
+			}
+		}
+		if (drop) {
+			unhash_block(data, block);
+			block->valid = 0;
+		}
+	}
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error cache_read_at(struct lf12_device *device, void *buf,
+				     size_t count, off_t offset)
+{
+	struct cache_device_data *data = device->data;
+	struct cache_block *block;
+	enum lf12_error err;
+	size_t block_offset, chunk;
+
+	if (offset < 0 || offset + (off_t) count > data->size) {
+		return F12_IO_ERROR;
+	}
+
+	while (count > 0) {
+		block_offset = offset % data->block_size;
+		chunk = data->block_size - block_offset;
+		if (chunk > count) {
+			chunk = count;
+		}
+
+		err = get_block(data, offset / data->block_size, 1, &block);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+		memcpy(buf, block->data + block_offset, chunk);
+
+		buf = (char *)buf + chunk;
+		count -= chunk;
+		offset += chunk;
+	}
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error cache_write_at(struct lf12_device *device,
+				      const void *buf, size_t count,
+				      off_t offset)
+{
+	struct cache_device_data *data = device->data;
+	struct cache_block *block;
+	enum lf12_error err;
+	size_t block_offset, chunk;
+	int whole_block;
+
+	if (offset < 0) {
+		return F12_IO_ERROR;
+	}
+
+	while (count > 0) {
+		block_offset = offset % data->block_size;
+		chunk = data->block_size - block_offset;
+		if (chunk > count) {
+			chunk = count;
+		}
+		// Blocks, that are overwritten completely, need not be read
+		whole_block = 0 == block_offset && chunk == data->block_size;
+
+		err = get_block(data, offset / data->block_size, !whole_block,
+				&block);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+		memcpy(block->data + block_offset, buf, chunk);
+		block->dirty = 1;
+
+		buf = (const char *)buf + chunk;
+		count -= chunk;
+		offset += chunk;
+		if (offset > data->size) {
+			data->size = offset;
+		}
+	}
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error cache_copy_to_fd(struct lf12_device *device, int fd,
+					size_t count, off_t offset)
+{
+	struct cache_device_data *data = device->data;
+	enum lf12_error err;
+
+	err = write_back_range(data, count, offset, 0);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+
+	return lf12_device_copy_to_fd(data->backing, fd, count, offset);
+}
+
+static enum lf12_error cache_copy_from_fd(struct lf12_device *device, int fd,
+					  size_t count, off_t offset)
+{
+	struct cache_device_data *data = device->data;
+	enum lf12_error err;
+
+	// The cached blocks of the range become stale
+	err = write_back_range(data, count, offset, 1);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+
+	err = lf12_device_copy_from_fd(data->backing, fd, count, offset);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+	if (offset + (off_t) count > data->size) {
+		data->size = offset + count;
+	}
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error cache_resize(struct lf12_device *device, off_t size,
+				    int allocate)
+{
+	struct cache_device_data *data = device->data;
+	enum lf12_error err;
+
+	if (size < 0) {
+		return F12_IO_ERROR;
+	}
+
+	if (size < data->size) {
+		// Cached blocks behind the new end of the device become stale
+		err = write_back_range(data, data->size - size, size, 1);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+	}
+
+	err = lf12_device_resize(data->backing, size, allocate);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+	data->size = size;
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error cache_discard(struct lf12_device *device, size_t count,
+				     off_t offset)
+{
+	struct cache_device_data *data = device->data;
+	enum lf12_error err;
+
+	err = write_back_range(data, count, offset, 1);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+
+	return lf12_device_discard(data->backing, count, offset);
+}
+
+static int compare_blocks(const void *a, const void *b)
+{
+	const struct cache_block *first = *(struct cache_block * const *)a;
+	const struct cache_block *second = *(struct cache_block * const *)b;
+
+	if (first->number < second->number) {
+		return -1;
+	}
+
+	return first->number > second->number;
+}
+
+/**
+ * Write all dirty blocks back to the backing device. The blocks are sorted and
+ * consecutive blocks are written with a single vectored write.
+ *
+ * @param device a pointer to the device
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error cache_flush(struct lf12_device *device)
+{
+	struct cache_device_data *data = device->data;
+	struct cache_block **dirty;
+	struct iovec *iov;
+	enum lf12_error err = F12_SUCCESS;
+	size_t dirty_count = 0, run;
+
+	dirty = malloc(data->block_count * sizeof(struct cache_block *));
+	iov = malloc(data->block_count * sizeof(struct iovec));
+	if (NULL == dirty || NULL == iov) {
+		free(dirty);
+		free(iov);
+
+		return F12_ALLOCATION_ERROR;
+	}
+
+	for (size_t i = 0; i < data->block_count; i++) {
+		if (data->blocks[i].valid && data->blocks[i].dirty) {
+			dirty[dirty_count++] = &data->blocks[i];
+		}
+	}
+	qsort(dirty, dirty_count, sizeof(struct cache_block *),
+	      compare_blocks);
+
+	for (size_t i = 0; i < dirty_count; i += run) {
+		run = 0;
+		do {
+			iov[run].iov_base = dirty[i + run]->data;
+			iov[run].iov_len =
+				block_extent(data, dirty[i + run]->number);
+			run++;
+		} while (i + run < dirty_count && run < IOV_MAX &&
+			 dirty[i + run]->number ==
+			 dirty[i + run - 1]->number + 1);
+
+		err = lf12_device_writev(data->backing, iov, run,
+					 dirty[i]->number * data->block_size);
+		if (F12_SUCCESS != err) {
+			break;
+		}
+		for (size_t j = i; j < i + run; j++) {
+			dirty[j]->dirty = 0;
+		}
+	}
+
+	free(dirty);
+	free(iov);
+
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+
+	return lf12_device_flush(data->backing);
+}
+
+/**
+ * Invalidate all dirty blocks without writing them back. The size of the
+ * device is reset to the size of the backing device, as writes past its end
+ * are dropped too.
+ *
+ * @param device a pointer to the device
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error cache_drop(struct lf12_device *device)
+{
+	struct cache_device_data *data = device->data;
+	struct cache_block *block;
+
+	for (size_t i = 0; i < data->block_count; i++) {
+		block = &data->blocks[i];
+		if (block->valid && block->dirty) {
+			unhash_block(data, block);
+			block->valid = 0;
+			block->dirty = 0;
+		}
+	}
+
+	return lf12_device_size(data->backing, &data->size);
+}
+
+static enum lf12_error cache_size(struct lf12_device *device, off_t *size)
+{
+	struct cache_device_data *data = device->data;
+
+	*size = data->size;
+
+	return F12_SUCCESS;
+}
+
+static void free_cache_data(struct cache_device_data *data)
+{
+	if (NULL != data->blocks) {
+		for (size_t i = 0; i < data->block_count; i++) {
+			free(data->blocks[i].data);
+		}
+	}
+	free(data->blocks);
+	free(data->buckets);
+	free(data);
+}
+
+static void cache_close(struct lf12_device *device)
+{
+	struct cache_device_data *data = device->data;
+
+	lf12_close_device(data->backing);
+	free_cache_data(data);
+}
+
+enum lf12_error lf12_open_cached_device(struct lf12_device *backing,
+					size_t block_size, size_t block_count,
+					struct lf12_device **device)
+{
+	enum lf12_error err;
+	struct cache_device_data *data;
+	struct cache_block *block;
+
+	if (0 == block_size || 0 == block_count) {
+		return F12_LOGIC_ERROR;
+	}
+
+	data = calloc(1, sizeof(struct cache_device_data));
+	if (NULL == data) {
+		return F12_ALLOCATION_ERROR;
+	}
+
+	err = lf12_device_size(backing, &data->size);
+	if (F12_SUCCESS != err) {
+		free(data);
+
+		return err;
+	}
+
+	data->backing = backing;
+	data->block_size = block_size;
+	data->block_count = block_count;
+	data->blocks = calloc(block_count, sizeof(struct cache_block));
+	data->buckets = calloc(block_count, sizeof(struct cache_block *));
+	if (NULL == data->blocks || NULL == data->buckets) {
+		free_cache_data(data);
+
+		return F12_ALLOCATION_ERROR;
+	}
+
+	for (size_t i = 0; i < block_count; i++) {
+		block = &data->blocks[i];
+		block->data = malloc(block_size);
+		if (NULL == block->data) {
+			free_cache_data(data);
+
+			return F12_ALLOCATION_ERROR;
+		}
+		// Initially the blocks are ordered by their position
+		block->newer = i > 0 ? &data->blocks[i - 1] : NULL;
+		block->older = i + 1 < block_count ?
+			&data->blocks[i + 1] : NULL;
+	}
+	data->newest = &data->blocks[0];
+	data->oldest = &data->blocks[block_count - 1];
+
+	*device = calloc(1, sizeof(struct lf12_device));
+	if (NULL == *device) {
+		free_cache_data(data);
+
+		return F12_ALLOCATION_ERROR;
+	}
+
+	(*device)->data = data;
+	(*device)->read_at = cache_read_at;
+	(*device)->write_at = cache_write_at;
+	(*device)->flush = cache_flush;
+	(*device)->drop = cache_drop;
+	(*device)->size = cache_size;
+	(*device)->copy_to_fd = cache_copy_to_fd;
+	(*device)->copy_from_fd = cache_copy_from_fd;
+	(*device)->resize = cache_resize;
+	(*device)->discard = cache_discard;
+	(*device)->close = cache_close;
+
+	return F12_SUCCESS;
+}
@@ -0,0 +1,383 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "io_p.h"
+#include "libfat12.h"
+#include "metadata_p.h"
+
+// First character of the name of a deleted directory entry
+#define DELETED_ENTRY 0xe5
+
+/**
+ * The new layout of the clusters of a partition.
+ */
+struct defrag_plan {
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	// The first cluster behind the data area
+	uint16_t end;
+	// Non zero for every cluster in the chain of a file or directory
+	uint8_t *in_chain;
+	// The new position of every cluster in the chain of a file or directory
+	uint16_t *target;
+	// The next cluster of the new layout
+	uint16_t next_target;
+	struct lf12_defrag_stats *stats;
+};
+
+static int is_end_of_chain(uint16_t entry)
+{
+	return entry > LF12_CLUSTER_BAD;
+}
+
+static int is_moved(struct defrag_plan *plan, uint16_t cluster)
+{
+	return plan->in_chain[cluster] && plan->target[cluster] != cluster;
+}
+
+/**
+ * Check whether a directory entry owns no cluster chain, because it is empty
+ * or was deleted.
+ *
+ * @param entry a pointer to the directory entry
+ * @return 1 if the entry is empty or deleted else 0
+ */
+static int is_unused(struct lf12_directory_entry *entry)
+{
+	return lf12_entry_is_empty(entry) ||
+		DELETED_ENTRY == (uint8_t) entry->ShortFileName[0];
+}
+
+/**
+ * Mark the clusters of a chain and count its extents.
+ *
+ * @param plan a pointer to the layout
+ * @param cluster the first cluster of the chain
+ * @return F12_SUCCESS or F12_INVALID_CHAIN if the chain leaves the data area,
+ * contains a free or bad cluster or shares clusters with another chain
+ */
+static enum lf12_error collect_chain(struct defrag_plan *plan,
+				     uint16_t cluster)
+{
+	uint16_t *fat_entries = plan->f12_meta->fat_entries;
+	uint16_t entry;
+
+	plan->stats->chain_count++;
+	plan->stats->extents_before++;
+
+	while (1) {
+		if (cluster < 2 || cluster >= plan->end ||
+		    plan->in_chain[cluster]) {
+			return F12_INVALID_CHAIN;
+		}
+		plan->in_chain[cluster] = 1;
+
+		entry = fat_entries[cluster];
+		if (is_end_of_chain(entry)) {
+			return F12_SUCCESS;
+		}
+		if (entry != cluster + 1) {
+			plan->stats->extents_before++;
+		}
+		cluster = entry;
+	}
+}
+
+/**
+ * Assign the next clusters of the new layout to a chain. Clusters, that are
+ * used but do not belong to any file or directory, stay where they are.
+ *
+ * @param plan a pointer to the layout
+ * @param cluster the first cluster of the chain
+ * @return F12_SUCCESS
+ */
+static enum lf12_error place_chain(struct defrag_plan *plan, uint16_t cluster)
+{
+	uint16_t *fat_entries = plan->f12_meta->fat_entries;
+	uint16_t target, previous = 0;
+
+	while (1) {
+		while (LF12_CLUSTER_FREE != fat_entries[plan->next_target] &&
+		       !plan->in_chain[plan->next_target]) {
+			plan->next_target++;
+		}
+		target = plan->next_target++;
+
+		plan->target[cluster] = target;
+		if (target != cluster) {
+			plan->stats->moved_clusters++;
+		}
+		if (0 == previous || target != previous + 1) {
+			plan->stats->extents_after++;
+		}
+		previous = target;
+
+		if (is_end_of_chain(fat_entries[cluster])) {
+			return F12_SUCCESS;
+		}
+		cluster = fat_entries[cluster];
+	}
+}
+
+/**
+ * Visit the chains of all files and directories below a directory in the
+ * order of the new layout. The table of every directory comes directly before
+ * the files in it. Directory tables, that are not loaded yet, are loaded.
+ *
+ * @param plan a pointer to the layout
+ * @param dir a pointer to the directory
+ * @param visit the function called with the first cluster of every chain
+ * @return F12_SUCCESS or the first error that occurred
+ */
+static enum lf12_error walk_directory(struct defrag_plan *plan,
+				      struct lf12_directory_entry *dir,
+				      enum lf12_error (*visit)(struct
+							       defrag_plan *,
+							       uint16_t))
+{
+	enum lf12_error err;
+	struct lf12_directory_entry *entry;
+
+	for (int i = 0; i < dir->child_count; i++) {
+		entry = &dir->children[i];
+		if (is_unused(entry) || lf12_is_directory(entry) ||
+		    0 == entry->FirstCluster) {
+			continue;
+		}
+		err = visit(plan, entry->FirstCluster);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+	}
+
+	for (int i = 0; i < dir->child_count; i++) {
+		entry = &dir->children[i];
+		if (is_unused(entry) || !lf12_is_directory(entry) ||
+		    lf12_is_dot_dir(entry) || 0 == entry->FirstCluster) {
+			continue;
+		}
+		err = visit(plan, entry->FirstCluster);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+		err = lf12_load_directory(plan->device, plan->f12_meta, entry,
+					  0);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+		err = walk_directory(plan, entry, visit);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+	}
+
+	return F12_SUCCESS;
+}
+
+/**
+ * Create the file allocation table for the new layout.
+ *
+ * @param plan a pointer to the layout
+ * @return a pointer to the entries of the new table, that must be freed, or
+ * NULL if the allocation failed
+ */
+static uint16_t *relink_chains(struct defrag_plan *plan)
+{
+	uint16_t *fat_entries = plan->f12_meta->fat_entries;
+	uint16_t *entries = malloc(plan->end * sizeof(uint16_t));
+	uint16_t next;
+
+	if (NULL == entries) {
+		return NULL;
+	}
+	memcpy(entries, fat_entries, plan->end * sizeof(uint16_t));
+
+	for (uint16_t cluster = 2; cluster < plan->end; cluster++) {
+		if (plan->in_chain[cluster]) {
+			entries[cluster] = LF12_CLUSTER_FREE;
+		}
+	}
+	for (uint16_t cluster = 2; cluster < plan->end; cluster++) {
+		if (!plan->in_chain[cluster]) {
+			continue;
+		}
+		next = fat_entries[cluster];
+		entries[plan->target[cluster]] = is_end_of_chain(next) ?
+			next : plan->target[next];
+	}
+
+	return entries;
+}
+
+/**
+ * Copy the data of all moved clusters to their new position. The data of all
+ * of them is read before the first one is written, so that no cluster is
+ * overwritten before it was copied. Runs of clusters, that are consecutive at
+ * their old and their new position, are read with a single access and runs of
+ * consecutive new positions are written with a single access.
+ *
+ * @param plan a pointer to the layout
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error move_clusters(struct defrag_plan *plan)
+{
+	enum lf12_error err = F12_SUCCESS;
+	struct lf12_metadata *f12_meta = plan->f12_meta;
+	size_t cluster_size = _lf12_get_cluster_size(f12_meta);
+	uint16_t first = plan->end, last = 0, run;
+	off_t offset;
+	// The old position of the cluster moved to each cluster
+	uint16_t *source;
+	char *buffer;
+
+	for (uint16_t cluster = 2; cluster < plan->end; cluster++) {
+		if (!is_moved(plan, cluster)) {
+			continue;
+		}
+		if (plan->target[cluster] < first) {
+			first = plan->target[cluster];
+		}
+		if (plan->target[cluster] > last) {
+			last = plan->target[cluster];
+		}
+	}
+	if (first > last) {
+		return F12_SUCCESS;
+	}
+
+	source = calloc(plan->end, sizeof(uint16_t));
+	buffer = malloc((last - first + 1) * cluster_size);
+	if (NULL == source || NULL == buffer) {
+		free(source);
+		free(buffer);
+
+		return F12_ALLOCATION_ERROR;
+	}
+
+	for (uint16_t cluster = 2; cluster < plan->end; cluster += run) {
+		run = 1;
+		if (!is_moved(plan, cluster)) {
+			continue;
+		}
+		source[plan->target[cluster]] = cluster;
+		while (cluster + run < plan->end &&
+		       is_moved(plan, cluster + run) &&
+		       plan->target[cluster + run] ==
+		       plan->target[cluster] + run) {
+			source[plan->target[cluster + run]] = cluster + run;
+			run++;
+		}
+		offset = _lf12_cluster_offset(cluster, f12_meta);
+		err = lf12_device_read(plan->device, buffer +
+				       (plan->target[cluster] - first) *
+				       cluster_size, run * cluster_size,
+				       offset);
+		if (F12_SUCCESS != err) {
+			break;
+		}
+	}
+
+	for (uint16_t cluster = first; F12_SUCCESS == err && cluster <= last;
+	     cluster += run) {
+		run = 1;
+		if (0 == source[cluster]) {
+			continue;
+		}
+		while (cluster + run <= last && 0 != source[cluster + run]) {
+			run++;
+		}
+		offset = _lf12_cluster_offset(cluster, f12_meta);
+		err = lf12_device_write(plan->device, buffer +
+					(cluster - first) * cluster_size,
+					run * cluster_size, offset);
+	}
+
+	free(source);
+	free(buffer);
+
+	return err;
+}
+
+/**
+ * Point the entries of a directory and all its subdirectories to the new
+ * position of their first cluster. This includes the dot directories.
+ *
+ * @param plan a pointer to the layout
+ * @param dir a pointer to the directory
+ */
+static void remap_entries(struct defrag_plan *plan,
+			  struct lf12_directory_entry *dir)
+{
+	struct lf12_directory_entry *entry;
+	uint16_t cluster;
+
+	for (int i = 0; i < dir->child_count; i++) {
+		entry = &dir->children[i];
+		cluster = entry->FirstCluster;
+		if (is_unused(entry) || cluster < 2 || cluster >= plan->end ||
+		    !plan->in_chain[cluster]) {
+			continue;
+		}
+		if (plan->target[cluster] != cluster) {
+			entry->FirstCluster = plan->target[cluster];
+			dir->dirty = 1;
+		}
+		if (lf12_is_directory(entry) && !lf12_is_dot_dir(entry)) {
+			remap_entries(plan, entry);
+		}
+	}
+}
+
+enum lf12_error lf12_defragment(struct lf12_device *device,
+				struct lf12_metadata *f12_meta, int dry_run,
+				struct lf12_defrag_stats *stats)
+{
+	enum lf12_error err;
+	struct defrag_plan plan = {
+		.device = device,
+		.f12_meta = f12_meta,
+		.end = _lf12_clusters_end(f12_meta),
+		.next_target = 2,
+		.stats = stats,
+	};
+	uint16_t *fat_entries = f12_meta->fat_entries, *entries = NULL;
+
+	memset(stats, 0, sizeof(struct lf12_defrag_stats));
+	plan.in_chain = calloc(plan.end, 1);
+	plan.target = calloc(plan.end, sizeof(uint16_t));
+	if (NULL == plan.in_chain || NULL == plan.target) {
+		free(plan.in_chain);
+		free(plan.target);
+
+		return F12_ALLOCATION_ERROR;
+	}
+
+	err = walk_directory(&plan, f12_meta->root_dir, collect_chain);
+	if (F12_SUCCESS == err) {
+		err = walk_directory(&plan, f12_meta->root_dir, place_chain);
+	}
+	if (F12_SUCCESS == err && !dry_run && stats->moved_clusters) {
+		entries = relink_chains(&plan);
+		if (NULL == entries) {
+			err = F12_ALLOCATION_ERROR;
+		}
+	}
+	if (NULL != entries) {
+		err = move_clusters(&plan);
+	}
+	if (NULL != entries && F12_SUCCESS == err) {
+		for (uint16_t cluster = 2; cluster < plan.end; cluster++) {
+			if (entries[cluster] != fat_entries[cluster]) {
+				_lf12_set_fat_entry(f12_meta, cluster,
+						    entries[cluster]);
+			}
+		}
+		remap_entries(&plan, f12_meta->root_dir);
+	}
+
+	free(entries);
+	free(plan.in_chain);
+	free(plan.target);
+
+	return err;
+}
@@ -0,0 +1,716 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "libfat12.h"
+
+struct fd_device_data {
+	int fd;
+};
+
+struct memory_device_data {
+	char *buffer;
+	size_t size;
+};
+
+struct mmap_device_data {
+	int fd;
+	char *map;
+	size_t size;
+	int writable;
+};
+
+/**
+ * Read from a file descriptor at a given offset until the requested number of
+ * bytes is read.
+ *
+ * @param device a pointer to the device
+ * @param buf the buffer to read into
+ * @param count the number of bytes to read
+ * @param offset the offset on the device to start reading from
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error fd_read_at(struct lf12_device *device, void *buf,
+				  size_t count, off_t offset)
+{
+	struct fd_device_data *data = device->data;
+	ssize_t res;
+
+	while (count > 0) {
+		res = pread(data->fd, buf, count, offset);
+		if (-1 == res) {
+			if (EINTR == errno) {
+				continue;
+			}
+			lf12_save_errno();
+
+			return F12_IO_ERROR;
+		}
+		if (0 == res) {
+			// Unexpected end of the file
+			return F12_IO_ERROR;
+		}
+		buf = (char *)buf + res;
+		count -= res;
+		offset += res;
+	}
+
+	return F12_SUCCESS;
+}
+
+/**
+ * Write to a file descriptor at a given offset until the requested number of
+ * bytes is written.
+ *
+ * @param device a pointer to the device
+ * @param buf the data to write
+ * @param count the number of bytes to write
+ * @param offset the offset on the device to start writing at
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error fd_write_at(struct lf12_device *device, const void *buf,
+				   size_t count, off_t offset)
+{
+	struct fd_device_data *data = device->data;
+	ssize_t res;
+
+	while (count > 0) {
+		res = pwrite(data->fd, buf, count, offset);
+		if (-1 == res) {
+			if (EINTR == errno) {
+				continue;
+			}
+			lf12_save_errno();
+
+			return F12_IO_ERROR;
+		}
+		buf = (const char *)buf + res;
+		count -= res;
+		offset += res;
+	}
+
+	return F12_SUCCESS;
+}
+
+/**
+ * Write multiple buffers to a file descriptor at a given offset until all of
+ * them are written.
+ *
+ * @param device a pointer to the device
+ * @param iov a pointer to the array with the buffers to write
+ * @param iovcnt the number of buffers in the array
+ * @param offset the offset on the device to start writing at
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error fd_writev_at(struct lf12_device *device,
+				    const struct iovec *iov, int iovcnt,
+				    off_t offset)
+{
+	struct fd_device_data *data = device->data;
+	enum lf12_error err;
+	size_t rest;
+	ssize_t res;
+
+	while (iovcnt > 0) {
+		res = pwritev(data->fd, iov, iovcnt, offset);
+		if (-1 == res) {
+			if (EINTR == errno) {
+				continue;
+			}
+			lf12_save_errno();
+
+			return F12_IO_ERROR;
+		}
+		offset += res;
+		// Skip all buffers, that were written completely
+		while (iovcnt > 0 && (size_t) res >= iov->iov_len) {
+			res -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (res > 0) {
+			// Finish the partially written buffer on its own
+			rest = iov->iov_len - res;
+			err = fd_write_at(device, (char *)iov->iov_base + res,
+					  rest, offset);
+			if (F12_SUCCESS != err) {
+				return err;
+			}
+			offset += rest;
+			iov++;
+			iovcnt--;
+		}
+	}
+
+	return F12_SUCCESS;
+}
+
+/**
+ * Check whether an error of copy_file_range or sendfile means, that the files
+ * can not be copied this way.
+ *
+ * @param error the error number
+ * @return 1 if the copy is not supported for the files else 0
+ */
+static int copy_unsupported(int error)
+{
+	return ENOSYS == error || EXDEV == error || EINVAL == error ||
+		EOPNOTSUPP == error;
+}
+
+/**
+ * Copy data between two files inside the kernel. copy_file_range is tried
+ * first, as it allows the file system to share the blocks of both files.
+ * sendfile is used for files that copy_file_range can not handle.
+ *
+ * @param in_fd the file descriptor of the source
+ * @param in_offset a pointer to the offset in the source or NULL to read from
+ * the current position of the source
+ * @param out_fd the file descriptor of the destination
+ * @param out_offset a pointer to the offset in the destination or NULL to
+ * write at the current position of the destination
+ * @param count the number of bytes to copy
+ * @return F12_SUCCESS, F12_UNSUPPORTED if nothing could be copied or any other
+ * error that occurred
+ */
+static enum lf12_error kernel_copy(int in_fd, off_t *in_offset, int out_fd,
+				   off_t *out_offset, size_t count)
+{
+	int use_sendfile = 0, copied = 0;
+	ssize_t res;
+
+	while (count > 0) {
+		if (!use_sendfile) {
+			res = copy_file_range(in_fd, in_offset, out_fd,
+					      out_offset, count, 0);
+		} else {
+			// sendfile always writes at the position of out_fd
+			if (NULL != out_offset &&
+			    -1 == lseek(out_fd, *out_offset, SEEK_SET)) {
+				lf12_save_errno();
+
+				return F12_IO_ERROR;
+			}
+			res = sendfile(out_fd, in_fd, in_offset, count);
+			if (res > 0 && NULL != out_offset) {
+				*out_offset += res;
+			}
+		}
+		if (-1 == res) {
+			if (EINTR == errno) {
+				continue;
+			}
+			if (!copied && copy_unsupported(errno)) {
+				if (!use_sendfile) {
+					use_sendfile = 1;
+					continue;
+				}
+
+				return F12_UNSUPPORTED;
+			}
+			lf12_save_errno();
+
+			return F12_IO_ERROR;
+		}
+		if (0 == res) {
+			// Unexpected end of the source
+			return F12_IO_ERROR;
+		}
+		copied = 1;
+		count -= res;
+	}
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error fd_copy_to_fd(struct lf12_device *device, int fd,
+				     size_t count, off_t offset)
+{
+	struct fd_device_data *data = device->data;
+
+	return kernel_copy(data->fd, &offset, fd, NULL, count);
+}
+
+static enum lf12_error fd_copy_from_fd(struct lf12_device *device, int fd,
+				       size_t count, off_t offset)
+{
+	struct fd_device_data *data = device->data;
+
+	return kernel_copy(fd, NULL, data->fd, &offset, count);
+}
+
+static enum lf12_error fd_resize(struct lf12_device *device, off_t size,
+				 int allocate)
+{
+	struct fd_device_data *data = device->data;
+	int res;
+
+	if (0 != ftruncate(data->fd, size)) {
+		lf12_save_errno();
+
+		return F12_IO_ERROR;
+	}
+
+	if (allocate && size > 0) {
+		res = posix_fallocate(data->fd, 0, size);
+		if (0 != res) {
+			errno = res;
+			lf12_save_errno();
+
+			return F12_IO_ERROR;
+		}
+	}
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error fd_discard(struct lf12_device *device, size_t count,
+				  off_t offset)
+{
+	struct fd_device_data *data = device->data;
+
+	if (0 != fallocate(data->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			   offset, count)) {
+		if (EOPNOTSUPP == errno || ENOSYS == errno) {
+			return F12_UNSUPPORTED;
+		}
+		lf12_save_errno();
+
+		return F12_IO_ERROR;
+	}
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error fd_size(struct lf12_device *device, off_t *size)
+{
+	struct fd_device_data *data = device->data;
+	struct stat sb;
+
+	if (0 != fstat(data->fd, &sb)) {
+		lf12_save_errno();
+
+		return F12_IO_ERROR;
+	}
+	*size = sb.st_size;
+
+	return F12_SUCCESS;
+}
+
+static void fd_close(struct lf12_device *device)
+{
+	struct fd_device_data *data = device->data;
+
+	close(data->fd);
+	free(data);
+}
+
+static enum lf12_error memory_read_at(struct lf12_device *device, void *buf,
+				      size_t count, off_t offset)
+{
+	struct memory_device_data *data = device->data;
+
+	if (offset < 0 || (size_t) offset > data->size ||
+	    count > data->size - offset) {
+		return F12_IO_ERROR;
+	}
+	memcpy(buf, data->buffer + offset, count);
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error memory_write_at(struct lf12_device *device,
+				       const void *buf, size_t count,
+				       off_t offset)
+{
+	struct memory_device_data *data = device->data;
+
+	if (offset < 0 || (size_t) offset > data->size ||
+	    count > data->size - offset) {
+		return F12_IO_ERROR;
+	}
+	memcpy(data->buffer + offset, buf, count);
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error memory_size(struct lf12_device *device, off_t *size)
+{
+	struct memory_device_data *data = device->data;
+
+	*size = data->size;
+
+	return F12_SUCCESS;
+}
+
+static const void *memory_map(struct lf12_device *device, size_t count,
+			      off_t offset)
+{
+	struct memory_device_data *data = device->data;
+
+	if (offset < 0 || (size_t) offset > data->size ||
+	    count > data->size - offset) {
+		return NULL;
+	}
+
+	return data->buffer + offset;
+}
+
+static void memory_close(struct lf12_device *device)
+{
+	free(device->data);
+}
+
+static enum lf12_error mmap_read_at(struct lf12_device *device, void *buf,
+				    size_t count, off_t offset)
+{
+	struct mmap_device_data *data = device->data;
+
+	if (offset < 0 || (size_t) offset > data->size ||
+	    count > data->size - offset) {
+		return F12_IO_ERROR;
+	}
+	memcpy(buf, data->map + offset, count);
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error mmap_write_at(struct lf12_device *device,
+				     const void *buf, size_t count,
+				     off_t offset)
+{
+	struct mmap_device_data *data = device->data;
+
+	if (!data->writable) {
+		errno = EBADF;
+		lf12_save_errno();
+
+		return F12_IO_ERROR;
+	}
+	if (offset < 0 || (size_t) offset > data->size ||
+	    count > data->size - offset) {
+		return F12_IO_ERROR;
+	}
+	memcpy(data->map + offset, buf, count);
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error mmap_flush(struct lf12_device *device)
+{
+	struct mmap_device_data *data = device->data;
+
+	if (!data->writable) {
+		return F12_SUCCESS;
+	}
+
+	if (0 != msync(data->map, data->size, MS_SYNC)) {
+		lf12_save_errno();
+
+		return F12_IO_ERROR;
+	}
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error mmap_size(struct lf12_device *device, off_t *size)
+{
+	struct mmap_device_data *data = device->data;
+
+	*size = data->size;
+
+	return F12_SUCCESS;
+}
+
+static const void *mmap_map(struct lf12_device *device, size_t count,
+			    off_t offset)
+{
+	struct mmap_device_data *data = device->data;
+
+	if (offset < 0 || (size_t) offset > data->size ||
+	    count > data->size - offset) {
+		return NULL;
+	}
+
+	return data->map + offset;
+}
+
+static enum lf12_error mmap_copy_to_fd(struct lf12_device *device, int fd,
+				       size_t count, off_t offset)
+{
+	struct mmap_device_data *data = device->data;
+
+	if (offset < 0 || (size_t) offset > data->size ||
+	    count > data->size - offset) {
+		return F12_IO_ERROR;
+	}
+
+	return kernel_copy(data->fd, &offset, fd, NULL, count);
+}
+
+static void mmap_close(struct lf12_device *device)
+{
+	struct mmap_device_data *data = device->data;
+
+	munmap(data->map, data->size);
+	close(data->fd);
+	free(data);
+}
+
+enum lf12_error lf12_open_fd_device(int fd, struct lf12_device **device)
+{
+	struct fd_device_data *data = malloc(sizeof(struct fd_device_data));
+
+	if (NULL == data) {
+		return F12_ALLOCATION_ERROR;
+	}
+
+	*device = calloc(1, sizeof(struct lf12_device));
+	if (NULL == *device) {
+		free(data);
+
+		return F12_ALLOCATION_ERROR;
+	}
+
+	data->fd = fd;
+	(*device)->data = data;
+	(*device)->read_at = fd_read_at;
+	(*device)->write_at = fd_write_at;
+	(*device)->writev_at = fd_writev_at;
+	(*device)->copy_to_fd = fd_copy_to_fd;
+	(*device)->copy_from_fd = fd_copy_from_fd;
+	(*device)->resize = fd_resize;
+	(*device)->discard = fd_discard;
+	(*device)->size = fd_size;
+	(*device)->close = fd_close;
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_open_memory_device(void *buffer, size_t size,
+					struct lf12_device **device)
+{
+	struct memory_device_data *data =
+		malloc(sizeof(struct memory_device_data));
+
+	if (NULL == data) {
+		return F12_ALLOCATION_ERROR;
+	}
+
+	*device = calloc(1, sizeof(struct lf12_device));
+	if (NULL == *device) {
+		free(data);
+
+		return F12_ALLOCATION_ERROR;
+	}
+
+	data->buffer = buffer;
+	data->size = size;
+	(*device)->data = data;
+	(*device)->read_at = memory_read_at;
+	(*device)->write_at = memory_write_at;
+	(*device)->size = memory_size;
+	(*device)->map = memory_map;
+	(*device)->close = memory_close;
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_open_mmap_device(int fd, int writable,
+				      struct lf12_device **device)
+{
+	struct mmap_device_data *data;
+	struct stat sb;
+	int prot = PROT_READ;
+
+	if (0 != fstat(fd, &sb)) {
+		lf12_save_errno();
+
+		return F12_IO_ERROR;
+	}
+
+	data = malloc(sizeof(struct mmap_device_data));
+	if (NULL == data) {
+		return F12_ALLOCATION_ERROR;
+	}
+
+	if (writable) {
+		prot |= PROT_WRITE;
+	}
+
+	data->map = mmap(NULL, sb.st_size, prot, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == data->map) {
+		lf12_save_errno();
+		free(data);
+
+		return F12_IO_ERROR;
+	}
+
+	*device = calloc(1, sizeof(struct lf12_device));
+	if (NULL == *device) {
+		munmap(data->map, sb.st_size);
+		free(data);
+
+		return F12_ALLOCATION_ERROR;
+	}
+
+	data->fd = fd;
+	data->size = sb.st_size;
+	data->writable = writable;
+	(*device)->data = data;
+	(*device)->read_at = mmap_read_at;
+	(*device)->write_at = mmap_write_at;
+	(*device)->flush = mmap_flush;
+	(*device)->size = mmap_size;
+	(*device)->map = mmap_map;
+	(*device)->copy_to_fd = mmap_copy_to_fd;
+	(*device)->close = mmap_close;
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_device_read(struct lf12_device *device, void *buf,
+				 size_t count, off_t offset)
+{
+	if (NULL == device->read_at) {
+		return F12_UNSUPPORTED;
+	}
+
+	return device->read_at(device, buf, count, offset);
+}
+
+enum lf12_error lf12_device_write(struct lf12_device *device, const void *buf,
+				  size_t count, off_t offset)
+{
+	if (NULL == device->write_at) {
+		return F12_UNSUPPORTED;
+	}
+
+	return device->write_at(device, buf, count, offset);
+}
+
+enum lf12_error lf12_device_writev(struct lf12_device *device,
+				   const struct iovec *iov, int iovcnt,
+				   off_t offset)
+{
+	enum lf12_error err;
+
+	if (NULL != device->writev_at) {
+		return device->writev_at(device, iov, iovcnt, offset);
+	}
+
+	for (int i = 0; i < iovcnt; i++) {
+		err = lf12_device_write(device, iov[i].iov_base,
+					iov[i].iov_len, offset);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+		offset += iov[i].iov_len;
+	}
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_device_flush(struct lf12_device *device)
+{
+	if (NULL == device->flush) {
+		// Nothing is buffered by the device
+		return F12_SUCCESS;
+	}
+
+	return device->flush(device);
+}
+
+enum lf12_error lf12_device_drop(struct lf12_device *device)
+{
+	if (NULL == device->drop) {
+		// Nothing is buffered by the device
+		return F12_SUCCESS;
+	}
+
+	return device->drop(device);
+}
+
+enum lf12_error lf12_device_resize(struct lf12_device *device, off_t size,
+				   int allocate)
+{
+	if (NULL == device->resize) {
+		return F12_UNSUPPORTED;
+	}
+
+	return device->resize(device, size, allocate);
+}
+
+enum lf12_error lf12_device_size(struct lf12_device *device, off_t *size)
+{
+	if (NULL == device->size) {
+		return F12_UNSUPPORTED;
+	}
+
+	return device->size(device, size);
+}
+
+enum lf12_error lf12_device_discard(struct lf12_device *device, size_t count,
+				    off_t offset)
+{
+	if (NULL == device->discard) {
+		return F12_UNSUPPORTED;
+	}
+
+	return device->discard(device, count, offset);
+}
+
+const void *lf12_device_map(struct lf12_device *device, size_t count,
+			    off_t offset)
+{
+	if (NULL == device->map) {
+		return NULL;
+	}
+
+	return device->map(device, count, offset);
+}
+
+enum lf12_error lf12_device_copy_to_fd(struct lf12_device *device, int fd,
+				       size_t count, off_t offset)
+{
+	if (NULL == device->copy_to_fd) {
+		return F12_UNSUPPORTED;
+	}
+
+	return device->copy_to_fd(device, fd, count, offset);
+}
+
+enum lf12_error lf12_device_copy_from_fd(struct lf12_device *device, int fd,
+					 size_t count, off_t offset)
+{
+	if (NULL == device->copy_from_fd) {
+		return F12_UNSUPPORTED;
+	}
+
+	return device->copy_from_fd(device, fd, count, offset);
+}
+
+enum lf12_error lf12_close_device(struct lf12_device *device)
+{
+	enum lf12_error err;
+
+	if (NULL == device) {
+		return F12_SUCCESS;
+	}
+
+	err = lf12_device_flush(device);
+	if (NULL != device->close) {
+		device->close(device);
+	}
+	free(device);
+
+	return err;
+}
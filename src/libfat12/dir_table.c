@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "io_p.h"
+#include "libfat12.h"
+#include "metadata_p.h"
+
+// Size of an entry of a directory table on the partition
+#define RAW_ENTRY_SIZE 32
+
+/**
+ * A directory table in the format of the partition.
+ */
+struct lf12_dir_table {
+	// The entries of the table, either mapped from the device or in buffer
+	const char *data;
+	// Memory for the table, if the device could not map it, or NULL
+	char *buffer;
+	int entry_count;
+};
+
+/**
+ * Read the table of a subdirectory into a buffer with one access per run of
+ * consecutive clusters.
+ *
+ * @param device a pointer to the device with the partition
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param first_cluster the first cluster of the table
+ * @param buffer a pointer to memory for the whole table
+ * @param size the size of the table in bytes
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error read_chain(struct lf12_device *device,
+				  struct lf12_metadata *f12_meta,
+				  uint16_t first_cluster, char *buffer,
+				  size_t size)
+{
+	enum lf12_error err;
+	size_t cluster_size = _lf12_get_cluster_size(f12_meta);
+	size_t offset = 0, extent_size;
+	uint16_t cluster = first_cluster, extent_start;
+
+	while (offset < size) {
+		extent_start = cluster;
+		extent_size = _lf12_get_extent(&cluster, f12_meta) *
+			cluster_size;
+		err = lf12_device_read(device, buffer + offset, extent_size,
+				       _lf12_cluster_offset(extent_start,
+							    f12_meta));
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+		offset += extent_size;
+	}
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_open_dir_table(struct lf12_device *device,
+				    struct lf12_metadata *f12_meta,
+				    uint16_t first_cluster,
+				    struct lf12_dir_table **table)
+{
+	enum lf12_error err = F12_SUCCESS;
+	struct lf12_dir_table *new_table;
+	size_t size;
+	off_t offset;
+	uint16_t cluster = first_cluster;
+	int contiguous;
+
+	if (0 == first_cluster) {
+		size = f12_meta->bpb->RootDirEntries * RAW_ENTRY_SIZE;
+		offset = f12_meta->root_dir_offset;
+		contiguous = 1;
+	} else if (first_cluster < 2 ||
+		   first_cluster >= _lf12_clusters_end(f12_meta)) {
+		return F12_INVALID_CHAIN;
+	} else {
+		size = _lf12_get_cluster_chain_size(first_cluster, f12_meta);
+		offset = _lf12_cluster_offset(first_cluster, f12_meta);
+		contiguous = _lf12_get_extent(&cluster, f12_meta) *
+			_lf12_get_cluster_size(f12_meta) == size;
+	}
+
+	new_table = calloc(1, sizeof(struct lf12_dir_table));
+	if (NULL == new_table) {
+		return F12_ALLOCATION_ERROR;
+	}
+	new_table->entry_count = size / RAW_ENTRY_SIZE;
+
+	if (contiguous) {
+		new_table->data = lf12_device_map(device, size, offset);
+	}
+	if (NULL == new_table->data) {
+		new_table->buffer = malloc(size);
+		if (NULL == new_table->buffer) {
+			free(new_table);
+
+			return F12_ALLOCATION_ERROR;
+		}
+		new_table->data = new_table->buffer;
+		if (contiguous) {
+			err = lf12_device_read(device, new_table->buffer, size,
+					       offset);
+		} else {
+			err = read_chain(device, f12_meta, first_cluster,
+					 new_table->buffer, size);
+		}
+	}
+	if (F12_SUCCESS != err) {
+		lf12_close_dir_table(new_table);
+
+		return err;
+	}
+
+	*table = new_table;
+
+	return F12_SUCCESS;
+}
+
+void lf12_close_dir_table(struct lf12_dir_table *table)
+{
+	free(table->buffer);
+	free(table);
+}
+
+int lf12_dir_table_size(const struct lf12_dir_table *table)
+{
+	return table->entry_count;
+}
+
+const char *lf12_dir_table_entry(const struct lf12_dir_table *table, int n)
+{
+	return table->data + n * RAW_ENTRY_SIZE;
+}
+
+int lf12_dir_table_child_count(const struct lf12_dir_table *table)
+{
+	const char *data = table->data;
+	int child_count = 0;
+
+	for (int i = 0; i < table->entry_count; i++) {
+		child_count += 0 != data[i * RAW_ENTRY_SIZE];
+	}
+
+	return child_count;
+}
+
+int lf12_dir_table_find_free(const struct lf12_dir_table *table)
+{
+	const char *data = table->data;
+
+	for (int i = 0; i < table->entry_count; i++) {
+		if (0 == data[i * RAW_ENTRY_SIZE]) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+int lf12_raw_entry_is_empty(const char *raw_entry)
+{
+	return 0 == raw_entry[0];
+}
+
+int lf12_raw_entry_is_directory(const char *raw_entry)
+{
+	return 0 != (raw_entry[11] & LF12_ATTR_SUBDIRECTORY);
+}
+
+int lf12_raw_entry_is_dot_dir(const char *raw_entry)
+{
+	if (!lf12_raw_entry_is_directory(raw_entry)) {
+		return 0;
+	}
+
+	return 0 == memcmp(raw_entry, ".          ", 11) ||
+		0 == memcmp(raw_entry, "..         ", 11);
+}
+
+uint16_t lf12_raw_entry_first_cluster(const char *raw_entry)
+{
+	uint16_t first_cluster;
+
+	memcpy(&first_cluster, raw_entry + 26, 2);
+
+	return first_cluster;
+}
+
+uint32_t lf12_raw_entry_file_size(const char *raw_entry)
+{
+	uint32_t file_size;
+
+	memcpy(&file_size, raw_entry + 28, 4);
+
+	return file_size;
+}
+
+/**
+ * Count the files and directories below a directory table.
+ *
+ * @param device a pointer to the device with the partition
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param first_cluster the first cluster of the table or 0 for the root
+ * directory
+ * @param depth the number of directories above the table
+ * @param file_count a pointer to the number of files, that is increased
+ * @param dir_count a pointer to the number of directories, that is increased
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error count_entries(struct lf12_device *device,
+				     struct lf12_metadata *f12_meta,
+				     uint16_t first_cluster, int depth,
+				     int *file_count, int *dir_count)
+{
+	enum lf12_error err;
+	struct lf12_dir_table *table;
+	const char *raw_entry;
+
+	// Every level of a valid tree takes at least one cluster
+	if (depth > _lf12_clusters_end(f12_meta)) {
+		return F12_INVALID_CHAIN;
+	}
+
+	err = lf12_open_dir_table(device, f12_meta, first_cluster, &table);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+
+	for (int i = 0; i < table->entry_count; i++) {
+		raw_entry = lf12_dir_table_entry(table, i);
+		if (!lf12_raw_entry_is_directory(raw_entry)) {
+			*file_count += !lf12_raw_entry_is_empty(raw_entry);
+			continue;
+		}
+		if (lf12_raw_entry_is_dot_dir(raw_entry)) {
+			continue;
+		}
+		(*dir_count)++;
+		if (0 == lf12_raw_entry_first_cluster(raw_entry)) {
+			continue;
+		}
+		err = count_entries(device, f12_meta,
+				    lf12_raw_entry_first_cluster(raw_entry),
+				    depth + 1, file_count, dir_count);
+		if (F12_SUCCESS != err) {
+			break;
+		}
+	}
+
+	lf12_close_dir_table(table);
+
+	return err;
+}
+
+enum lf12_error lf12_count_entries(struct lf12_device *device,
+				   struct lf12_metadata *f12_meta,
+				   int *file_count, int *dir_count)
+{
+	*file_count = 0;
+	*dir_count = 0;
+
+	return count_entries(device, f12_meta, 0, 0, file_count, dir_count);
+}
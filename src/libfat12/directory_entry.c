@@ -1,8 +1,33 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "arena_p.h"
+#include "directory_entry_p.h"
 #include "libfat12.h"
 
+/**
+ * Hash index of the names in a directory table.
+ *
+ * Every slot of the hash table holds the position of a child in the directory
+ * table or -1 if it is unused. Collisions are resolved by linear probing. The
+ * table has at least twice as many slots as the directory table has entries,
+ * so it never runs full.
+ *
+ * The index of a table loaded with the metadata is reserved in the arena
+ * together with the table and only built on the first lookup.
+ */
+struct lf12_name_index {
+	// Number of slots in the hash table, a power of two
+	size_t size;
+	// Whether the index lives in the arena of the metadata
+	int in_arena;
+	// Whether the slots hold the children of the directory
+	int built;
+	// There is no free entry in the directory table before this position
+	int first_free;
+	int slots[];
+};
+
 /**
  * Get a free entry of a directory.
  *
@@ -18,15 +43,304 @@ static struct lf12_directory_entry *get_free_entry(struct lf12_directory_entry
 		return NULL;
 	}
 
+	return _lf12_find_free_child(dir);
+}
+
+/**
+ * Get the hash of a short file name with the FNV-1a algorithm.
+ *
+ * @param name a pointer to the 8 characters of the short file name
+ * @param extension a pointer to the 3 characters of the short file extension
+ * @return the hash of the name
+ */
+static size_t hash_name(const char *name, const char *extension)
+{
+	uint32_t hash = 2166136261u;
+
+	for (int i = 0; i < 8; i++) {
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+	}
+	for (int i = 0; i < 3; i++) {
+		hash = (hash ^ (unsigned char)extension[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static size_t hash_entry(struct lf12_directory_entry *entry)
+{
+	return hash_name(entry->ShortFileName, entry->ShortFileExtension);
+}
+
+static int has_name(struct lf12_directory_entry *entry, const char *name,
+		    const char *extension)
+{
+	return 0 == memcmp(entry->ShortFileName, name, 8) &&
+		0 == memcmp(entry->ShortFileExtension, extension, 3);
+}
+
+/**
+ * Get the size of a name index for a directory table.
+ *
+ * @param child_count the number of entries in the directory table
+ * @return the number of slots of the index
+ */
+static size_t get_index_size(int child_count)
+{
+	size_t size = 8;
+
+	while (size < 2 * (size_t) child_count) {
+		size *= 2;
+	}
+
+	return size;
+}
+
+/**
+ * Get the name index of a directory, if it was built.
+ *
+ * @param dir a pointer to the directory
+ * @return a pointer to the name index or NULL if there is none
+ */
+static struct lf12_name_index *get_built_index(struct lf12_directory_entry
+					       *dir)
+{
+	if (NULL == dir->name_index || !dir->name_index->built) {
+		return NULL;
+	}
+
+	return dir->name_index;
+}
+
+static void insert_child(struct lf12_directory_entry *dir, int position)
+{
+	struct lf12_name_index *index = dir->name_index;
+	struct lf12_directory_entry *child = &dir->children[position];
+	size_t mask = index->size - 1;
+	size_t slot = hash_entry(child) & mask;
+
+	while (-1 != index->slots[slot]) {
+		// Only the first child with a name can be found
+		if (has_name(&dir->children[index->slots[slot]],
+			     child->ShortFileName, child->ShortFileExtension)) {
+			return;
+		}
+		slot = (slot + 1) & mask;
+	}
+	index->slots[slot] = position;
+}
+
+/**
+ * Get the name index of a directory and build it, if it does not exist yet.
+ *
+ * @param dir a pointer to the directory
+ * @return a pointer to the name index or NULL if the directory can not be
+ * indexed
+ */
+static struct lf12_name_index *get_name_index(struct lf12_directory_entry *dir)
+{
+	struct lf12_name_index *index = dir->name_index;
+	size_t size;
+
+	if (NULL != index && index->built) {
+		return index;
+	}
+	// Dot directories share the table of another directory
+	if (NULL == dir->children || lf12_is_dot_dir(dir)) {
+		return NULL;
+	}
+
+	if (NULL == index) {
+		size = get_index_size(dir->child_count);
+		index = malloc(sizeof(struct lf12_name_index) +
+			       size * sizeof(int));
+		if (NULL == index) {
+			return NULL;
+		}
+		index->size = size;
+		index->in_arena = 0;
+	}
+	size = index->size;
+	index->built = 1;
+	index->first_free = dir->child_count;
+	for (size_t i = 0; i < size; i++) {
+		index->slots[i] = -1;
+	}
+	dir->name_index = index;
+
 	for (int i = 0; i < dir->child_count; i++) {
+		if (!lf12_entry_is_empty(&dir->children[i])) {
+			insert_child(dir, i);
+		} else if (i < index->first_free) {
+			index->first_free = i;
+		}
+	}
+
+	return index;
+}
+
+struct lf12_directory_entry *_lf12_find_child(struct lf12_directory_entry *dir,
+					      const char *name,
+					      const char *extension)
+{
+	struct lf12_name_index *index = get_name_index(dir);
+	struct lf12_directory_entry *child;
+	size_t mask, slot;
+
+	if (NULL == index) {
+		for (int i = 0; i < dir->child_count; i++) {
+			if (has_name(&dir->children[i], name, extension)) {
+				return &dir->children[i];
+			}
+		}
+
+		return NULL;
+	}
+
+	mask = index->size - 1;
+	slot = hash_name(name, extension) & mask;
+	while (-1 != index->slots[slot]) {
+		child = &dir->children[index->slots[slot]];
+		if (has_name(child, name, extension)) {
+			return child;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	return NULL;
+}
+
+struct lf12_directory_entry *_lf12_find_free_child(struct lf12_directory_entry
+						   *dir)
+{
+	struct lf12_name_index *index = get_name_index(dir);
+	int start = 0;
+
+	if (NULL != index) {
+		start = index->first_free;
+	}
+
+	for (int i = start; i < dir->child_count; i++) {
 		if (lf12_entry_is_empty(&dir->children[i])) {
+			if (NULL != index) {
+				index->first_free = i;
+			}
+
 			return &dir->children[i];
 		}
 	}
+	if (NULL != index) {
+		index->first_free = dir->child_count;
+	}
 
 	return NULL;
 }
 
+void _lf12_index_child(struct lf12_directory_entry *dir,
+		       struct lf12_directory_entry *child)
+{
+	struct lf12_name_index *index = get_built_index(dir);
+	int position = child - dir->children;
+
+	if (NULL == index) {
+		return;
+	}
+
+	insert_child(dir, position);
+	if (position == index->first_free) {
+		index->first_free++;
+	}
+}
+
+void _lf12_unindex_child(struct lf12_directory_entry *dir,
+			 struct lf12_directory_entry *child)
+{
+	struct lf12_name_index *index = get_built_index(dir);
+	int position = child - dir->children;
+	size_t mask, slot, hole, home;
+
+	if (NULL == index) {
+		return;
+	}
+
+	if (position < index->first_free) {
+		index->first_free = position;
+	}
+	if (lf12_entry_is_empty(child)) {
+		return;
+	}
+
+	mask = index->size - 1;
+	slot = hash_entry(child) & mask;
+	while (position != index->slots[slot]) {
+		if (-1 == index->slots[slot]) {
+			// The child has the name of a previous child
+			return;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	// Move the following children of the probe sequence into the hole, so
+	// that they can still be found
+	hole = slot;
+	while (1) {
+		slot = (slot + 1) & mask;
+		if (-1 == index->slots[slot]) {
+			break;
+		}
+		home = hash_entry(&dir->children[index->slots[slot]]) & mask;
+		if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+			index->slots[hole] = index->slots[slot];
+			hole = slot;
+		}
+	}
+	index->slots[hole] = -1;
+}
+
+void _lf12_drop_name_index(struct lf12_directory_entry *dir)
+{
+	if (NULL == dir->name_index) {
+		return;
+	}
+	// Memory from the arena is kept for the next build
+	if (dir->name_index->in_arena) {
+		dir->name_index->built = 0;
+
+		return;
+	}
+	free(dir->name_index);
+	dir->name_index = NULL;
+}
+
+enum lf12_error _lf12_create_table(struct lf12_metadata *f12_meta,
+				   struct lf12_directory_entry *dir,
+				   int child_count)
+{
+	struct lf12_directory_entry *children;
+	struct lf12_name_index *index;
+	size_t size = get_index_size(child_count);
+
+	children = _lf12_arena_alloc(f12_meta->arena, child_count *
+				     sizeof(struct lf12_directory_entry));
+	index = _lf12_arena_alloc(f12_meta->arena,
+				  sizeof(struct lf12_name_index) +
+				  size * sizeof(int));
+	if (NULL == children || NULL == index) {
+		return F12_ALLOCATION_ERROR;
+	}
+	index->size = size;
+	index->in_arena = 1;
+
+	for (int i = 0; i < child_count; i++) {
+		children[i].parent = dir;
+	}
+	dir->children = children;
+	dir->child_count = child_count;
+	dir->name_index = index;
+
+	return F12_SUCCESS;
+}
+
 int lf12_is_directory(struct lf12_directory_entry *entry)
 {
 	if (entry->FileAttributes & LF12_ATTR_SUBDIRECTORY)
@@ -131,6 +445,7 @@ void lf12_free_entry(struct lf12_directory_entry *entry)
 		lf12_free_entry(&entry->children[i]);
 	}
 	free(entry->children);
+	_lf12_drop_name_index(entry);
 }
 
 enum lf12_error lf12_move_entry(struct lf12_directory_entry *src,
@@ -158,6 +473,9 @@ enum lf12_error lf12_move_entry(struct lf12_directory_entry *src,
 		return F12_DIR_FULL;
 	}
 
+	src->parent->dirty = 1;
+	dest->dirty = 1;
+
 	if (0 == memcmp(src->ShortFileName, ".       ", 8) &&
 	    0 == memcmp(src->ShortFileExtension, "   ", 3) &&
 	    lf12_is_directory(src)) {
@@ -179,14 +497,18 @@ enum lf12_error lf12_move_entry(struct lf12_directory_entry *src,
 				       sizeof(struct lf12_directory_entry));
 			}
 		}
+		// Both directory tables changed completely
+		_lf12_drop_name_index(src->parent);
+		_lf12_drop_name_index(dest);
 
 		return 0;
 	}
 
-	src->parent = dest;
 	if (NULL == (free_entry = get_free_entry(dest))) {
 		return F12_DIR_FULL;
 	}
+	_lf12_unindex_child(src->parent, src);
+	src->parent = dest;
 
 	for (int i = 0; i < src->child_count; i++) {
 		if (lf12_entry_is_empty(&src->children[i])) {
@@ -197,6 +519,7 @@ enum lf12_error lf12_move_entry(struct lf12_directory_entry *src,
 
 	memmove(free_entry, src, sizeof(struct lf12_directory_entry));
 	memset(src, 0, sizeof(struct lf12_directory_entry));
+	_lf12_index_child(dest, free_entry);
 
 	return F12_SUCCESS;
 }
@@ -0,0 +1,75 @@
+#ifndef LF12_DIRECTORY_ENTRY_P_H
+#define LF12_DIRECTORY_ENTRY_P_H
+
+#include "libfat12.h"
+
+/**
+ * Find a child of a directory by its name.
+ *
+ * The names of the children are looked up in a hash index, that is built on
+ * the first call for the directory. Dot directories share the table of another
+ * directory and are searched without an index.
+ *
+ * @param dir a pointer to the directory
+ * @param name a pointer to the 8 characters of the short file name
+ * @param extension a pointer to the 3 characters of the short file extension
+ * @return a pointer to the first child with the name or NULL if there is none
+ */
+struct lf12_directory_entry *_lf12_find_child(struct lf12_directory_entry *dir,
+					      const char *name,
+					      const char *extension);
+
+/**
+ * Find the first free entry in the table of a directory.
+ *
+ * @param dir a pointer to the directory
+ * @return a pointer to the first free entry or NULL if the table is full
+ */
+struct lf12_directory_entry *_lf12_find_free_child(struct lf12_directory_entry
+						   *dir);
+
+/**
+ * Add a child to the name index of its directory. This must be called after an
+ * empty entry of the directory table got a name.
+ *
+ * @param dir a pointer to the directory
+ * @param child a pointer to the named entry in the table of the directory
+ */
+void _lf12_index_child(struct lf12_directory_entry *dir,
+		       struct lf12_directory_entry *child);
+
+/**
+ * Remove a child from the name index of its directory. This must be called
+ * before the entry is erased or overwritten.
+ *
+ * @param dir a pointer to the directory
+ * @param child a pointer to the entry in the table of the directory
+ */
+void _lf12_unindex_child(struct lf12_directory_entry *dir,
+			 struct lf12_directory_entry *child);
+
+/**
+ * Release the name index of a directory. It is built again on the next
+ * lookup. This is used after many entries of the directory table were changed
+ * at once.
+ *
+ * @param dir a pointer to the directory
+ */
+void _lf12_drop_name_index(struct lf12_directory_entry *dir);
+
+/**
+ * Allocate the table of a directory and its name index from the arena of the
+ * metadata. The entries of the table are empty children of the directory.
+ *
+ * The memory is only released together with the metadata.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param dir a pointer to the directory
+ * @param child_count the number of entries in the table
+ * @return F12_SUCCESS or F12_ALLOCATION_ERROR
+ */
+enum lf12_error _lf12_create_table(struct lf12_metadata *f12_meta,
+				   struct lf12_directory_entry *dir,
+				   int child_count);
+
+#endif
@@ -15,6 +15,10 @@ static char *ERR_DIR_NOT_EMPTY = "Directory is not empty";
 static char *ERR_SUCCESS = "Success";
 static char *ERR_UNKNOWN = "Error unknown";
 static char *ERR_DIR = "Target is a directory. Maybe use the recursive flag";
+static char *ERR_UNSUPPORTED = "Operation not supported by the device";
+static char *ERR_STALE_INDEX = "The index does not match the image";
+static char *ERR_INVALID_CHAIN = "A cluster chain on the image is damaged";
+static char *ERR_PATH_TOO_LONG = "The path has too many parts";
 
 static int saved_errno = 0;
 static int has_saved = 0;
@@ -57,6 +61,14 @@ char *lf12_strerror(enum lf12_error err)
 		return ERR_SUCCESS;
 	case F12_IS_DIR:
 		return ERR_DIR;
+	case F12_UNSUPPORTED:
+		return ERR_UNSUPPORTED;
+	case F12_STALE_INDEX:
+		return ERR_STALE_INDEX;
+	case F12_INVALID_CHAIN:
+		return ERR_INVALID_CHAIN;
+	case F12_PATH_TOO_LONG:
+		return ERR_PATH_TOO_LONG;
 	default:
 		break;
 	}
@@ -0,0 +1,134 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fat_p.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LF12_FAT_SSSE3
+#include <tmmintrin.h>
+#endif
+
+void _lf12_decode_fat_scalar(const char *fat, uint16_t *entries, size_t count)
+{
+	const uint8_t *bytes = (const uint8_t *)fat;
+	size_t i;
+
+	for (i = 0; i + 1 < count; i += 2, bytes += 3) {
+		entries[i] = bytes[0] | (bytes[1] & 0x0f) << 8;
+		entries[i + 1] = bytes[1] >> 4 | bytes[2] << 4;
+	}
+	if (i < count) {
+		entries[i] = bytes[0] | (bytes[1] & 0x0f) << 8;
+	}
+}
+
+void _lf12_encode_fat_scalar(const uint16_t *entries, size_t count, char *fat)
+{
+	uint8_t *bytes = (uint8_t *) fat;
+	size_t i;
+
+	for (i = 0; i + 1 < count; i += 2, bytes += 3) {
+		bytes[0] = entries[i];
+		bytes[1] = (entries[i] >> 8 & 0x0f) | entries[i + 1] << 4;
+		bytes[2] = entries[i + 1] >> 4;
+	}
+	if (i < count) {
+		bytes[0] = entries[i];
+		bytes[1] = entries[i] >> 8 & 0x0f;
+	}
+}
+
+#ifdef LF12_FAT_SSSE3
+/*
+ * Both vector implementations handle eight entries in twelve bytes per step,
+ * but access sixteen bytes of the table. They stop while at least eleven
+ * entries are left, so that the access stays inside the table, and leave the
+ * rest to the scalar implementation.
+ */
+#define VECTOR_ENTRIES 8
+#define VECTOR_MARGIN 11
+
+__attribute__((target("ssse3")))
+static void decode_fat_ssse3(const char *fat, uint16_t *entries, size_t count)
+{
+	// Move the two bytes holding every entry into its 16 bit lane
+	const __m128i spread = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5,
+					     6, 7, 7, 8, 9, 10, 10, 11);
+	const __m128i even_mask = _mm_set1_epi32(0x00000fff);
+	const __m128i odd_mask = _mm_set1_epi32(0x0fff0000);
+	__m128i words;
+	size_t i;
+
+	for (i = 0; i + VECTOR_MARGIN <= count; i += VECTOR_ENTRIES) {
+		words = _mm_loadu_si128((const __m128i *)(fat + i * 3 / 2));
+		words = _mm_shuffle_epi8(words, spread);
+		// Even entries are the lower and odd entries the upper 12 bit
+		words = _mm_or_si128(_mm_and_si128(words, even_mask),
+				     _mm_and_si128(_mm_srli_epi16(words, 4),
+						   odd_mask));
+		_mm_storeu_si128((__m128i *) (entries + i), words);
+	}
+
+	_lf12_decode_fat_scalar(fat + i * 3 / 2, entries + i, count - i);
+}
+
+__attribute__((target("ssse3")))
+static void encode_fat_ssse3(const uint16_t *entries, size_t count, char *fat)
+{
+	// Keep the lower three bytes of every 32 bit lane
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,
+					   10, 12, 13, 14, -1, -1, -1, -1);
+	const __m128i even_mask = _mm_set1_epi32(0x00000fff);
+	const __m128i odd_mask = _mm_set1_epi32(0x00fff000);
+	__m128i pairs;
+	size_t i;
+
+	for (i = 0; i + VECTOR_MARGIN <= count; i += VECTOR_ENTRIES) {
+		pairs = _mm_loadu_si128((const __m128i *)(entries + i));
+		// Join every pair of entries to 24 bit
+		pairs = _mm_or_si128(_mm_and_si128(pairs, even_mask),
+				     _mm_and_si128(_mm_srli_epi32(pairs, 4),
+						   odd_mask));
+		// The last four bytes are overwritten by the next step
+		_mm_storeu_si128((__m128i *) (fat + i * 3 / 2),
+				 _mm_shuffle_epi8(pairs, pack));
+	}
+
+	_lf12_encode_fat_scalar(entries + i, count - i, fat + i * 3 / 2);
+}
+#endif
+
+static void (*decode_fat)(const char *, uint16_t *, size_t) = NULL;
+static void (*encode_fat)(const uint16_t *, size_t, char *) = NULL;
+
+static void select_codec(void)
+{
+	decode_fat = _lf12_decode_fat_scalar;
+	encode_fat = _lf12_encode_fat_scalar;
+
+#ifdef LF12_FAT_SSSE3
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3")) {
+		decode_fat = decode_fat_ssse3;
+		encode_fat = encode_fat_ssse3;
+	}
+#endif
+}
+
+void _lf12_decode_fat(const char *fat, uint16_t *entries, size_t count)
+{
+	if (NULL == decode_fat) {
+		select_codec();
+	}
+
+	decode_fat(fat, entries, count);
+}
+
+void _lf12_encode_fat(const uint16_t *entries, size_t count, char *fat)
+{
+	if (NULL == encode_fat) {
+		select_codec();
+	}
+
+	encode_fat(entries, count, fat);
+}
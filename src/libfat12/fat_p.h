@@ -0,0 +1,49 @@
+#ifndef LF12_FAT_P_H
+#define LF12_FAT_P_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decode entries of a file allocation table. Every three bytes of the table
+ * hold two entries of twelve bit.
+ *
+ * The fastest implementation available on the processor is chosen on the
+ * first call.
+ *
+ * @param fat a pointer to the compressed file allocation table. At least
+ * (count * 3 + 1) / 2 bytes are read.
+ * @param entries a pointer to the memory for the decoded entries
+ * @param count the number of entries to decode
+ */
+void _lf12_decode_fat(const char *fat, uint16_t *entries, size_t count);
+
+/**
+ * Encode entries of a file allocation table. Only the lower twelve bit of
+ * every entry are stored.
+ *
+ * The fastest implementation available on the processor is chosen on the
+ * first call.
+ *
+ * @param entries a pointer to the entries to encode
+ * @param count the number of entries to encode
+ * @param fat a pointer to the compressed file allocation table. Exactly
+ * (count * 3 + 1) / 2 bytes are written.
+ */
+void _lf12_encode_fat(const uint16_t *entries, size_t count, char *fat);
+
+/**
+ * Decode entries of a file allocation table without vector instructions.
+ *
+ * @see _lf12_decode_fat
+ */
+void _lf12_decode_fat_scalar(const char *fat, uint16_t *entries, size_t count);
+
+/**
+ * Encode entries of a file allocation table without vector instructions.
+ *
+ * @see _lf12_encode_fat
+ */
+void _lf12_encode_fat_scalar(const uint16_t *entries, size_t count, char *fat);
+
+#endif
@@ -0,0 +1,328 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "directory_entry_p.h"
+#include "io_p.h"
+#include "libfat12.h"
+
+#define INDEX_MAGIC "F12INDEX"
+#define INDEX_VERSION 1
+// Entry count of a directory, whose table was not loaded
+#define INDEX_NOT_LOADED UINT32_MAX
+
+/**
+ * The header at the start of an index.
+ *
+ * The decoded file allocation table follows the header directly. After it come
+ * the directory tables in depth first order. Every table starts with the
+ * number of its entries followed by the raw entries as on the disk. The tables
+ * of the subdirectories of a directory follow the table of the directory in
+ * the order of their entries.
+ */
+struct index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_count;
+	// Size of the whole index in bytes
+	uint64_t size;
+	struct lf12_index_key key;
+	struct bios_parameter_block bpb;
+};
+
+/**
+ * A position in the directory tables of an index.
+ */
+struct index_cursor {
+	char *data;
+	size_t remaining;
+};
+
+/**
+ * Check if the table of a directory entry is stored in an index.
+ *
+ * @param entry a pointer to the directory entry
+ * @return non zero if the entry is a subdirectory with an own table
+ */
+static int has_table(struct lf12_directory_entry *entry)
+{
+	return !lf12_entry_is_empty(entry) && lf12_is_directory(entry) &&
+		!lf12_is_dot_dir(entry);
+}
+
+static size_t tables_size(struct lf12_directory_entry *dir_entry)
+{
+	size_t size = sizeof(uint32_t);
+
+	if (NULL == dir_entry->children) {
+		return size;
+	}
+
+	size += dir_entry->child_count * 32;
+	for (int i = 0; i < dir_entry->child_count; i++) {
+		if (has_table(&dir_entry->children[i])) {
+			size += tables_size(&dir_entry->children[i]);
+		}
+	}
+
+	return size;
+}
+
+static char *write_tables(char *data, struct lf12_directory_entry *dir_entry)
+{
+	uint32_t entry_count = INDEX_NOT_LOADED;
+
+	if (NULL != dir_entry->children) {
+		entry_count = dir_entry->child_count;
+	}
+	memcpy(data, &entry_count, sizeof(uint32_t));
+	data += sizeof(uint32_t);
+
+	if (NULL == dir_entry->children) {
+		return data;
+	}
+
+	for (int i = 0; i < dir_entry->child_count; i++) {
+		_lf12_write_dir_entry(data, &dir_entry->children[i]);
+		data += 32;
+	}
+	for (int i = 0; i < dir_entry->child_count; i++) {
+		if (has_table(&dir_entry->children[i])) {
+			data = write_tables(data, &dir_entry->children[i]);
+		}
+	}
+
+	return data;
+}
+
+enum lf12_error lf12_write_index(int fd, const struct lf12_index_key *key,
+				 struct lf12_metadata *f12_meta)
+{
+	struct index_header header = { 0 };
+	size_t fat_size = f12_meta->entry_count * sizeof(uint16_t);
+	size_t size = sizeof(struct index_header) + fat_size +
+		tables_size(f12_meta->root_dir);
+	char *index, *position;
+	ssize_t written;
+	size_t offset = 0;
+
+	index = malloc(size);
+	if (NULL == index) {
+		return F12_ALLOCATION_ERROR;
+	}
+
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.version = INDEX_VERSION;
+	header.entry_count = f12_meta->entry_count;
+	header.size = size;
+	header.key = *key;
+	header.bpb = *f12_meta->bpb;
+	memcpy(index, &header, sizeof(struct index_header));
+	position = index + sizeof(struct index_header);
+	memcpy(position, f12_meta->fat_entries, fat_size);
+	write_tables(position + fat_size, f12_meta->root_dir);
+
+	while (offset < size) {
+		written = pwrite(fd, index + offset, size - offset, offset);
+		if (-1 == written) {
+			lf12_save_errno();
+			free(index);
+
+			return F12_IO_ERROR;
+		}
+		offset += written;
+	}
+	free(index);
+
+	return F12_SUCCESS;
+}
+
+static enum lf12_error read_tables(struct index_cursor *cursor,
+				   struct lf12_metadata *f12_meta,
+				   struct lf12_directory_entry *dir_entry)
+{
+	enum lf12_error err;
+	uint32_t entry_count;
+	struct lf12_directory_entry *entries;
+
+	if (cursor->remaining < sizeof(uint32_t)) {
+		return F12_STALE_INDEX;
+	}
+	memcpy(&entry_count, cursor->data, sizeof(uint32_t));
+	cursor->data += sizeof(uint32_t);
+	cursor->remaining -= sizeof(uint32_t);
+
+	if (INDEX_NOT_LOADED == entry_count) {
+		return F12_SUCCESS;
+	}
+	if (cursor->remaining / 32 < entry_count ||
+	    (dir_entry == f12_meta->root_dir &&
+	     entry_count != (uint32_t) dir_entry->child_count)) {
+		return F12_STALE_INDEX;
+	}
+
+	// The table of the root directory was created with the metadata
+	if (dir_entry != f12_meta->root_dir) {
+		err = _lf12_create_table(f12_meta, dir_entry, entry_count);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+	}
+	entries = dir_entry->children;
+
+	for (uint32_t i = 0; i < entry_count; i++) {
+		_lf12_read_dir_entry(cursor->data, &entries[i]);
+		entries[i].parent = dir_entry;
+		cursor->data += 32;
+		cursor->remaining -= 32;
+	}
+
+	for (uint32_t i = 0; i < entry_count; i++) {
+		if (dir_entry != f12_meta->root_dir &&
+		    _lf12_link_dot_dir(f12_meta, &entries[i])) {
+			continue;
+		}
+		if (!has_table(&entries[i])) {
+			continue;
+		}
+		err = read_tables(cursor, f12_meta, &entries[i]);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+	}
+
+	return F12_SUCCESS;
+}
+
+/**
+ * Check that the geometry in the header of an index matches the number of
+ * entries of the file allocation table and that the file allocation table and
+ * the root directory fit into the index.
+ *
+ * @param header a pointer to the header of the index
+ * @return non zero if the header is consistent
+ */
+static int check_header(struct index_header *header)
+{
+	struct bios_parameter_block *bpb = &header->bpb;
+	uint64_t fat_size = header->entry_count * sizeof(uint16_t);
+	uint64_t root_dir_size = sizeof(uint32_t) + bpb->RootDirEntries * 32;
+	uint16_t cluster_count;
+
+	if (0 == bpb->SectorsPerCluster) {
+		return 0;
+	}
+	// The same number of entries as in lf12_create_root_dir_meta
+	cluster_count = bpb->LogicalSectors / bpb->SectorsPerCluster + 2;
+	if (header->entry_count != cluster_count) {
+		return 0;
+	}
+	// Every entry takes 12 bits of the table on the image
+	if ((uint32_t) bpb->SectorsPerFat * bpb->SectorSize <
+	    (header->entry_count * 3 + 1) / 2) {
+		return 0;
+	}
+
+	return header->size - sizeof(struct index_header) >=
+		fat_size + root_dir_size;
+}
+
+static enum lf12_error restore_metadata(char *index,
+					struct lf12_metadata *f12_meta)
+{
+	enum lf12_error err;
+	struct index_header *header = (struct index_header *)index;
+	struct bios_parameter_block *bpb = f12_meta->bpb;
+	size_t fat_size = header->entry_count * sizeof(uint16_t);
+	struct index_cursor cursor;
+
+	if (!check_header(header)) {
+		return F12_STALE_INDEX;
+	}
+
+	*bpb = header->bpb;
+	f12_meta->root_dir_offset = bpb->SectorSize *
+		((bpb->NumberOfFats * bpb->SectorsPerFat) +
+		 bpb->ReservedForBoot);
+
+	err = lf12_create_root_dir_meta(f12_meta);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+
+	memcpy(f12_meta->fat_entries, index + sizeof(struct index_header),
+	       fat_size);
+	f12_meta->fat_id = f12_meta->fat_entries[0];
+	f12_meta->end_of_chain_marker = f12_meta->fat_entries[1];
+
+	cursor.data = index + sizeof(struct index_header) + fat_size;
+	cursor.remaining = header->size - sizeof(struct index_header) -
+		fat_size;
+
+	err = read_tables(&cursor, f12_meta, f12_meta->root_dir);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+
+	// The restored metadata matches the image
+	f12_meta->bpb_dirty = 0;
+	f12_meta->root_dir->dirty = 0;
+	memset(f12_meta->dirty_fat_sectors, 0, bpb->SectorsPerFat);
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_read_index(int fd, const struct lf12_index_key *key,
+				struct lf12_metadata **f12_meta)
+{
+	enum lf12_error err;
+	struct stat sb;
+	struct index_header *header;
+	char *index;
+
+	if (0 != fstat(fd, &sb)) {
+		lf12_save_errno();
+
+		return F12_IO_ERROR;
+	}
+	if (sb.st_size < (off_t) sizeof(struct index_header)) {
+		return F12_STALE_INDEX;
+	}
+
+	index = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (MAP_FAILED == index) {
+		lf12_save_errno();
+
+		return F12_IO_ERROR;
+	}
+
+	header = (struct index_header *)index;
+	if (0 != memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) ||
+	    INDEX_VERSION != header->version ||
+	    (uint64_t) sb.st_size != header->size ||
+	    0 != memcmp(&header->key, key, sizeof(struct lf12_index_key))) {
+		munmap(index, sb.st_size);
+
+		return F12_STALE_INDEX;
+	}
+
+	err = lf12_create_metadata(f12_meta);
+	if (F12_SUCCESS != err) {
+		munmap(index, sb.st_size);
+
+		return err;
+	}
+
+	err = restore_metadata(index, *f12_meta);
+	munmap(index, sb.st_size);
+	if (F12_SUCCESS != err) {
+		lf12_free_metadata(*f12_meta);
+		*f12_meta = NULL;
+
+		return err;
+	}
+
+	return F12_SUCCESS;
+}
@@ -2,12 +2,28 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
+#include "allocation_p.h"
+#include "directory_entry_p.h"
+#include "fat_p.h"
 #include "io_p.h"
 #include "libfat12.h"
 
-uint16_t _lf12_read_fat_entry(char *fat, int n)
+// Parts of the directory tree loaded by read_metadata
+enum load_depth {
+	// Only the bios parameter block and the file allocation table
+	LOAD_FAT,
+	// Additionally the root directory table
+	LOAD_ROOT_DIR,
+	// All directory tables
+	LOAD_TREE,
+};
+
+uint16_t _lf12_read_fat_entry(const char *fat, int n)
 {
 	uint16_t fat_entry;
 	memcpy(&fat_entry, fat + n * 3 / 2, 2);
@@ -18,6 +34,25 @@ uint16_t _lf12_read_fat_entry(char *fat, int n)
 	}
 }
 
+void _lf12_set_fat_entry(struct lf12_metadata *f12_meta, uint16_t cluster,
+			 uint16_t value)
+{
+	size_t offset = cluster * 3 / 2;
+	size_t sector_size;
+
+	f12_meta->fat_entries[cluster] = value;
+	_lf12_update_free_space(f12_meta, cluster, value);
+
+	if (NULL == f12_meta->dirty_fat_sectors) {
+		return;
+	}
+
+	// An entry may span two sectors
+	sector_size = f12_meta->bpb->SectorSize;
+	f12_meta->dirty_fat_sectors[offset / sector_size] = 1;
+	f12_meta->dirty_fat_sectors[(offset + 1) / sector_size] = 1;
+}
+
 int _lf12_cluster_offset(uint16_t cluster, struct lf12_metadata *f12_meta)
 {
 	struct bios_parameter_block *bpb = f12_meta->bpb;
@@ -45,6 +80,21 @@ uint16_t _lf12_get_cluster_chain_length(uint16_t start_cluster,
 	return chain_length;
 }
 
+uint16_t _lf12_get_extent(uint16_t *cluster, struct lf12_metadata *f12_meta)
+{
+	uint16_t *fat_entries = f12_meta->fat_entries;
+	uint16_t current_cluster = *cluster;
+	uint16_t extent_length = 1;
+
+	while (fat_entries[current_cluster] == current_cluster + 1) {
+		current_cluster++;
+		extent_length++;
+	}
+	*cluster = fat_entries[current_cluster];
+
+	return extent_length;
+}
+
 size_t _lf12_get_cluster_size(struct lf12_metadata *f12_meta)
 {
 	return f12_meta->bpb->SectorSize * f12_meta->bpb->SectorsPerCluster;
@@ -60,99 +110,130 @@ size_t _lf12_get_cluster_chain_size(uint16_t start_cluster,
 }
 
 /**
- * Load the contents of a cluster chain into memory.
+ * Get read access to a range of the image. If the device maps the range into
+ * the memory, a pointer into the mapping is returned. Otherwise the range is
+ * read into a buffer, which grows as needed.
  *
- * @param fp the file descriptor of the fat12 image
- * @param start_cluster the number of the first cluster in the cluster chain
- * @param f12_meta a pointer to the metadata of the partition
- * @return a pointer to the contents of the cluster chain in the memory. Must be
- *         freed.
+ * @param device a pointer to the device with the fat12 image
+ * @param count the number of bytes to access
+ * @param offset the offset of the range on the image
+ * @param buffer a pointer to a pointer to the buffer or to NULL. If the
+ * pointer is set after the call, the buffer must be freed.
+ * @param buffer_size a pointer to the size of the buffer in bytes
+ * @param view a pointer to the pointer, that is set to the range in the memory
+ * @return F12_SUCCESS or any error that occurred
  */
-static char *load_cluster_chain(FILE * fp,
-				uint16_t start_cluster,
-				struct lf12_metadata *f12_meta)
+static enum lf12_error map_or_read(struct lf12_device *device, size_t count,
+				   off_t offset, char **buffer,
+				   size_t *buffer_size, const char **view)
 {
-	uint16_t *fat_entries = f12_meta->fat_entries;
-	uint16_t current_cluster = start_cluster;
-	uint16_t cluster_size = _lf12_get_cluster_size(f12_meta);
-	size_t data_size = _lf12_get_cluster_chain_size(start_cluster,
-							f12_meta);
-	int offset;
-	char *data;
+	char *new_buffer;
 
-	data = malloc(data_size);
-
-	if (NULL == data) {
-		return NULL;
+	*view = lf12_device_map(device, count, offset);
+	if (NULL != *view) {
+		return F12_SUCCESS;
 	}
 
-	do {
-		offset = _lf12_cluster_offset(current_cluster, f12_meta);
-		if (0 != fseek(fp, offset, SEEK_SET)) {
-			lf12_save_errno();
-
-			return NULL;
+	if (*buffer_size < count) {
+		new_buffer = realloc(*buffer, count);
+		if (NULL == new_buffer) {
+			return F12_ALLOCATION_ERROR;
 		}
-		if (cluster_size != fread(data, 1, cluster_size, fp)) {
-			lf12_save_errno();
-
-			return NULL;
-		}
-		data += cluster_size;
-	} while ((current_cluster = fat_entries[current_cluster])
-		 != f12_meta->end_of_chain_marker);
-
-	data -= data_size;
+		*buffer = new_buffer;
+		*buffer_size = count;
+	}
+	*view = *buffer;
 
-	return data;
+	return lf12_device_read(device, *buffer, count, offset);
 }
 
 /**
- * Erase the contents of a cluster chain on the partition.
+ * Erase the contents of a cluster chain on the partition. The extents of the
+ * chain are discarded where the device supports it, which releases their
+ * storage on sparse images. Otherwise the clusters are overwritten with zeros.
  *
- * @param fp file pointer of the partition
+ * @param device a pointer to the device with the partition
  * @param f12_meta a pointer to the metadata of the partition
  * @param first_cluster the number of the first cluster of the cluster chain
  * @return F12_SUCCESS or any error that occurred
  */
-static enum lf12_error erase_cluster_chain(FILE * fp,
+static enum lf12_error erase_cluster_chain(struct lf12_device *device,
 					   struct lf12_metadata *f12_meta,
 					   uint16_t first_cluster)
 {
-	uint16_t *fat_entries = f12_meta->fat_entries;
+	enum lf12_error err;
 	uint16_t current_cluster = first_cluster;
+	uint16_t extent_start, extent_length;
 	size_t cluster_size = _lf12_get_cluster_size(f12_meta);
-	int offset;
-	char *zeros = malloc(cluster_size);
-
-	if (NULL == zeros) {
-		return F12_ALLOCATION_ERROR;
-	}
-
-	memset(zeros, 0, cluster_size);
-
-	do {
-		offset = _lf12_cluster_offset(current_cluster, f12_meta);
-		if (0 != fseek(fp, offset, SEEK_SET)) {
-			lf12_save_errno();
-			free(zeros);
-
-			return F12_IO_ERROR;
+	int discard = 1;
+	char *zeros = NULL;
+
+	while (current_cluster >= 2 &&
+	       current_cluster < f12_meta->end_of_chain_marker) {
+		extent_start = current_cluster;
+		extent_length = _lf12_get_extent(&current_cluster, f12_meta);
+
+		if (discard) {
+			err = lf12_device_discard(device,
+						  extent_length * cluster_size,
+						  _lf12_cluster_offset
+						  (extent_start, f12_meta));
+			if (F12_SUCCESS == err) {
+				continue;
+			}
+			if (F12_UNSUPPORTED != err) {
+				return err;
+			}
+			// Overwrite the clusters with zeros instead
+			discard = 0;
+			zeros = calloc(1, cluster_size);
+			if (NULL == zeros) {
+				return F12_ALLOCATION_ERROR;
+			}
 		}
-		if (cluster_size != fwrite(zeros, 1, cluster_size, fp)) {
-			lf12_save_errno();
-			free(zeros);
 
-			return F12_IO_ERROR;
+		for (uint16_t i = 0; i < extent_length; i++) {
+			err = lf12_device_write(device, zeros, cluster_size,
+						_lf12_cluster_offset
+						(extent_start + i, f12_meta));
+			if (F12_SUCCESS != err) {
+				free(zeros);
+
+				return err;
+			}
 		}
-	} while ((current_cluster = fat_entries[current_cluster])
-		 != f12_meta->end_of_chain_marker);
+	}
 
 	free(zeros);
 
 	return F12_SUCCESS;
 }
 
+/**
+ * Mark all clusters of a cluster chain as free in the file allocation table of
+ * the metadata.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param first_cluster the number of the first cluster of the cluster chain
+ */
+static void free_cluster_chain(struct lf12_metadata *f12_meta,
+			       uint16_t first_cluster)
+{
+	uint16_t current_cluster = first_cluster, next_cluster;
+
+	if (0 == first_cluster) {
+		// Empty files have no cluster chain
+		return;
+	}
+
+	do {
+		next_cluster = f12_meta->fat_entries[current_cluster];
+		_lf12_set_fat_entry(f12_meta, current_cluster, 0);
+		current_cluster = next_cluster;
+	} while (current_cluster != f12_meta->end_of_chain_marker &&
+		 current_cluster != 0);
+}
+
 /**
 * Erase a lf12_directory_entry structure
  *
@@ -163,7 +244,8 @@ static void erase_entry(struct lf12_directory_entry *entry)
 	memset(entry, 0, sizeof(struct lf12_directory_entry));
 }
 
-void _lf12_read_dir_entry(char *data, struct lf12_directory_entry *entry)
+void _lf12_read_dir_entry(const char *data,
+			  struct lf12_directory_entry *entry)
 {
 	memcpy(&entry->ShortFileName, data, 8);
 	memcpy(&entry->ShortFileExtension, data + 8, 3);
@@ -180,19 +262,61 @@ void _lf12_read_dir_entry(char *data, struct lf12_directory_entry *entry)
 	memcpy(&entry->FileSize, data + 28, 4);
 }
 
+void _lf12_write_dir_entry(char *data,
+			   const struct lf12_directory_entry *entry)
+{
+	memcpy(data, &entry->ShortFileName, 8);
+	memcpy(data + 8, &entry->ShortFileExtension, 3);
+	memcpy(data + 11, &entry->FileAttributes, 1);
+	memcpy(data + 12, &entry->UserAttributes, 1);
+	memcpy(data + 13, &entry->CreateTimeOrFirstCharacter, 1);
+	memcpy(data + 14, &entry->PasswordHashOrCreateTime, 2);
+	memcpy(data + 16, &entry->CreateDate, 2);
+	memcpy(data + 18, &entry->OwnerIdOrLastAccessDate, 2);
+	memcpy(data + 20, &entry->AccessRights, 2);
+	memcpy(data + 22, &entry->LastModifiedTime, 2);
+	memcpy(data + 24, &entry->LastModifiedDate, 2);
+	memcpy(data + 26, &entry->FirstCluster, 2);
+	memcpy(data + 28, &entry->FileSize, 4);
+}
+
+int _lf12_link_dot_dir(struct lf12_metadata *f12_meta,
+		       struct lf12_directory_entry *dir_entry)
+{
+	if (0 == memcmp(dir_entry->ShortFileName, ".       ", 8) &&
+	    0 == memcmp(dir_entry->ShortFileExtension, "   ", 3)) {
+		dir_entry->children = dir_entry->parent->children;
+		dir_entry->child_count = dir_entry->parent->child_count;
+		return 1;
+	}
+	if (0 == memcmp(dir_entry->ShortFileName, "..      ", 8) &&
+	    0 == memcmp(dir_entry->ShortFileExtension, "   ", 3)) {
+		if (dir_entry->parent == f12_meta->root_dir) {
+			return 1;
+		}
+		dir_entry->children = dir_entry->parent->parent->children;
+		dir_entry->child_count = dir_entry->parent->parent->child_count;
+		return 1;
+	}
+
+	return 0;
+}
+
 /**
  * Scan for subdirectories and files in a directory on the partition.
  *
- * @param fp file pointer of the fat12 partition
+ * @param device a pointer to the device with the fat12 partition
  * @param f12_meta a pointer to the metadata of the partition
  * @param dir_entry a pointer to a lf12_directory_entry structure describing the
  * directory, that should be scanned for subdirectories and files
+ * @param recursive if non zero, the subdirectories are scanned as well.
+ * Otherwise their children are left unloaded.
  * @return F12_SUCCESS or any error that occurred
  */
-static enum lf12_error scan_subsequent_entries(FILE * fp,
+static enum lf12_error scan_subsequent_entries(struct lf12_device *device,
 					       struct lf12_metadata *f12_meta,
 					       struct lf12_directory_entry
-					       *dir_entry)
+					       *dir_entry, int recursive)
 {
 	enum lf12_error err;
 
@@ -200,51 +324,62 @@ static enum lf12_error scan_subsequent_entries(FILE * fp,
 		return F12_SUCCESS;
 	}
 
-	if (0 == memcmp(dir_entry->ShortFileName, ".       ", 8) &&
-	    0 == memcmp(dir_entry->ShortFileExtension, "   ", 3)) {
-		dir_entry->children = dir_entry->parent->children;
-		dir_entry->child_count = dir_entry->parent->child_count;
-		return F12_SUCCESS;
-	}
-	if (0 == memcmp(dir_entry->ShortFileName, "..      ", 8) &&
-	    0 == memcmp(dir_entry->ShortFileExtension, "   ", 3)) {
-		if (dir_entry->parent == f12_meta->root_dir) {
-			return F12_SUCCESS;
-		}
-		dir_entry->children = dir_entry->parent->parent->children;
-		dir_entry->child_count = dir_entry->parent->parent->child_count;
+	if (_lf12_link_dot_dir(f12_meta, dir_entry)) {
 		return F12_SUCCESS;
 	}
 
+	size_t cluster_size = _lf12_get_cluster_size(f12_meta);
 	size_t directory_size =
 		_lf12_get_cluster_chain_size(dir_entry->FirstCluster,
 					     f12_meta);
 	int entry_count = directory_size / 32;
-	char *directory_table = load_cluster_chain(fp, dir_entry->FirstCluster,
-						   f12_meta);
-	if (NULL == directory_table) {
-		return F12_UNKNOWN_ERROR;
+	int extent_entries;
+	uint16_t current_cluster = dir_entry->FirstCluster;
+	uint16_t extent_start, extent_length;
+	char *buffer = NULL;
+	size_t buffer_size = 0;
+	const char *extent;
+	struct lf12_directory_entry *entries;
+
+	err = _lf12_create_table(f12_meta, dir_entry, entry_count);
+	if (F12_SUCCESS != err) {
+		return err;
 	}
+	entries = dir_entry->children;
+
+	// Decode the directory table with one access per run of consecutive
+	// clusters
+	for (int i = 0; i < entry_count; i += extent_entries) {
+		extent_start = current_cluster;
+		extent_length = _lf12_get_extent(&current_cluster, f12_meta);
+		extent_entries = extent_length * cluster_size / 32;
+		err = map_or_read(device, extent_length * cluster_size,
+				  _lf12_cluster_offset(extent_start, f12_meta),
+				  &buffer, &buffer_size, &extent);
+		if (F12_SUCCESS != err) {
+			free(buffer);
 
-	struct lf12_directory_entry *entries =
-		calloc(entry_count, sizeof(struct lf12_directory_entry));
-	if (NULL == entries) {
-		free(directory_table);
-		return F12_ALLOCATION_ERROR;
+			return err;
+		}
+		for (int j = 0; j < extent_entries; j++) {
+			_lf12_read_dir_entry(extent + j * 32,
+					     &entries[i + j]);
+			entries[i + j].parent = dir_entry;
+		}
 	}
+	free(buffer);
 
-	dir_entry->child_count = entry_count;
-	dir_entry->children = entries;
 	for (int i = 0; i < entry_count; i++) {
-		_lf12_read_dir_entry(directory_table + i * 32, &entries[i]);
-		entries[i].parent = dir_entry;
-		err = scan_subsequent_entries(fp, f12_meta, &entries[i]);
+		// The dot directories only link to already loaded tables
+		if (!recursive && !lf12_is_dot_dir(&entries[i])) {
+			continue;
+		}
+		err = scan_subsequent_entries(device, f12_meta, &entries[i],
+					      recursive);
 		if (F12_SUCCESS != err) {
-			free(directory_table);
 			return err;
 		}
 	}
-	free(directory_table);
 
 	return F12_SUCCESS;
 }
@@ -252,34 +387,29 @@ static enum lf12_error scan_subsequent_entries(FILE * fp,
 /**
  * Loads the root directory of a fat12 partition.
  *
- * @param fp file pointer of the partition
+ * @param device a pointer to the device with the partition
  * @param f12_meta a pointer to the metadata of the partition
  * @return F12_SUCCESS or any error that occurred
  */
-static enum lf12_error load_root_dir(FILE * fp, struct lf12_metadata *f12_meta)
+static enum lf12_error load_root_dir(struct lf12_device *device,
+				     struct lf12_metadata *f12_meta,
+				     int recursive)
 {
 	enum lf12_error err;
 	struct bios_parameter_block *bpb = f12_meta->bpb;
 
 	int root_start = f12_meta->root_dir_offset;
 	size_t root_size = bpb->RootDirEntries * 32;
-	char *root_data = malloc(root_size);
-
-	if (NULL == root_data) {
-		return F12_ALLOCATION_ERROR;
-	}
-
-	if (0 != fseek(fp, root_start, SEEK_SET)) {
-		lf12_save_errno();
-		free(root_data);
+	char *buffer = NULL;
+	size_t buffer_size = 0;
+	const char *root_data;
 
-		return F12_IO_ERROR;
-	}
-	if (root_size != fread(root_data, 1, root_size, fp)) {
-		lf12_save_errno();
-		free(root_data);
+	err = map_or_read(device, root_size, root_start, &buffer, &buffer_size,
+			  &root_data);
+	if (F12_SUCCESS != err) {
+		free(buffer);
 
-		return F12_IO_ERROR;
+		return err;
 	}
 
 	struct lf12_directory_entry *root_entries =
@@ -287,16 +417,20 @@ static enum lf12_error load_root_dir(FILE * fp, struct lf12_metadata *f12_meta)
 
 	for (int i = 0; i < bpb->RootDirEntries; i++) {
 		_lf12_read_dir_entry(root_data + i * 32, &root_entries[i]);
+		if (!recursive) {
+			continue;
+		}
 
-		err = scan_subsequent_entries(fp, f12_meta, &root_entries[i]);
+		err = scan_subsequent_entries(device, f12_meta,
+					      &root_entries[i], 1);
 		if (F12_SUCCESS != err) {
-			free(root_data);
+			free(buffer);
 
 			return err;
 		}
 	}
 
-	free(root_data);
+	free(buffer);
 
 	return F12_SUCCESS;
 }
@@ -304,66 +438,56 @@ static enum lf12_error load_root_dir(FILE * fp, struct lf12_metadata *f12_meta)
 /**
  * Reads all values out of the cluster table of the partition.
  *
- * @param fp file pointer of the partition
+ * @param device a pointer to the device with the partition
  * @param f12_meta a pointer to the metadata of the partition
  * @return F12_SUCCESS or any other error that occurred
  */
-static enum lf12_error read_fat_entries(FILE * fp,
+static enum lf12_error read_fat_entries(struct lf12_device *device,
 					struct lf12_metadata *f12_meta)
 {
+	enum lf12_error err;
 
 	struct bios_parameter_block *bpb = f12_meta->bpb;
 	int fat_start_addr = bpb->SectorSize * bpb->ReservedForBoot;
 	size_t fat_size = bpb->SectorsPerFat * bpb->SectorSize;
 	uint16_t cluster_count = bpb->LogicalSectors / bpb->SectorsPerCluster;
+	char *buffer = NULL;
+	size_t buffer_size = 0;
+	const char *fat;
 
-	char *fat = malloc(fat_size);
-
-	if (NULL == fat) {
-		return F12_ALLOCATION_ERROR;
-	}
-
-	if (0 != fseek(fp, fat_start_addr, SEEK_SET)) {
-		lf12_save_errno();
-		free(fat);
-
-		return F12_IO_ERROR;
-	}
-	if (fat_size != fread(fat, 1, fat_size, fp)) {
-		lf12_save_errno();
-		free(fat);
+	err = map_or_read(device, fat_size, fat_start_addr, &buffer,
+			  &buffer_size, &fat);
+	if (F12_SUCCESS != err) {
+		free(buffer);
 
-		return F12_IO_ERROR;
+		return err;
 	}
 
-	for (int i = 0; i < cluster_count; i++) {
-		f12_meta->fat_entries[i] = _lf12_read_fat_entry(fat, i);
-	}
+	_lf12_decode_fat(fat, f12_meta->fat_entries, cluster_count);
 
-	free(fat);
+	free(buffer);
 	return F12_SUCCESS;
 }
 
 /**
  * Populates a bios_parameter_block structure with data from the image.
  *
- * @param fp file pointer of the image
+ * @param device a pointer to the device with the image
  * @param bpb a pointer to the bios_parameter_block structure to populate
  * @return F12_SUCCESS or any other error that occurred
  */
-static enum lf12_error read_bpb(FILE * fp, struct bios_parameter_block *bpb)
+static enum lf12_error read_bpb(struct lf12_device *device,
+				struct bios_parameter_block *bpb)
 {
-	char buffer[59];
-
-	if (0 != fseek(fp, 3L, SEEK_SET)) {
-		lf12_save_errno();
-
-		return F12_IO_ERROR;
-	}
-	if (59 != fread(buffer, 1, 59, fp)) {
-		lf12_save_errno();
+	enum lf12_error err;
+	char storage[59];
+	char *scratch = storage;
+	size_t scratch_size = sizeof(storage);
+	const char *buffer;
 
-		return F12_IO_ERROR;
+	err = map_or_read(device, 59, 3L, &scratch, &scratch_size, &buffer);
+	if (F12_SUCCESS != err) {
+		return err;
 	}
 
 	memcpy(&(bpb->OEMLabel), buffer, 8);
@@ -395,86 +519,90 @@ static enum lf12_error read_bpb(FILE * fp, struct bios_parameter_block *bpb)
 /**
  * Writes data to a cluster chain.
  *
- * @param fp the file pointer of the image
+ * @param device a pointer to the device with the image
  * @param data a pointer to the data to write
  * @param first_cluster the number of the first cluster of the cluster chain
  * @param bytes the number of bytes to write
  * @param f12_meta a pointer to the metadata of the partition
  * @return F12_SUCCESS or any other error that occurred
  */
-static enum lf12_error write_to_cluster_chain(FILE * fp,
+static enum lf12_error write_to_cluster_chain(struct lf12_device *device,
 					      void *data,
 					      uint16_t first_cluster,
 					      size_t bytes,
 					      struct lf12_metadata *f12_meta)
 {
-	uint16_t chain_length = _lf12_get_cluster_chain_size(first_cluster,
-							     f12_meta);
-	uint16_t written_bytes = 0;
+	enum lf12_error err;
+	size_t chain_size = _lf12_get_cluster_chain_size(first_cluster,
+							 f12_meta);
+	size_t written_bytes = 0;
+	size_t cluster_size = _lf12_get_cluster_size(f12_meta);
+	size_t extent_size;
 	uint16_t current_cluster = first_cluster;
-	uint16_t cluster_size = _lf12_get_cluster_size(f12_meta);
-	uint16_t *fat_entries = f12_meta->fat_entries;
-	uint16_t bytes_left;
-	int offset;
+	uint16_t extent_start;
+	struct iovec iov[2];
+	int iovcnt;
+	char *zeros = NULL;
 
 	/* Check if the data is larger than the clusterchain */
-	if (bytes > chain_length) {
+	if (bytes > chain_size) {
 		return F12_LOGIC_ERROR;
 	}
 
 	/* Check if the data is more than on cluster smaller than the clusterchain */
-	if (bytes + cluster_size <= chain_length) {
+	if (bytes + cluster_size <= chain_size) {
 		return F12_LOGIC_ERROR;
 	}
 
-	while (written_bytes < bytes) {
-		offset = _lf12_cluster_offset(current_cluster, f12_meta);
-		if (0 != fseek(fp, offset, SEEK_SET)) {
-			lf12_save_errno();
-
-			return F12_IO_ERROR;
-
+	if (bytes < chain_size) {
+		zeros = calloc(1, chain_size - bytes);
+		if (NULL == zeros) {
+			return F12_ALLOCATION_ERROR;
 		}
-		bytes_left = bytes - written_bytes;
-
-		if (bytes_left < cluster_size) {
-			if (bytes_left != fwrite(data, 1, bytes_left, fp)) {
-				lf12_save_errno();
+	}
 
-				return F12_IO_ERROR;
-			}
-			char zero = 0;
-			for (uint16_t i = bytes_left; i < cluster_size; i++) {
-				if (1 != fwrite(&zero, 1, 1, fp)) {
-					lf12_save_errno();
+	while (written_bytes < bytes) {
+		extent_start = current_cluster;
+		extent_size = _lf12_get_extent(&current_cluster, f12_meta) *
+			cluster_size;
+		iov[0].iov_base = (char *)data + written_bytes;
+		iov[0].iov_len = extent_size;
+		iovcnt = 1;
+
+		if (bytes - written_bytes < extent_size) {
+			// Pad the last cluster with zeros in the same write
+			iov[0].iov_len = bytes - written_bytes;
+			iov[1].iov_base = zeros;
+			iov[1].iov_len = chain_size - bytes;
+			iovcnt = 2;
+		}
 
-					return F12_IO_ERROR;
-				}
-			}
-		} else {
-			if (cluster_size != fwrite(data, 1, cluster_size, fp)) {
-				lf12_save_errno();
+		err = lf12_device_writev(device, iov, iovcnt,
+					 _lf12_cluster_offset(extent_start,
+							      f12_meta));
+		if (F12_SUCCESS != err) {
+			free(zeros);
 
-				return F12_IO_ERROR;
-			}
+			return err;
 		}
 
-		written_bytes += cluster_size;
-		data += cluster_size;
-		current_cluster = fat_entries[current_cluster];
+		written_bytes += extent_size;
 	}
 
+	free(zeros);
+
 	return F12_SUCCESS;
 }
 
 /**
  * Write the bios_parameter_block structure to the image.
  *
- * @param fp file pointer of the partition
+ * @param device a pointer to the device with the partition
  * @param f12_meta a pointer to the metadata of the image
  * @return F12_SUCCESS or any other error that occurred
  */
-static enum lf12_error write_bpb(FILE * fp, struct lf12_metadata *f12_meta)
+static enum lf12_error write_bpb(struct lf12_device *device,
+				 struct lf12_metadata *f12_meta)
 {
 	struct bios_parameter_block *bpb = f12_meta->bpb;
 	char buffer[59];
@@ -499,18 +627,7 @@ static enum lf12_error write_bpb(FILE * fp, struct lf12_metadata *f12_meta)
 	memcpy(buffer + 40, &(bpb->VolumeLabel), 11);
 	memcpy(buffer + 51, &(bpb->FileSystem), 8);
 
-	if (0 != fseek(fp, 3L, SEEK_SET)) {
-		lf12_save_errno();
-
-		return F12_IO_ERROR;
-	}
-	if (59 != fwrite(buffer, 1, 59, fp)) {
-		lf12_save_errno();
-
-		return F12_IO_ERROR;
-	}
-
-	return F12_SUCCESS;
+	return lf12_device_write(device, buffer, 59, 3L);
 }
 
 /**
@@ -524,7 +641,6 @@ static char *create_fat(struct lf12_metadata *f12_meta)
 	struct bios_parameter_block *bpb = f12_meta->bpb;
 	int fat_size = bpb->SectorsPerFat * bpb->SectorSize;
 	int cluster_count = bpb->LogicalSectors / bpb->SectorsPerCluster;
-	uint16_t cluster;
 
 	char *fat = calloc(1, fat_size);
 
@@ -532,18 +648,7 @@ static char *create_fat(struct lf12_metadata *f12_meta)
 		return NULL;
 	}
 
-	for (int i = 0; i < cluster_count; i++) {
-		if (i % 2) {
-			// Odd cluster
-			cluster = (f12_meta->fat_entries[i] << 4) |
-				(f12_meta->fat_entries[i - 1] >> 8);
-			memmove(fat + i * 3 / 2, &cluster, 2);
-
-			continue;
-		}
-		cluster = f12_meta->fat_entries[i];
-		memmove(fat + i * 3 / 2, &cluster, 2);
-	}
+	_lf12_encode_fat(f12_meta->fat_entries, cluster_count, fat);
 
 	return fat;
 }
@@ -560,9 +665,7 @@ static char *create_fat(struct lf12_metadata *f12_meta)
 static char *create_directory(struct lf12_directory_entry *dir_entry,
 			      size_t dir_size)
 {
-	size_t offset;
 	char *dir = calloc(1, dir_size);
-	struct lf12_directory_entry *entry;
 
 	if (NULL == dir) {
 		return NULL;
@@ -573,75 +676,91 @@ static char *create_directory(struct lf12_directory_entry *dir_entry,
 	}
 
 	for (int i = 0; i < dir_entry->child_count; i++) {
-		entry = &dir_entry->children[i];
-		offset = i * 32;
-		memcpy(dir + offset, &entry->ShortFileName, 8);
-		memcpy(dir + offset + 8, &entry->ShortFileExtension, 3);
-		memcpy(dir + offset + 11, &entry->FileAttributes, 1);
-		memcpy(dir + offset + 12, &entry->UserAttributes, 1);
-		memcpy(dir + offset + 13, &entry->CreateTimeOrFirstCharacter,
-		       1);
-		memcpy(dir + offset + 14, &entry->PasswordHashOrCreateTime, 2);
-		memcpy(dir + offset + 16, &entry->CreateDate, 2);
-		memcpy(dir + offset + 18, &entry->OwnerIdOrLastAccessDate, 2);
-		memcpy(dir + offset + 20, &entry->AccessRights, 2);
-		memcpy(dir + offset + 22, &entry->LastModifiedTime, 2);
-		memcpy(dir + offset + 24, &entry->LastModifiedDate, 2);
-		memcpy(dir + offset + 26, &entry->FirstCluster, 2);
-		memcpy(dir + offset + 28, &entry->FileSize, 4);
+		_lf12_write_dir_entry(dir + i * 32, &dir_entry->children[i]);
 	}
 
 	return dir;
 }
 
 /**
- * Writes the file allocation table from the metadata on the partition.
+ * Writes the modified sectors of the file allocation table from the metadata
+ * on the partition.
  *
- * @param fp the file pointer of the image
+ * @param device a pointer to the device with the image
  * @param f12_meta a pointer to the metadata
  * @return F12_SUCCESS or any other error that occurred
  */
-static enum lf12_error write_fats(FILE * fp, struct lf12_metadata *f12_meta)
+static enum lf12_error write_fats(struct lf12_device *device,
+				  struct lf12_metadata *f12_meta)
 {
+	enum lf12_error err;
 	struct bios_parameter_block *bpb = f12_meta->bpb;
+	uint8_t *dirty = f12_meta->dirty_fat_sectors;
 	int fat_offset = bpb->SectorSize * bpb->ReservedForBoot;
 	size_t fat_size = bpb->SectorsPerFat * bpb->SectorSize;
+	size_t run_offset;
 	int fat_count = bpb->NumberOfFats;
-	char *fat = create_fat(f12_meta);
+	int sector, run, modified = 0;
+	char *fat;
+
+	for (sector = 0; sector < bpb->SectorsPerFat; sector++) {
+		if (NULL == dirty || dirty[sector]) {
+			modified = 1;
+			break;
+		}
+	}
+	if (!modified) {
+		return F12_SUCCESS;
+	}
 
+	fat = create_fat(f12_meta);
 	if (NULL == fat) {
 		return F12_ALLOCATION_ERROR;
 	}
 
-	if (0 != fseek(fp, fat_offset, SEEK_SET)) {
-		lf12_save_errno();
-		free(fat);
+	for (sector = 0; sector < bpb->SectorsPerFat; sector += run) {
+		run = 1;
+		if (NULL != dirty && !dirty[sector]) {
+			continue;
+		}
+		// Write runs of consecutive modified sectors at once
+		while (sector + run < bpb->SectorsPerFat &&
+		       (NULL == dirty || dirty[sector + run])) {
+			run++;
+		}
 
-		return F12_IO_ERROR;
-	}
-	for (int i = 0; i < fat_count; i++) {
-		if (fat_size != fwrite(fat, 1, fat_size, fp)) {
-			lf12_save_errno();
-			free(fat);
+		run_offset = sector * bpb->SectorSize;
+		for (int i = 0; i < fat_count; i++) {
+			err = lf12_device_write(device, fat + run_offset,
+						run * bpb->SectorSize,
+						fat_offset + i * fat_size +
+						run_offset);
+			if (F12_SUCCESS != err) {
+				free(fat);
 
-			return F12_IO_ERROR;
+				return err;
+			}
 		}
 	}
 
+	if (NULL != dirty) {
+		memset(dirty, 0, bpb->SectorsPerFat);
+	}
+
 	free(fat);
 	return F12_SUCCESS;
 }
 
 /**
  * Writes the directory described by a lf12_directory_entry structure and all
- * its children on the image.
+ * its children on the image, if they were modified.
  *
- * @param fp the file pointer of the image
+ * @param device a pointer to the device with the image
  * @param f12_meta a pointer to the metadata of the image
  * @param entry a pointer to the lf12_directory_entry structure
  * @return F12_SUCCESS or any other error that occurred
  */
-static enum lf12_error write_directory(FILE * fp,
+static enum lf12_error write_directory(struct lf12_device *device,
 				       struct lf12_metadata *f12_meta,
 				       struct lf12_directory_entry *entry)
 {
@@ -657,24 +776,29 @@ static enum lf12_error write_directory(FILE * fp,
 	uint16_t first_cluster = entry->FirstCluster;
 
 	for (int i = 0; i < entry->child_count; i++) {
-		err = write_directory(fp, f12_meta, &entry->children[i]);
+		err = write_directory(device, f12_meta, &entry->children[i]);
 		if (F12_SUCCESS != err) {
 			return err;
 		}
 	}
 
+	if (!entry->dirty) {
+		return F12_SUCCESS;
+	}
+
 	size_t dir_size = _lf12_get_cluster_chain_size(entry->FirstCluster,
 						       f12_meta);
 	char *dir = create_directory(entry, dir_size);
 	if (NULL == dir) {
 		return F12_ALLOCATION_ERROR;
 	}
-	err = write_to_cluster_chain(fp, dir, first_cluster, dir_size,
+	err = write_to_cluster_chain(device, dir, first_cluster, dir_size,
 				     f12_meta);
 	free(dir);
 	if (F12_SUCCESS != err) {
 		return err;
 	}
+	entry->dirty = 0;
 
 	return F12_SUCCESS;
 }
@@ -683,43 +807,275 @@ static enum lf12_error write_directory(FILE * fp,
  * Writes the root directory from the metadata of a fat12 image on the
  * image.
  *
- * @param fp the file pointer of the image
+ * @param device a pointer to the device with the image
  * @param f12_meta a pointer to the metadata of the image
  * @return F12_SUCCESS or any other error that occurred
  */
-static enum lf12_error write_root_dir(FILE * fp, struct lf12_metadata *f12_meta)
+static enum lf12_error write_root_dir(struct lf12_device *device,
+				      struct lf12_metadata *f12_meta)
 {
 	enum lf12_error err;
-
 	size_t dir_size = 32 * f12_meta->bpb->RootDirEntries;
-	char *dir = create_directory(f12_meta->root_dir, dir_size);
-
-	if (NULL == dir) {
-		return F12_ALLOCATION_ERROR;
-	}
+	char *dir;
 
 	for (int i = 0; i < f12_meta->root_dir->child_count; i++) {
-		err = write_directory(fp, f12_meta,
+		err = write_directory(device, f12_meta,
 				      &f12_meta->root_dir->children[i]);
 		if (F12_SUCCESS != err) {
 			return err;
 		}
 	}
 
-	if (0 != fseek(fp, f12_meta->root_dir_offset, SEEK_SET)) {
-		lf12_save_errno();
-		free(dir);
+	if (!f12_meta->root_dir->dirty) {
+		return F12_SUCCESS;
+	}
 
-		return F12_IO_ERROR;
+	dir = create_directory(f12_meta->root_dir, dir_size);
+	if (NULL == dir) {
+		return F12_ALLOCATION_ERROR;
+	}
+
+	err = lf12_device_write(device, dir, dir_size,
+				f12_meta->root_dir_offset);
+	free(dir);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+	f12_meta->root_dir->dirty = 0;
+
+	return F12_SUCCESS;
+}
+
+/**
+ * Allocate a free cluster and append it to a cluster chain. The cluster is
+ * chosen by the allocation policy of the partition.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param last_cluster the last cluster of the chain or 0 to start a new chain
+ * @param cluster_count the number of clusters the chain still needs or 0 if it
+ * is not known
+ * @return the number of the allocated cluster or 0 if the partition is full
+ */
+static uint16_t append_cluster(struct lf12_metadata *f12_meta,
+			       uint16_t last_cluster,
+			       unsigned int cluster_count)
+{
+	uint16_t cluster = _lf12_choose_free_cluster(f12_meta, last_cluster,
+						     cluster_count);
+
+	if (0 == cluster) {
+		return 0;
+	}
+
+	if (0 != last_cluster) {
+		_lf12_set_fat_entry(f12_meta, last_cluster, cluster);
+	}
+	_lf12_set_fat_entry(f12_meta, cluster, f12_meta->end_of_chain_marker);
+
+	return cluster;
+}
+
+/**
+ * Get the file descriptor of a stream, if the data of the stream can be
+ * copied inside the kernel. This is the case for regular files without data
+ * buffered in the stream.
+ *
+ * @param fp the file pointer of the stream
+ * @param remaining a pointer to the variable, that is set to the number of
+ * bytes between the position of the stream and the end of the file
+ * @return the file descriptor or -1 if the data can not be copied directly
+ */
+static int regular_file_fd(FILE * fp, off_t *remaining)
+{
+	struct stat sb;
+	off_t position;
+	int fd = fileno(fp);
+
+	if (-1 == fd || 0 != fstat(fd, &sb) || !S_ISREG(sb.st_mode)) {
+		return -1;
+	}
+
+	position = ftello(fp);
+	if (-1 == position || position != lseek(fd, 0, SEEK_CUR) ||
+	    position > sb.st_size) {
+		return -1;
+	}
+	*remaining = sb.st_size - position;
+
+	return fd;
+}
+
+/**
+ * Copy the data of an extent from a file into the image inside the kernel.
+ * The remainder of the extent is filled with zeros.
+ *
+ * @param device a pointer to the device with the partition
+ * @param fd the file descriptor of the source file
+ * @param data_size the number of bytes to copy from the file
+ * @param extent_size the size of the extent in bytes
+ * @param offset the offset of the extent on the device
+ * @param zeros a pointer to at least one cluster of zeros
+ * @return F12_SUCCESS, F12_UNSUPPORTED if the data can not be copied inside
+ * the kernel or any other error that occurred
+ */
+static enum lf12_error copy_extent_from_fd(struct lf12_device *device, int fd,
+					   size_t data_size,
+					   size_t extent_size, off_t offset,
+					   const char *zeros)
+{
+	enum lf12_error err;
+
+	err = lf12_device_copy_from_fd(device, fd, data_size, offset);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+	if (data_size < extent_size) {
+		return lf12_device_write(device, zeros, extent_size - data_size,
+					 offset + data_size);
+	}
+
+	return F12_SUCCESS;
+}
+
+/**
+ * Copy the contents of a file into a new cluster chain. The file is read in
+ * chunks and the clusters are allocated as the data arrives, so that files
+ * without a known size like pipes can be copied. Regular files are copied
+ * inside the kernel where possible.
+ *
+ * @param device a pointer to the device with the partition
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param source_fp the file pointer of the file to copy
+ * @param first_cluster a pointer to the first cluster of the new chain. It
+ * stays 0 for empty files and holds the clusters allocated so far if an error
+ * occurs.
+ * @param file_size a pointer to the number of bytes copied
+ * @return F12_SUCCESS or any error that occurred
+ */
+static enum lf12_error stream_to_cluster_chain(struct lf12_device *device,
+					       struct lf12_metadata *f12_meta,
+					       FILE * source_fp,
+					       uint16_t *first_cluster,
+					       size_t *file_size)
+{
+	enum lf12_error err;
+	size_t cluster_size = _lf12_get_cluster_size(f12_meta);
+	size_t buffer_size, count, padded, extent_size, data_size;
+	uint16_t last_cluster = 0, chunk_cluster, extent_start;
+	unsigned int expected = 0, allocated = 0;
+	off_t offset, remaining = 0;
+	char *buffer;
+	int fd;
+
+	// The buffer holds a whole number of clusters
+	buffer_size = LF12_STREAM_BUFFER_SIZE -
+		LF12_STREAM_BUFFER_SIZE % cluster_size;
+	if (buffer_size < cluster_size) {
+		buffer_size = cluster_size;
+	}
+	buffer = malloc(buffer_size);
+	if (NULL == buffer) {
+		return F12_ALLOCATION_ERROR;
+	}
+
+	fd = regular_file_fd(source_fp, &remaining);
+	if (-1 != fd) {
+		// The buffer only provides the padding of the last cluster
+		memset(buffer, 0, cluster_size);
+		expected = (remaining + cluster_size - 1) / cluster_size;
+	}
+
+	while (1) {
+		if (-1 != fd) {
+			count = remaining < (off_t) buffer_size ?
+				(size_t) remaining : buffer_size;
+			remaining -= count;
+		} else {
+			count = fread(buffer, 1, buffer_size, source_fp);
+		}
+		if (0 == count) {
+			break;
+		}
+
+		chunk_cluster = 0;
+		for (size_t i = 0; i < count; i += cluster_size) {
+			last_cluster = append_cluster(f12_meta, last_cluster,
+						      expected > allocated ?
+						      expected - allocated : 0);
+			if (0 == last_cluster) {
+				free(buffer);
+
+				return F12_IMAGE_FULL;
+			}
+			allocated++;
+			if (0 == *first_cluster) {
+				*first_cluster = last_cluster;
+			}
+			if (0 == chunk_cluster) {
+				chunk_cluster = last_cluster;
+			}
+		}
+
+		// Pad the last cluster with zeros
+		padded = (count + cluster_size - 1) / cluster_size *
+			cluster_size;
+		if (-1 == fd) {
+			memset(buffer + count, 0, padded - count);
+		}
+
+		for (size_t written = 0; written < padded;
+		     written += extent_size) {
+			extent_start = chunk_cluster;
+			extent_size = _lf12_get_extent(&chunk_cluster,
+						       f12_meta) * cluster_size;
+			offset = _lf12_cluster_offset(extent_start, f12_meta);
+
+			if (-1 != fd) {
+				data_size = count - written;
+				if (data_size > extent_size) {
+					data_size = extent_size;
+				}
+				err = copy_extent_from_fd(device, fd, data_size,
+							  extent_size, offset,
+							  buffer);
+				if (F12_SUCCESS == err) {
+					continue;
+				}
+				if (F12_UNSUPPORTED != err) {
+					free(buffer);
+
+					return err;
+				}
+				// Read the rest of the chunk through the stream
+				fd = -1;
+				if (count - written !=
+				    fread(buffer + written, 1, count - written,
+					  source_fp)) {
+					lf12_save_errno();
+					free(buffer);
+
+					return F12_IO_ERROR;
+				}
+				memset(buffer + count, 0, padded - count);
+			}
+
+			err = lf12_device_write(device, buffer + written,
+						extent_size, offset);
+			if (F12_SUCCESS != err) {
+				free(buffer);
+
+				return err;
+			}
+		}
+		*file_size += count;
 	}
+	free(buffer);
 
-	if (dir_size != fwrite(dir, 1, dir_size, fp)) {
+	if (ferror(source_fp)) {
 		lf12_save_errno();
-		free(dir);
 
 		return F12_IO_ERROR;
 	}
-	free(dir);
 
 	return F12_SUCCESS;
 }
@@ -727,42 +1083,37 @@ static enum lf12_error write_root_dir(FILE * fp, struct lf12_metadata *f12_meta)
 uint16_t _lf12_create_cluster_chain(struct lf12_metadata *f12_meta,
 				    int cluster_count)
 {
-	uint16_t i = 0, j = 2, first_cluster, last_cluster;
-	unsigned int free_clusters = 0;
-
-	// Retrieve the number of unused cluster
-	for (int cluster = 2; cluster < f12_meta->entry_count; cluster++) {
-		if (0 == f12_meta->fat_entries[cluster]) {
-			free_clusters++;
-		}
-	}
+	uint16_t first_cluster = 0, last_cluster = 0;
 
-	if (cluster_count > free_clusters) {
+	if (cluster_count <= 0 ||
+	    (unsigned int) cluster_count >
+	    _lf12_get_free_cluster_count(f12_meta)) {
 		return 0;
 	}
 
-	while (j < f12_meta->entry_count) {
-		if (f12_meta->fat_entries[j] == 0) {
-			if (i > 0) {
-				f12_meta->fat_entries[last_cluster] = j;
-			} else {
-				first_cluster = j;
-			}
-			last_cluster = j;
-			i++;
-			if (i == cluster_count) {
-				f12_meta->fat_entries[j] =
-					f12_meta->end_of_chain_marker;
-				return first_cluster;
-			}
+	for (int i = 0; i < cluster_count; i++) {
+		last_cluster = append_cluster(f12_meta, last_cluster,
+					      cluster_count - i);
+		if (0 == first_cluster) {
+			first_cluster = last_cluster;
 		}
-		j++;
 	}
 
-	return 0;
+	return first_cluster;
 }
 
-enum lf12_error lf12_read_metadata(FILE * fp, struct lf12_metadata **f12_meta)
+/**
+ * Populates a lf12_metadata structure with data from a fat12 image.
+ *
+ * @param device a pointer to the device with the image
+ * @param f12_meta a pointer to a pointer to the lf12_metadata structure to
+ * populate.
+ * @param depth how much of the directory tree is loaded
+ * @return F12_SUCCESS or any other error that occurred
+ */
+static enum lf12_error read_metadata(struct lf12_device *device,
+				     struct lf12_metadata **f12_meta,
+				     enum load_depth depth)
 {
 	enum lf12_error err;
 	struct bios_parameter_block *bpb;
@@ -773,7 +1124,7 @@ enum lf12_error lf12_read_metadata(FILE * fp, struct lf12_metadata **f12_meta)
 	}
 
 	bpb = (*f12_meta)->bpb;
-	if (F12_SUCCESS != (err = read_bpb(fp, (*f12_meta)->bpb))) {
+	if (F12_SUCCESS != (err = read_bpb(device, (*f12_meta)->bpb))) {
 		lf12_free_metadata(*f12_meta);
 		*f12_meta = NULL;
 
@@ -786,10 +1137,13 @@ enum lf12_error lf12_read_metadata(FILE * fp, struct lf12_metadata **f12_meta)
 
 	err = lf12_create_root_dir_meta(*f12_meta);
 	if (F12_SUCCESS != err) {
+		lf12_free_metadata(*f12_meta);
+		*f12_meta = NULL;
+
 		return err;
 	}
 
-	if (F12_SUCCESS != (err = read_fat_entries(fp, *f12_meta))) {
+	if (F12_SUCCESS != (err = read_fat_entries(device, *f12_meta))) {
 		lf12_free_metadata(*f12_meta);
 		*f12_meta = NULL;
 
@@ -799,31 +1153,149 @@ enum lf12_error lf12_read_metadata(FILE * fp, struct lf12_metadata **f12_meta)
 	(*f12_meta)->fat_id = (*f12_meta)->fat_entries[0];
 	(*f12_meta)->end_of_chain_marker = (*f12_meta)->fat_entries[1];
 
-	if (F12_SUCCESS != (err = load_root_dir(fp, *f12_meta))) {
-		lf12_free_metadata(*f12_meta);
-		*f12_meta = NULL;
+	if (LOAD_FAT != depth) {
+		err = load_root_dir(device, *f12_meta, LOAD_TREE == depth);
+		if (F12_SUCCESS != err) {
+			lf12_free_metadata(*f12_meta);
+			*f12_meta = NULL;
 
-		return err;
+			return err;
+		}
 	}
 
+	// The metadata matches the image
+	(*f12_meta)->bpb_dirty = 0;
+	(*f12_meta)->root_dir->dirty = 0;
+	memset((*f12_meta)->dirty_fat_sectors, 0, bpb->SectorsPerFat);
+
 	return F12_SUCCESS;
 }
 
-enum lf12_error lf12_write_metadata(FILE * fp, struct lf12_metadata *f12_meta)
+enum lf12_error lf12_read_metadata(struct lf12_device *device,
+				   struct lf12_metadata **f12_meta)
+{
+	return read_metadata(device, f12_meta, LOAD_TREE);
+}
+
+enum lf12_error lf12_read_metadata_lazy(struct lf12_device *device,
+					struct lf12_metadata **f12_meta)
+{
+	return read_metadata(device, f12_meta, LOAD_ROOT_DIR);
+}
+
+enum lf12_error lf12_read_fat_metadata(struct lf12_device *device,
+				       struct lf12_metadata **f12_meta)
+{
+	return read_metadata(device, f12_meta, LOAD_FAT);
+}
+
+enum lf12_error lf12_load_directory(struct lf12_device *device,
+				    struct lf12_metadata *f12_meta,
+				    struct lf12_directory_entry *dir_entry,
+				    int recursive)
 {
 	enum lf12_error err;
 
-	err = write_bpb(fp, f12_meta);
-	if (F12_SUCCESS != err) {
-		return err;
+	if (lf12_entry_is_empty(dir_entry) || !lf12_is_directory(dir_entry) ||
+	    lf12_is_dot_dir(dir_entry)) {
+		return F12_SUCCESS;
 	}
 
-	err = write_fats(fp, f12_meta);
+	if (NULL == dir_entry->children && dir_entry != f12_meta->root_dir) {
+		return scan_subsequent_entries(device, f12_meta, dir_entry,
+					       recursive);
+	}
+
+	if (!recursive) {
+		return F12_SUCCESS;
+	}
+
+	for (int i = 0; i < dir_entry->child_count; i++) {
+		err = lf12_load_directory(device, f12_meta,
+					  &dir_entry->children[i], 1);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+	}
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_load_entry_from_path(struct lf12_device *device,
+					  struct lf12_metadata *f12_meta,
+					  struct lf12_path *path,
+					  struct lf12_directory_entry **entry)
+{
+	enum lf12_error err;
+	struct lf12_directory_entry *dir_entry = f12_meta->root_dir;
+
+	while (NULL != path) {
+		err = lf12_load_directory(device, f12_meta, dir_entry, 0);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+
+		*entry = _lf12_find_child(dir_entry, path->short_file_name,
+					  path->short_file_extension);
+		if (NULL == *entry) {
+			return F12_FILE_NOT_FOUND;
+		}
+
+		dir_entry = *entry;
+		path = path->descendant;
+	}
+	*entry = dir_entry;
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_load_entry_from_compact_path(struct lf12_device *device,
+						  struct lf12_metadata
+						  *f12_meta,
+						  const struct lf12_compact_path
+						  *path,
+						  struct lf12_directory_entry
+						  **entry)
+{
+	enum lf12_error err;
+	struct lf12_directory_entry *dir_entry = f12_meta->root_dir;
+
+	for (int i = 0; i < path->part_count; i++) {
+		err = lf12_load_directory(device, f12_meta, dir_entry, 0);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+
+		dir_entry = _lf12_find_child(dir_entry, path->names[i],
+					     path->names[i] + 8);
+		if (NULL == dir_entry) {
+			return F12_FILE_NOT_FOUND;
+		}
+	}
+	*entry = dir_entry;
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_write_metadata(struct lf12_device *device,
+				    struct lf12_metadata *f12_meta)
+{
+	enum lf12_error err;
+
+	if (f12_meta->bpb_dirty) {
+		err = write_bpb(device, f12_meta);
+		if (F12_SUCCESS != err) {
+			return err;
+		}
+		f12_meta->bpb_dirty = 0;
+	}
+
+	err = write_fats(device, f12_meta);
 	if (F12_SUCCESS != err) {
 		return err;
 	}
 
-	err = write_root_dir(fp, f12_meta);
+	err = write_root_dir(device, f12_meta);
 	if (F12_SUCCESS != err) {
 		return err;
 	}
@@ -831,7 +1303,7 @@ enum lf12_error lf12_write_metadata(FILE * fp, struct lf12_metadata *f12_meta)
 	return F12_SUCCESS;
 }
 
-enum lf12_error lf12_del_entry(FILE * fp,
+enum lf12_error lf12_del_entry(struct lf12_device *device,
 			       struct lf12_metadata *f12_meta,
 			       struct lf12_directory_entry *entry,
 			       int soft_delete)
@@ -846,108 +1318,158 @@ enum lf12_error lf12_del_entry(FILE * fp,
 		return F12_SUCCESS;
 	}
 
+	err = lf12_unlink_entry(device, f12_meta, entry);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+
+	err = lf12_write_metadata(device, f12_meta);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
+
+	return F12_SUCCESS;
+}
+
+enum lf12_error lf12_unlink_entry(struct lf12_device *device,
+				  struct lf12_metadata *f12_meta,
+				  struct lf12_directory_entry *entry)
+{
+	enum lf12_error err;
+
+	if (lf12_is_directory(entry) && lf12_get_child_count(entry) > 2) {
+		return F12_DIR_NOT_EMPTY;
+	}
+
 	if (entry->FirstCluster) {
-		err = erase_cluster_chain(fp, f12_meta, entry->FirstCluster);
+		err = erase_cluster_chain(device, f12_meta,
+					  entry->FirstCluster);
 		if (err != F12_SUCCESS) {
 			return err;
 		}
+		free_cluster_chain(f12_meta, entry->FirstCluster);
 	}
-	if (entry->children) {
-		free(entry->children);
-	}
+	// The table stays in the arena until the metadata is freed
+	_lf12_drop_name_index(entry);
+	entry->parent->dirty = 1;
+	_lf12_unindex_child(entry->parent, entry);
 	erase_entry(entry);
-	err = lf12_write_metadata(fp, f12_meta);
-	if (F12_SUCCESS != err) {
-		return err;
-	}
 
 	return F12_SUCCESS;
 }
 
-enum lf12_error lf12_dump_file(FILE * fp,
+enum lf12_error lf12_dump_file(struct lf12_device *device,
 			       struct lf12_metadata *f12_meta,
 			       struct lf12_directory_entry *entry,
 			       FILE * dest_fp)
 {
-	uint32_t file_size = entry->FileSize;
-	char *buffer = load_cluster_chain(fp, entry->FirstCluster, f12_meta);
+	enum lf12_error err = F12_SUCCESS;
+	uint32_t bytes_left = entry->FileSize;
+	uint16_t current_cluster = entry->FirstCluster;
+	uint16_t extent_length;
+	size_t cluster_size = _lf12_get_cluster_size(f12_meta);
+	size_t extent_left, count;
+	off_t offset, position;
+	char *buffer = NULL;
+	const char *data;
+	int fd = -1;
 
-	if (NULL == buffer) {
-		return F12_UNKNOWN_ERROR;
+	// Extents are copied into the file directly, so nothing may be pending
+	// in the stream
+	if (bytes_left > 0 && 0 == fflush(dest_fp)) {
+		fd = fileno(dest_fp);
 	}
 
-	if (file_size != fwrite(buffer, 1, file_size, dest_fp)) {
-		lf12_save_errno();
+	// Every error leaves the loops, so that the buffer is freed below
+	while (F12_SUCCESS == err && bytes_left > 0) {
+		offset = _lf12_cluster_offset(current_cluster, f12_meta);
+		extent_length = _lf12_get_extent(&current_cluster, f12_meta);
+		extent_left = extent_length * cluster_size;
+		if (bytes_left < extent_left) {
+			extent_left = bytes_left;
+		}
 
-		return F12_IO_ERROR;
+		if (-1 != fd) {
+			err = lf12_device_copy_to_fd(device, fd, extent_left,
+						     offset);
+			if (F12_SUCCESS == err) {
+				bytes_left -= extent_left;
+				continue;
+			}
+			if (F12_UNSUPPORTED != err) {
+				break;
+			}
+			// Continue at the end of the copied data in the stream
+			position = lseek(fd, 0, SEEK_CUR);
+			if (-1 != position) {
+				fseeko(dest_fp, position, SEEK_SET);
+			}
+			fd = -1;
+			err = F12_SUCCESS;
+		}
+
+		data = lf12_device_map(device, extent_left, offset);
+		if (NULL != data) {
+			if (extent_left != fwrite(data, 1, extent_left,
+						  dest_fp)) {
+				lf12_save_errno();
+				err = F12_IO_ERROR;
+				break;
+			}
+			bytes_left -= extent_left;
+			continue;
+		}
+
+		if (NULL == buffer) {
+			buffer = malloc(LF12_STREAM_BUFFER_SIZE);
+			if (NULL == buffer) {
+				err = F12_ALLOCATION_ERROR;
+				break;
+			}
+		}
+		// Stream the extent through the buffer
+		while (extent_left > 0) {
+			count = extent_left < LF12_STREAM_BUFFER_SIZE ?
+				extent_left : LF12_STREAM_BUFFER_SIZE;
+			err = lf12_device_read(device, buffer, count, offset);
+			if (F12_SUCCESS != err) {
+				break;
+			}
+			if (count != fwrite(buffer, 1, count, dest_fp)) {
+				lf12_save_errno();
+				err = F12_IO_ERROR;
+				break;
+			}
+			extent_left -= count;
+			bytes_left -= count;
+			offset += count;
+		}
 	}
 
 	free(buffer);
 
-	return F12_SUCCESS;
+	return err;
 }
 
-enum lf12_error lf12_create_file(FILE * fp,
+enum lf12_error lf12_create_file(struct lf12_device *device,
 				 struct lf12_metadata *f12_meta,
 				 struct lf12_path *path, FILE * source_fp,
 				 suseconds_t created)
 {
 	enum lf12_error err;
-
 	struct lf12_directory_entry *entry;
-	size_t cluster_size, file_size;
-	int cluster_count;
-	uint16_t first_cluster;
-
-	cluster_size = _lf12_get_cluster_size(f12_meta);
-	if (0 != fseek(source_fp, 0L, SEEK_END)) {
-		lf12_save_errno();
-
-		return F12_IO_ERROR;
-	}
-	long int ftell_res = ftell(source_fp);
-	if (-1L == ftell_res) {
-		lf12_save_errno();
-		fclose(fp);
-
-		return F12_IO_ERROR;
-	}
-	file_size = (size_t) ftell_res;
-	rewind(source_fp);
-
-	cluster_count = file_size / cluster_size;
-	if (file_size % cluster_size) {
-		cluster_count++;
-	}
-
-	first_cluster = _lf12_create_cluster_chain(f12_meta, cluster_count);
-
-	if (0 == first_cluster) {
-		// Image full
-		return F12_IMAGE_FULL;
-	}
-
-	char *data = malloc(file_size);
-	if (NULL == data) {
-		return F12_ALLOCATION_ERROR;
-	}
+	uint16_t first_cluster = 0;
+	size_t file_size = 0;
 
-	if (file_size != fread(data, 1, file_size, source_fp)) {
-		lf12_save_errno();
-		free(data);
-
-		return F12_IO_ERROR;
+	err = stream_to_cluster_chain(device, f12_meta, source_fp,
+				      &first_cluster, &file_size);
+	if (F12_SUCCESS == err) {
+		err = lf12_create_entry_from_path(f12_meta, path, &entry);
 	}
-
-	err = write_to_cluster_chain(fp, data, first_cluster, file_size,
-				     f12_meta);
-	free(data);
 	if (F12_SUCCESS != err) {
-		return err;
-	}
+		// Release the clusters allocated so far
+		free_cluster_chain(f12_meta, first_cluster);
 
-	err = lf12_create_entry_from_path(f12_meta, path, &entry);
-	if (err != F12_SUCCESS) {
 		return err;
 	}
 	/*
@@ -974,19 +1496,22 @@ enum lf12_error lf12_create_directory_table(struct lf12_metadata *f12_meta,
 					    struct lf12_directory_entry *entry)
 {
 	size_t table_size = 244 * 32;
+	struct lf12_directory_entry *children;
+	enum lf12_error err = _lf12_create_table(f12_meta, entry, 224);
 
-	struct lf12_directory_entry *children =
-		calloc(224, sizeof(struct lf12_directory_entry));
-	if (NULL == children) {
-		return F12_ALLOCATION_ERROR;
+	if (F12_SUCCESS != err) {
+		return err;
 	}
 
 	size_t cluster_size = _lf12_get_cluster_size(f12_meta);
 	uint16_t cluster_count = (table_size + cluster_size - 1) / cluster_size;
 
-	entry->children = children;
-	entry->child_count = 224;
+	children = entry->children;
 	entry->FileAttributes = LF12_ATTR_SUBDIRECTORY;
+	entry->dirty = 1;
+	if (NULL != entry->parent) {
+		entry->parent->dirty = 1;
+	}
 	entry->FirstCluster = _lf12_create_cluster_chain(f12_meta,
 							 cluster_count);
 	if (0 == entry->FirstCluster) {
@@ -998,6 +1523,7 @@ enum lf12_error lf12_create_directory_table(struct lf12_metadata *f12_meta,
 	memset(children[0].ShortFileExtension, 32, 3);
 	children[0].parent = entry;
 	children[0].FirstCluster = 0;
+	children[0].name_index = NULL;
 
 	// Create second dot dir
 	memcpy(&children[1], entry->parent,
@@ -1006,6 +1532,7 @@ enum lf12_error lf12_create_directory_table(struct lf12_metadata *f12_meta,
 	memset(children[1].ShortFileExtension, 32, 3);
 	children[1].parent = entry;
 	children[1].FirstCluster = 0;
+	children[1].name_index = NULL;
 
 	return F12_SUCCESS;
 }
@@ -1050,25 +1577,15 @@ enum lf12_error lf12_create_entry_from_path(struct lf12_metadata *f12_meta,
 	}
 
 	// Check if the file exists
-	for (int i = 0; i < parent_entry->child_count; i++) {
-		if (0 == memcmp(parent_entry->children[i].ShortFileName,
-				last_element->short_file_name, 8) &&
-		    0 == memcmp(parent_entry->children[i].ShortFileExtension,
-				last_element->short_file_extension, 3)) {
-			*entry = &parent_entry->children[i];
-			break;
-		}
-	}
+	*entry = _lf12_find_child(parent_entry, last_element->short_file_name,
+				  last_element->short_file_extension);
+	if (NULL != *entry) {
+		parent_entry->dirty = 1;
 
-	if (NULL == *entry) {
-		for (int i = 0; i < parent_entry->child_count; i++) {
-			if (parent_entry->children[i].ShortFileName[0] == 0) {
-				*entry = &parent_entry->children[i];
-				break;
-			}
-		}
+		return F12_SUCCESS;
 	}
 
+	*entry = _lf12_find_free_child(parent_entry);
 	if (NULL == *entry) {
 		return F12_DIR_FULL;
 	}
@@ -1076,44 +1593,68 @@ enum lf12_error lf12_create_entry_from_path(struct lf12_metadata *f12_meta,
 	memcpy((*entry)->ShortFileName, last_element->short_file_name, 8);
 	memcpy((*entry)->ShortFileExtension, last_element->short_file_extension,
 	       3);
+	(*entry)->parent = parent_entry;
+	_lf12_index_child(parent_entry, *entry);
+	parent_entry->dirty = 1;
 
 	return F12_SUCCESS;
 }
 
-enum lf12_error lf12_create_image(FILE * fp, struct lf12_metadata *f12_meta)
+enum lf12_error lf12_create_image(struct lf12_device *device,
+				  struct lf12_metadata *f12_meta,
+				  enum lf12_create_mode mode)
 {
+	enum lf12_error err;
 	struct bios_parameter_block *bpb = f12_meta->bpb;
-	void *sector = calloc(bpb->SectorSize, 1);
+	void *sector;
+
+	if (F12_CREATE_ZEROED != mode) {
+		// Truncating the device first discards all previous contents
+		err = lf12_device_resize(device, 0, 0);
+		if (F12_SUCCESS == err) {
+			err = lf12_device_resize(device,
+						 (off_t) bpb->LargeSectors *
+						 bpb->SectorSize,
+						 F12_CREATE_PREALLOCATED ==
+						 mode);
+		}
+		if (F12_SUCCESS == err) {
+			return lf12_write_metadata(device, f12_meta);
+		}
+		if (F12_UNSUPPORTED != err) {
+			return err;
+		}
+	}
+
+	sector = calloc(bpb->SectorSize, 1);
 	if (NULL == sector) {
 		return F12_ALLOCATION_ERROR;
 	}
 
 	for (int i = 0; i < bpb->LargeSectors; i++) {
-		fwrite(sector, 1, bpb->SectorSize, fp);
+		err = lf12_device_write(device, sector, bpb->SectorSize,
+					(off_t) i * bpb->SectorSize);
+		if (F12_SUCCESS != err) {
+			free(sector);
+
+			return err;
+		}
 	}
 	free(sector);
 
-	lf12_write_metadata(fp, f12_meta);
-
-	return F12_SUCCESS;
+	return lf12_write_metadata(device, f12_meta);
 }
 
-enum lf12_error lf12_install_bootloader(FILE * fp,
+enum lf12_error lf12_install_bootloader(struct lf12_device *device,
 					struct lf12_metadata *f12_meta,
 					char *bootloader)
 {
-	if (-1 == fseek(fp, 0, SEEK_SET)) {
-		lf12_save_errno();
-
-		return F12_IO_ERROR;
-	}
-	if (512 != fwrite(bootloader, 1, 512, fp)) {
-		lf12_save_errno();
+	enum lf12_error err;
 
-		return F12_IO_ERROR;
+	err = lf12_device_write(device, bootloader, 512, 0);
+	if (F12_SUCCESS != err) {
+		return err;
 	}
 
-	write_bpb(fp, f12_meta);
-
-	return F12_SUCCESS;
+	return write_bpb(device, f12_meta);
 }
@@ -5,6 +5,9 @@
 
 #include "libfat12.h"
 
+// Size of the buffer used to stream files between the host and the image
+#define LF12_STREAM_BUFFER_SIZE 65536
+
 /**
  * Get the value for a position in the file allocation table.
  *
@@ -12,7 +15,18 @@
  * @param n the number of the entry to readout
  * @return the value of the entry
  */
-uint16_t _lf12_read_fat_entry(char *fat, int n);
+uint16_t _lf12_read_fat_entry(const char *fat, int n);
+
+/**
+ * Set an entry of the file allocation table in the metadata and mark the
+ * sectors holding the entry as modified.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param cluster the number of the entry to set
+ * @param value the new value of the entry
+ */
+void _lf12_set_fat_entry(struct lf12_metadata *f12_meta, uint16_t cluster,
+			 uint16_t value);
 
 /**
  * Get the position of a cluster on a fat12 partition.
@@ -33,6 +47,18 @@ int _lf12_cluster_offset(uint16_t cluster, struct lf12_metadata *f12_meta);
 uint16_t _lf12_get_cluster_chain_length(uint16_t start_cluster,
 					struct lf12_metadata *f12_meta);
 
+/**
+ * Get the number of physically consecutive clusters at the start of a cluster
+ * chain.
+ *
+ * @param cluster a pointer to the number of the first cluster. After the call
+ * it holds the number of the cluster following the consecutive clusters or the
+ * end of chain marker.
+ * @param f12_meta a pointer to the metadata of the partition
+ * @return the number of consecutive clusters
+ */
+uint16_t _lf12_get_extent(uint16_t *cluster, struct lf12_metadata *f12_meta);
+
 /**
  * Get the cluster size of the image
  *
@@ -57,7 +83,29 @@ size_t _lf12_get_cluster_chain_size(uint16_t start_cluster,
  * @param data a pointer to the raw data
  * @param entry a pointer to the lf12_directory_entry structure to populate
  */
-void _lf12_read_dir_entry(char *data, struct lf12_directory_entry *entry);
+void _lf12_read_dir_entry(const char *data,
+			  struct lf12_directory_entry *entry);
+
+/**
+ * Write the raw entry for the disk from a lf12_directory_entry structure.
+ *
+ * @param data a pointer to the 32 bytes for the raw entry
+ * @param entry a pointer to the lf12_directory_entry structure to write
+ */
+void _lf12_write_dir_entry(char *data,
+			   const struct lf12_directory_entry *entry);
+
+/**
+ * Point the children of a dot directory entry to the directory table it
+ * refers to. The "." entry gets the table of its parent and the ".." entry the
+ * table of its grandparent, unless that is the root directory.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @param dir_entry a pointer to the entry with a loaded parent
+ * @return non zero if the entry is a dot directory or zero otherwise
+ */
+int _lf12_link_dot_dir(struct lf12_metadata *f12_meta,
+		       struct lf12_directory_entry *dir_entry);
 
 /**
  * Create a new cluster chain in the file allocation table of the metadata.
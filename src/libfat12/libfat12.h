@@ -4,6 +4,8 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 enum lf12_error {
 	F12_SUCCESS = 0,
@@ -18,6 +20,28 @@ enum lf12_error {
 	F12_DIR_NOT_EMPTY,
 	F12_UNKNOWN_ERROR,
 	F12_IS_DIR,
+	F12_UNSUPPORTED,
+	F12_STALE_INDEX,
+	F12_INVALID_CHAIN,
+	F12_PATH_TOO_LONG,
+};
+
+enum lf12_create_mode {
+	// Write zeros to every sector of the image
+	F12_CREATE_ZEROED,
+	// Only set the size of the image and write the metadata
+	F12_CREATE_SPARSE,
+	// Reserve the space for the image and write the metadata
+	F12_CREATE_PREALLOCATED,
+};
+
+enum lf12_allocation_policy {
+	// Use the free clusters with the lowest numbers
+	F12_ALLOC_FIRST_FIT,
+	// Continue the search behind the cluster allocated last
+	F12_ALLOC_NEXT_FIT,
+	// Use the smallest run of free clusters, that holds the whole chain
+	F12_ALLOC_BEST_FIT,
 };
 
 enum lf12_path_relations {
@@ -48,6 +72,14 @@ enum lf12_entry_attributes {
 	LF12_ATTR_RESERVED = 0x80,
 };
 
+/**
+ * Special values of entries in the file allocation table
+ */
+enum lf12_cluster_values {
+	LF12_CLUSTER_FREE = 0x000,
+	LF12_CLUSTER_BAD = 0xff7,
+};
+
 struct bios_parameter_block {
 	// Label of the software that created the image, 8 bytes plus the termination
 	// character \0
@@ -90,6 +122,11 @@ struct bios_parameter_block {
 	char FileSystem[9];
 };
 
+struct lf12_arena;
+struct lf12_dir_table;
+struct lf12_free_space;
+struct lf12_name_index;
+
 struct lf12_directory_entry {
 	char ShortFileName[8];
 	char ShortFileExtension[3];
@@ -107,6 +144,10 @@ struct lf12_directory_entry {
 	struct lf12_directory_entry *children;
 	struct lf12_directory_entry *parent;
 	int child_count;
+	// Non zero if the directory table was modified since it was written
+	int dirty;
+	// Hash index of the names of the children, built on the first lookup
+	struct lf12_name_index *name_index;
 };
 
 struct lf12_metadata {
@@ -117,6 +158,61 @@ struct lf12_metadata {
 	struct lf12_directory_entry *root_dir;
 	uint16_t *fat_entries;
 	uint16_t entry_count;
+	// Non zero if the bios parameter block was modified
+	int bpb_dirty;
+	// One flag for each sector of the file allocation table, non zero if
+	// the sector was modified since it was written
+	uint8_t *dirty_fat_sectors;
+	// How new clusters are chosen
+	enum lf12_allocation_policy allocation_policy;
+	// Index of the free clusters, built on the first allocation
+	struct lf12_free_space *free_space;
+	// Memory of the directory tree, released together with the metadata
+	struct lf12_arena *arena;
+};
+
+struct lf12_cluster_stats {
+	// Number of clusters in the data area of the partition
+	unsigned int cluster_count;
+	unsigned int free_clusters;
+	unsigned int used_clusters;
+	// Number of clusters marked as bad
+	unsigned int bad_clusters;
+	// Number of cluster chains, one for every file or directory with data
+	unsigned int chain_count;
+	// Number of chains, that consist of more than one extent
+	unsigned int fragmented_chains;
+	// Number of runs of consecutive clusters in all chains
+	unsigned int extent_count;
+	// Number of runs of consecutive free clusters
+	unsigned int free_extent_count;
+	// Number of clusters in the longest run of consecutive free clusters
+	unsigned int largest_free_extent;
+};
+
+struct lf12_defrag_stats {
+	// Number of cluster chains of files and directories
+	unsigned int chain_count;
+	// Number of runs of consecutive clusters in all chains before and after
+	// the defragmentation
+	unsigned int extents_before;
+	unsigned int extents_after;
+	// Number of clusters, that get a new position
+	unsigned int moved_clusters;
+};
+
+/**
+ * Identifies the state of an image, that an index was created from.
+ */
+struct lf12_index_key {
+	// Device and inode number of the image file
+	uint64_t device;
+	uint64_t inode;
+	// Size of the image in bytes
+	uint64_t size;
+	// Time of the last modification of the image
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
 };
 
 struct lf12_path {
@@ -127,6 +223,403 @@ struct lf12_path {
 	struct lf12_path *descendant;
 };
 
+/**
+ * A filepath packed into a single block of memory.
+ *
+ * Every part of the path is stored with the 8 characters of the short file
+ * name followed by the 3 characters of the extension, like in a directory
+ * entry.
+ */
+struct lf12_compact_path {
+	// Names of the parts from the root directory to the file
+	char (*names)[11];
+	// Number of names, that fit into the memory of names
+	int capacity;
+	int part_count;
+};
+
+/**
+ * A storage backend for a fat12 image.
+ *
+ * All accesses of libfat12 to an image go through the callbacks of this
+ * structure. Callbacks that are not supported by a backend are set to NULL.
+ */
+struct lf12_device {
+	// Private data of the backend
+	void *data;
+	// Read count bytes at offset into buf
+	enum lf12_error (*read_at)(struct lf12_device *device, void *buf,
+				   size_t count, off_t offset);
+	// Write count bytes from buf at offset
+	enum lf12_error (*write_at)(struct lf12_device *device,
+				    const void *buf, size_t count,
+				    off_t offset);
+	// Write the iovcnt buffers described by iov in order starting at offset
+	enum lf12_error (*writev_at)(struct lf12_device *device,
+				     const struct iovec *iov, int iovcnt,
+				     off_t offset);
+	// Write all data buffered by the backend to the underlying storage
+	enum lf12_error (*flush)(struct lf12_device *device);
+	// Forget all data buffered by the backend, that was not written to the
+	// underlying storage yet
+	enum lf12_error (*drop)(struct lf12_device *device);
+	// Get the size of the device in bytes
+	enum lf12_error (*size)(struct lf12_device *device, off_t *size);
+	// Get a pointer to count bytes at offset in the memory or NULL if the
+	// range can not be mapped
+	const void *(*map)(struct lf12_device *device, size_t count,
+			   off_t offset);
+	// Copy count bytes at offset to the current position of the file
+	// descriptor fd inside the kernel
+	enum lf12_error (*copy_to_fd)(struct lf12_device *device, int fd,
+				      size_t count, off_t offset);
+	// Copy count bytes from the current position of the file descriptor fd
+	// to offset inside the kernel
+	enum lf12_error (*copy_from_fd)(struct lf12_device *device, int fd,
+					size_t count, off_t offset);
+	// Set the size of the device to size bytes. If allocate is non zero,
+	// the storage for the whole device is reserved
+	enum lf12_error (*resize)(struct lf12_device *device, off_t size,
+				  int allocate);
+	// Let count bytes at offset read as zeros and release their storage
+	enum lf12_error (*discard)(struct lf12_device *device, size_t count,
+				   off_t offset);
+	// Release the private data of the backend
+	void (*close)(struct lf12_device *device);
+};
+
+// cache.c
+/**
+ * Create a device, that caches the blocks of another device in the memory.
+ *
+ * Reads are served from the cache where possible. Writes are collected in
+ * the cache and written back when a block is evicted or the device is
+ * flushed. On a flush all modified blocks are sorted and consecutive blocks
+ * are written together. Modified blocks, that were not written back yet, are
+ * forgotten by lf12_device_drop.
+ *
+ * @param backing a pointer to the device to cache. It is closed together with
+ * the cached device.
+ * @param block_size the size of a cached block in bytes
+ * @param block_count the maximum number of blocks in the cache
+ * @param device a pointer to the pointer to the newly created device
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_open_cached_device(struct lf12_device *backing,
+					size_t block_size, size_t block_count,
+					struct lf12_device **device);
+
+// defrag.c
+/**
+ * Move the cluster chains of all files and directories of a partition into
+ * runs of consecutive clusters at the start of the data area. The table of
+ * every directory is placed directly before the files in it. Used clusters,
+ * that do not belong to any file or directory, stay where they are.
+ *
+ * The data of the moved clusters is copied on the device, but the file
+ * allocation table and the directory tables are only updated in the metadata
+ * and must be written with lf12_write_metadata afterwards.
+ *
+ * @param device a pointer to the device with the partition
+ * @param f12_meta a pointer to the metadata of the partition. Directory tables,
+ * that are not loaded yet, are loaded.
+ * @param dry_run if non zero, only the statistics are collected and nothing is
+ * moved
+ * @param stats a pointer to the structure, that is filled with the statistics
+ * @return F12_SUCCESS, F12_INVALID_CHAIN if a cluster chain is damaged or any
+ * other error that occurred
+ */
+enum lf12_error lf12_defragment(struct lf12_device *device,
+				struct lf12_metadata *f12_meta, int dry_run,
+				struct lf12_defrag_stats *stats);
+
+// device.c
+/**
+ * Create a device that accesses a file through pread and pwrite.
+ *
+ * @param fd the file descriptor of the image. It is closed together with the
+ * device.
+ * @param device a pointer to the pointer to the newly created device
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_open_fd_device(int fd, struct lf12_device **device);
+
+/**
+ * Create a device that holds an image in a buffer in the memory.
+ *
+ * @param buffer a pointer to the buffer with the image. The buffer is not
+ * freed together with the device.
+ * @param size the size of the buffer in bytes
+ * @param device a pointer to the pointer to the newly created device
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_open_memory_device(void *buffer, size_t size,
+					struct lf12_device **device);
+
+/**
+ * Create a device that maps a whole file into the memory.
+ *
+ * @param fd the file descriptor of the image. It is closed together with the
+ * device.
+ * @param writable if non zero, the file is mapped for writing, else the device
+ * is read only
+ * @param device a pointer to the pointer to the newly created device
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_open_mmap_device(int fd, int writable,
+				      struct lf12_device **device);
+
+/**
+ * Read data from a device.
+ *
+ * @param device a pointer to the device
+ * @param buf a pointer to the buffer to read into
+ * @param count the number of bytes to read
+ * @param offset the offset on the device to start reading from
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_device_read(struct lf12_device *device, void *buf,
+				 size_t count, off_t offset);
+
+/**
+ * Write data to a device.
+ *
+ * @param device a pointer to the device
+ * @param buf a pointer to the data to write
+ * @param count the number of bytes to write
+ * @param offset the offset on the device to start writing at
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_device_write(struct lf12_device *device, const void *buf,
+				  size_t count, off_t offset);
+
+/**
+ * Write multiple buffers to consecutive locations on a device.
+ *
+ * Devices that can not write vectors natively get one write per buffer.
+ *
+ * @param device a pointer to the device
+ * @param iov a pointer to the array with the buffers to write
+ * @param iovcnt the number of buffers in the array
+ * @param offset the offset on the device to start writing at
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_device_writev(struct lf12_device *device,
+				   const struct iovec *iov, int iovcnt,
+				   off_t offset);
+
+/**
+ * Write all data buffered by a device to the underlying storage.
+ *
+ * @param device a pointer to the device
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_device_flush(struct lf12_device *device);
+
+/**
+ * Forget all data buffered by a device, that was not written to the
+ * underlying storage yet. Data, that was written back already, stays on the
+ * storage.
+ *
+ * This is used to abandon the changes of a failed operation, so that closing
+ * the device does not write them to the image.
+ *
+ * @param device a pointer to the device
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_device_drop(struct lf12_device *device);
+
+/**
+ * Get the size of a device.
+ *
+ * @param device a pointer to the device
+ * @param size a pointer to the variable where the size in bytes gets written
+ * into
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_device_size(struct lf12_device *device, off_t *size);
+
+/**
+ * Change the size of a device. New space of the device reads as zeros.
+ *
+ * @param device a pointer to the device
+ * @param size the new size of the device in bytes
+ * @param allocate if non zero, the storage for the whole device is reserved
+ * instead of leaving the new space sparse
+ * @return F12_SUCCESS, F12_UNSUPPORTED if the size of the device can not be
+ * changed or any other error that occurred
+ */
+enum lf12_error lf12_device_resize(struct lf12_device *device, off_t size,
+				   int allocate);
+
+/**
+ * Discard a range of a device. Afterwards the range reads as zeros and the
+ * storage of the range is released, where the device supports it.
+ *
+ * @param device a pointer to the device
+ * @param count the number of bytes to discard
+ * @param offset the offset of the range on the device
+ * @return F12_SUCCESS, F12_UNSUPPORTED if the device can not discard the range
+ * or any other error that occurred
+ */
+enum lf12_error lf12_device_discard(struct lf12_device *device, size_t count,
+				    off_t offset);
+
+/**
+ * Get direct read access to a range of a device without copying it.
+ *
+ * @param device a pointer to the device
+ * @param count the number of bytes to access
+ * @param offset the offset of the range on the device
+ * @return a pointer to the range in the memory, that is valid until the device
+ * is closed, or NULL if the device can not map the range
+ */
+const void *lf12_device_map(struct lf12_device *device, size_t count,
+			    off_t offset);
+
+/**
+ * Copy a range of a device to a file without passing the data through the
+ * user space. The data is written at the current position of the file, which
+ * is advanced by the number of copied bytes.
+ *
+ * @param device a pointer to the device
+ * @param fd the file descriptor of the destination file
+ * @param count the number of bytes to copy
+ * @param offset the offset of the range on the device
+ * @return F12_SUCCESS, F12_UNSUPPORTED if neither the device nor the kernel
+ * can copy between the files without a buffer, or any other error that
+ * occurred. No data was copied if F12_UNSUPPORTED is returned.
+ */
+enum lf12_error lf12_device_copy_to_fd(struct lf12_device *device, int fd,
+				       size_t count, off_t offset);
+
+/**
+ * Copy data from a file to a range of a device without passing the data
+ * through the user space. The data is read from the current position of the
+ * file, which is advanced by the number of copied bytes.
+ *
+ * @param device a pointer to the device
+ * @param fd the file descriptor of the source file
+ * @param count the number of bytes to copy
+ * @param offset the offset of the range on the device
+ * @return F12_SUCCESS, F12_UNSUPPORTED if neither the device nor the kernel
+ * can copy between the files without a buffer, or any other error that
+ * occurred. No data was copied if F12_UNSUPPORTED is returned.
+ */
+enum lf12_error lf12_device_copy_from_fd(struct lf12_device *device, int fd,
+					 size_t count, off_t offset);
+
+/**
+ * Flush and close a device and free all its resources.
+ *
+ * @param device a pointer to the device or NULL
+ * @return F12_SUCCESS or any error that occurred while flushing the device
+ */
+enum lf12_error lf12_close_device(struct lf12_device *device);
+
+// dir_table.c
+/**
+ * Open a directory table in the format of the partition. Unlike
+ * lf12_load_directory this decodes nothing and the table is accessed with the
+ * lf12_dir_table_* and lf12_raw_entry_* functions. A table in consecutive
+ * clusters is not copied, if the device can map it.
+ *
+ * @param device a pointer to the device with the partition. It must stay open
+ * until the table is closed.
+ * @param f12_meta a pointer to the metadata of the partition. Only the file
+ * allocation table is used.
+ * @param first_cluster the first cluster of the table or 0 for the root
+ * directory
+ * @param table a pointer to the pointer to the opened table
+ * @return F12_SUCCESS, F12_INVALID_CHAIN if the first cluster is outside the
+ * data area or any other error that occurred
+ */
+enum lf12_error lf12_open_dir_table(struct lf12_device *device,
+				    struct lf12_metadata *f12_meta,
+				    uint16_t first_cluster,
+				    struct lf12_dir_table **table);
+
+/**
+ * Close a directory table opened with lf12_open_dir_table.
+ *
+ * @param table a pointer to the table
+ */
+void lf12_close_dir_table(struct lf12_dir_table *table);
+
+/**
+ * @param table a pointer to the directory table
+ * @return the number of entries the table has room for
+ */
+int lf12_dir_table_size(const struct lf12_dir_table *table);
+
+/**
+ * Get an entry of a directory table.
+ *
+ * @param table a pointer to the directory table
+ * @param n the number of the entry
+ * @return a pointer to the 32 bytes of the entry
+ */
+const char *lf12_dir_table_entry(const struct lf12_dir_table *table, int n);
+
+/**
+ * @param table a pointer to the directory table
+ * @return the number of entries of the table, that are not empty
+ */
+int lf12_dir_table_child_count(const struct lf12_dir_table *table);
+
+/**
+ * @param table a pointer to the directory table
+ * @return the number of the first empty entry of the table or -1 if the
+ * table is full
+ */
+int lf12_dir_table_find_free(const struct lf12_dir_table *table);
+
+/**
+ * @param raw_entry a pointer to the 32 bytes of a directory entry
+ * @return 1 if the entry is empty else 0
+ */
+int lf12_raw_entry_is_empty(const char *raw_entry);
+
+/**
+ * @param raw_entry a pointer to the 32 bytes of a directory entry
+ * @return 1 if the entry is a directory else 0
+ */
+int lf12_raw_entry_is_directory(const char *raw_entry);
+
+/**
+ * @param raw_entry a pointer to the 32 bytes of a directory entry
+ * @return 1 if the entry is one of the dot directories "." or ".." else 0
+ */
+int lf12_raw_entry_is_dot_dir(const char *raw_entry);
+
+/**
+ * @param raw_entry a pointer to the 32 bytes of a directory entry
+ * @return the first cluster of the entry
+ */
+uint16_t lf12_raw_entry_first_cluster(const char *raw_entry);
+
+/**
+ * @param raw_entry a pointer to the 32 bytes of a directory entry
+ * @return the size of the file in bytes
+ */
+uint32_t lf12_raw_entry_file_size(const char *raw_entry);
+
+/**
+ * Count all files and directories on a partition by walking its directory
+ * tables with lf12_open_dir_table. The directory tree of the metadata is
+ * neither needed nor loaded.
+ *
+ * @param device a pointer to the device with the partition
+ * @param f12_meta a pointer to the metadata of the partition. Only the file
+ * allocation table is used.
+ * @param file_count a pointer to the number of files, that is set
+ * @param dir_count a pointer to the number of directories, that is set
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_count_entries(struct lf12_device *device,
+				   struct lf12_metadata *f12_meta,
+				   int *file_count, int *dir_count);
+
 // directory_entry.c
 /**
  * Check whether a lf12_directory_entry structure describes a file or a
@@ -184,6 +677,9 @@ int lf12_get_directory_count(struct lf12_directory_entry *entry);
 /**
  * Frees a lf12_directory_entry structure and all subsequent entries.
  *
+ * This is only meant for trees built on the heap. The tree of the metadata is
+ * released with lf12_free_metadata.
+ *
  * @param entry a pointer to the lf12_directory_entry structure to be freed
  */
 void lf12_free_entry(struct lf12_directory_entry *entry);
@@ -218,30 +714,147 @@ void lf12_save_errno(void);
  */
 char *lf12_strerror(enum lf12_error err);
 
+// index.c
+/**
+ * Write an index of the metadata to a file. The index holds the bios parameter
+ * block, the decoded file allocation table and all loaded directory tables, so
+ * that the metadata can be restored with lf12_read_index without parsing the
+ * image.
+ *
+ * @param fd the file descriptor of the empty file for the index
+ * @param key a pointer to the key of the image, that the metadata belongs to
+ * @param f12_meta a pointer to the completely or lazily loaded metadata
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_write_index(int fd, const struct lf12_index_key *key,
+				 struct lf12_metadata *f12_meta);
+
+/**
+ * Restore the metadata of an image from an index written with
+ * lf12_write_index. Directories, that were not loaded when the index was
+ * written, are still loaded on demand with lf12_load_directory.
+ *
+ * @param fd the file descriptor of the file with the index
+ * @param key a pointer to the key of the current state of the image
+ * @param f12_meta a pointer to a pointer to the lf12_metadata structure to
+ * populate.
+ * @return F12_SUCCESS, F12_STALE_INDEX if the index is invalid or was written
+ * for another state of the image or any other error that occurred
+ */
+enum lf12_error lf12_read_index(int fd, const struct lf12_index_key *key,
+				struct lf12_metadata **f12_meta);
+
 // io.c
 /**
  * Populates a lf12_metadata structure with data from a fat12 image.
  *
- * @param fp the file pointer of the image
+ * @param device a pointer to the device with the image
+ * @param f12_meta a pointer to a pointer to the lf12_metadata structure to
+ * populate.
+ * @return F12_SUCCESS or any other error that occurred
+ */
+enum lf12_error lf12_read_metadata(struct lf12_device *device,
+				   struct lf12_metadata **f12_meta);
+
+/**
+ * Populates a lf12_metadata structure with data from a fat12 image, but loads
+ * only the root directory table. The tables of the subdirectories are loaded
+ * on demand with lf12_load_directory or lf12_load_entry_from_path.
+ *
+ * The children of a subdirectory, that is not loaded yet, are NULL. Such
+ * metadata must not be modified or written back to the image.
+ *
+ * @param device a pointer to the device with the image
+ * @param f12_meta a pointer to a pointer to the lf12_metadata structure to
+ * populate.
+ * @return F12_SUCCESS or any other error that occurred
+ */
+enum lf12_error lf12_read_metadata_lazy(struct lf12_device *device,
+					struct lf12_metadata **f12_meta);
+
+/**
+ * Populates a lf12_metadata structure with the bios parameter block and the
+ * file allocation table of a fat12 image. No directory table is read, so the
+ * root directory appears empty. Such metadata must not be modified or written
+ * back to the image.
+ *
+ * @param device a pointer to the device with the image
  * @param f12_meta a pointer to a pointer to the lf12_metadata structure to
  * populate.
  * @return F12_SUCCESS or any other error that occurred
  */
-enum lf12_error lf12_read_metadata(FILE * fp, struct lf12_metadata **f12_meta);
+enum lf12_error lf12_read_fat_metadata(struct lf12_device *device,
+				       struct lf12_metadata **f12_meta);
+
+/**
+ * Load the directory table of a directory, if it was not loaded yet.
+ *
+ * @param device a pointer to the device with the image
+ * @param f12_meta a pointer to the metadata of the image
+ * @param dir_entry a pointer to the directory entry of the directory. Nothing
+ * is loaded for files.
+ * @param recursive if non zero, the tables of all subdirectories are loaded
+ * as well
+ * @return F12_SUCCESS or any other error that occurred
+ */
+enum lf12_error lf12_load_directory(struct lf12_device *device,
+				    struct lf12_metadata *f12_meta,
+				    struct lf12_directory_entry *dir_entry,
+				    int recursive);
+
+/**
+ * Find a file or directory on the image from a path and load the directory
+ * tables along the path on demand.
+ *
+ * @param device a pointer to the device with the image
+ * @param f12_meta a pointer to the metadata of the image
+ * @param path a pointer to a lf12_path structure relative to the root
+ * directory or NULL for the root directory itself
+ * @param entry a pointer to the pointer, that is set to the entry of the file
+ * or directory
+ * @return F12_SUCCESS, F12_FILE_NOT_FOUND if the path matches no file or any
+ * other error that occurred
+ */
+enum lf12_error lf12_load_entry_from_path(struct lf12_device *device,
+					  struct lf12_metadata *f12_meta,
+					  struct lf12_path *path,
+					  struct lf12_directory_entry **entry);
+
+/**
+ * Get the entry of a file or directory described by a compact path and load
+ * the directory tables on the way.
+ *
+ * @param device a pointer to the device with the image
+ * @param f12_meta a pointer to the metadata of the image
+ * @param path a pointer to a lf12_compact_path structure relative to the root
+ * directory, a path without parts describes the root directory itself
+ * @param entry a pointer to the pointer, that is set to the entry of the file
+ * or directory
+ * @return F12_SUCCESS, F12_FILE_NOT_FOUND if the path matches no file or any
+ * other error that occurred
+ */
+enum lf12_error lf12_load_entry_from_compact_path(struct lf12_device *device,
+						  struct lf12_metadata
+						  *f12_meta,
+						  const struct lf12_compact_path
+						  *path,
+						  struct lf12_directory_entry
+						  **entry);
 
 /**
  * Writes the data from a lf12_metadata structure on a fat12 image.
  *
- * @param fp the file pointer of the image
+ * @param device a pointer to the device with the image
  * @param f12_meta a pointer to the metadata
  * @return F12_SUCCESS or any other error that occurred
  */
-enum lf12_error lf12_write_metadata(FILE * fp, struct lf12_metadata *f12_meta);
+enum lf12_error lf12_write_metadata(struct lf12_device *device,
+				    struct lf12_metadata *f12_meta);
 
 /**
  * Deletes a file or directory from a fat12 image.
  *
- * @param fp the file pointer of the image
+ * @param device a pointer to the device with the image
  * @param f12_meta a pointer to the metadata of the image
  * @param entry a pointer to a lf12_directory_entry structure, that describes the
  * file or directory that should be removed; Note that the entry will also be
@@ -249,22 +862,39 @@ enum lf12_error lf12_write_metadata(FILE * fp, struct lf12_metadata *f12_meta);
  * @param soft_delete if non zero the entry is not erased, but marked as deleted
  * @return F12_SUCCESS or any other error that occurred
  */
-enum lf12_error lf12_del_entry(FILE * fp,
+enum lf12_error lf12_del_entry(struct lf12_device *device,
 			       struct lf12_metadata *f12_meta,
 			       struct lf12_directory_entry *entry,
 			       int hard_delete);
 
+/**
+ * Removes a file or an empty directory from the metadata of a fat12 image.
+ *
+ * The data of the entry is erased on the image and its clusters are freed, but
+ * the metadata is not written. This allows to delete many entries and write
+ * the metadata once afterwards.
+ *
+ * @param device a pointer to the device with the image
+ * @param f12_meta a pointer to the metadata of the image
+ * @param entry a pointer to the lf12_directory_entry structure of the file or
+ * directory to remove
+ * @return F12_SUCCESS or any other error that occurred
+ */
+enum lf12_error lf12_unlink_entry(struct lf12_device *device,
+				  struct lf12_metadata *f12_meta,
+				  struct lf12_directory_entry *entry);
+
 /**
  * Dump a file from the fat 12 image onto the host file system.
  *
- * @param fp the file pointer of the image
+ * @param device a pointer to the device with the image
  * @param f12_meta a pointer to the metadata of the image
  * @param entry a pointer to the lf12_directory_entry structure of the file that
  * should be dumped
  * @param dest_fp the file pointer of the destination file.
  * @return F12_SUCCESS or any other error that occurred
  */
-enum lf12_error lf12_dump_file(FILE * fp,
+enum lf12_error lf12_dump_file(struct lf12_device *device,
 			       struct lf12_metadata *f12_meta,
 			       struct lf12_directory_entry *entry,
 			       FILE * dest_fp);
@@ -272,14 +902,14 @@ enum lf12_error lf12_dump_file(FILE * fp,
 /**
  * Write a file to the given path on an image
  *
- * @param fp the file pointer of the image
+ * @param device a pointer to the device with the image
  * @param f12_meta a pointer to the metadata of the image
  * @param path the path for the newly created file
  * @param source_fp pointer to the file to write on the image
  * @param created the creation time of the file in microseconds since the epoch
  * @return F12_SUCCESS or any other error that occurred
  */
-enum lf12_error lf12_create_file(FILE * fp,
+enum lf12_error lf12_create_file(struct lf12_device *device,
 				 struct lf12_metadata *f12_meta,
 				 struct lf12_path *path, FILE * source_fp,
 				 suseconds_t created);
@@ -311,21 +941,28 @@ enum lf12_error lf12_create_entry_from_path(struct lf12_metadata *f12_meta,
 /**
  * Create a new (empty) fat12 image
  *
- * @param fp a pointer to the file for the image to create
+ * In the sparse and preallocated modes, the previous contents of the device
+ * are discarded by resizing it, so that only the metadata needs to be
+ * written. Devices that can not be resized are filled with zeros instead.
+ *
+ * @param device a pointer to the device for the image to create
  * @param f12_meta a pointer to the metadata of the image
+ * @param mode the way the sectors of the image are initialized
  * @return F12_SUCCESS or any error that occured
  */
-enum lf12_error lf12_create_image(FILE * fp, struct lf12_metadata *f12_meta);
+enum lf12_error lf12_create_image(struct lf12_device *device,
+				  struct lf12_metadata *f12_meta,
+				  enum lf12_create_mode mode);
 
 /**
  * Install a bootloader into a fat12 image
  *
- * @param fp a pointer to the file to install a bootloader into
+ * @param device a pointer to the device to install a bootloader into
  * @param f12_meta a pointer to the metadata of the fat12 image
  * @param bootloader a pointer to the binary bootloader data (should always be
  *                   512 bytes)
  */
-enum lf12_error lf12_install_bootloader(FILE * fp,
+enum lf12_error lf12_install_bootloader(struct lf12_device *device,
 					struct lf12_metadata *f12_meta,
 					char *bootloader);
 
@@ -346,6 +983,29 @@ size_t lf12_get_partition_size(struct lf12_metadata *f12_meta);
  */
 size_t lf12_get_used_bytes(struct lf12_metadata *f12_meta);
 
+/**
+ * Collect statistics about the clusters of a fat12 image from its file
+ * allocation table alone.
+ *
+ * @param f12_meta a pointer to the metadata of the image. The directory
+ * tables need not be loaded.
+ * @param stats a pointer to the structure, that is filled with the statistics
+ * @return F12_SUCCESS or any error that occurred
+ */
+enum lf12_error lf12_get_cluster_stats(struct lf12_metadata *f12_meta,
+				       struct lf12_cluster_stats *stats);
+
+/**
+ * Get the number of runs of consecutive clusters, that the cluster chain of a
+ * file or directory consists of.
+ *
+ * @param f12_meta a pointer to the metadata of the image
+ * @param entry a pointer to the directory entry
+ * @return the number of extents of the entry or 0 if it has no clusters
+ */
+unsigned int lf12_get_extent_count(struct lf12_metadata *f12_meta,
+				   struct lf12_directory_entry *entry);
+
 /**
  * Creates new metadata 
  *
@@ -356,6 +1016,8 @@ size_t lf12_get_used_bytes(struct lf12_metadata *f12_meta);
 enum lf12_error lf12_create_metadata(struct lf12_metadata **f12_meta);
 /**
  * Initializes the empty root directory metadata
+ *
+ * All parts of the new metadata are marked as modified.
  * 
  * @param f12_meta a pointer to the metadata of the partition
  */
@@ -467,10 +1129,47 @@ enum lf12_error lf12_parse_path(const char *input, struct lf12_path **path);
 /**
  * Frees a lf12_path structure
  *
- * @param path a pointer to the lf12_path structure
+ * @param path a pointer to the first lf12_path structure of a path created by
+ * lf12_parse_path
  */
 void lf12_free_path(struct lf12_path *path);
 
+/**
+ * Parses a filepath into a lf12_compact_path structure with names provided by
+ * the caller, for example on the stack. No memory is allocated.
+ *
+ * The part_count of the path is set to the number of parts of the filepath,
+ * even if they do not fit into the names.
+ *
+ * @param input a pointer to a string with the filepath to parse
+ * @param path a pointer to a lf12_compact_path structure with the names and
+ * their capacity set
+ * @return F12_SUCCESS, F12_EMPTY_PATH if input is empty or "/",
+ * F12_PATH_TOO_LONG if the filepath has more parts than the capacity
+ */
+enum lf12_error lf12_parse_compact_path(const char *input,
+					struct lf12_compact_path *path);
+
+/**
+ * Creates a lf12_compact_path structure with its names in a single
+ * allocation.
+ *
+ * @param input a pointer to a string with the filepath to parse
+ * @param path a pointer to a pointer to a lf12_compact_path structure with the
+ * parsed path, that must be freed with lf12_free_compact_path.
+ * @return F12_SUCCESS, F12_EMPTY_PATH if input is empty or "/" or any other
+ * error that occurred
+ */
+enum lf12_error lf12_create_compact_path(const char *input,
+					 struct lf12_compact_path **path);
+
+/**
+ * Frees a lf12_compact_path structure created by lf12_create_compact_path.
+ *
+ * @param path a pointer to the lf12_compact_path structure
+ */
+void lf12_free_compact_path(struct lf12_compact_path *path);
+
 /**
  * Determines if one of two given lf12_path structure describes a parent
  * directory of the file or directory described by the other path.
@@ -3,7 +3,11 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include "allocation_p.h"
+#include "arena_p.h"
+#include "directory_entry_p.h"
 #include "libfat12.h"
+#include "metadata_p.h"
 
 enum lf12_error lf12_create_root_dir_meta(struct lf12_metadata *f12_meta)
 {
@@ -11,43 +15,43 @@ enum lf12_error lf12_create_root_dir_meta(struct lf12_metadata *f12_meta)
 	uint16_t cluster_count =
 		bpb->LogicalSectors / bpb->SectorsPerCluster + 2;
 	struct lf12_directory_entry *root_dir = NULL;
-	struct lf12_directory_entry *root_entries = NULL;
+	enum lf12_error err;
 
-	root_dir = calloc(1, sizeof(struct lf12_directory_entry));
+	root_dir = _lf12_arena_alloc(f12_meta->arena,
+				     sizeof(struct lf12_directory_entry));
 	if (NULL == root_dir) {
 		return F12_ALLOCATION_ERROR;
 	}
 
-	root_entries =
-		calloc(bpb->RootDirEntries,
-		       sizeof(struct lf12_directory_entry));
-	if (NULL == root_entries) {
-		free(root_dir);
-
-		return F12_ALLOCATION_ERROR;
-	}
-
 	memset(root_dir->ShortFileName, ' ', 8);
 	memset(root_dir->ShortFileExtension, ' ', 3);
 	root_dir->parent = NULL;
 	root_dir->FileAttributes |= LF12_ATTR_SUBDIRECTORY;
-	root_dir->children = root_entries;
-	root_dir->child_count = bpb->RootDirEntries;
+	err = _lf12_create_table(f12_meta, root_dir, bpb->RootDirEntries);
+	if (F12_SUCCESS != err) {
+		return err;
+	}
 
 	f12_meta->root_dir = root_dir;
 
-	for (int i = 0; i < bpb->RootDirEntries; i++) {
-		root_entries[i].parent = root_dir;
-	}
-
+	_lf12_drop_free_space(f12_meta);
 	f12_meta->entry_count = cluster_count;
 	f12_meta->fat_entries = calloc(cluster_count, sizeof(uint16_t));
 	if (NULL == f12_meta->fat_entries) {
-		free(root_entries);
-		free(root_dir);
+		return F12_ALLOCATION_ERROR;
+	}
+	f12_meta->dirty_fat_sectors = malloc(bpb->SectorsPerFat);
+	if (NULL == f12_meta->dirty_fat_sectors) {
+		free(f12_meta->fat_entries);
+		f12_meta->fat_entries = NULL;
 
 		return F12_ALLOCATION_ERROR;
 	}
+	// Nothing of the new metadata is on the image yet
+	memset(f12_meta->dirty_fat_sectors, 1, bpb->SectorsPerFat);
+	f12_meta->bpb_dirty = 1;
+	root_dir->dirty = 1;
+
 	f12_meta->fat_id = ((uint16_t) bpb->MediumByte) | 0xf00;
 	f12_meta->fat_entries[0] = f12_meta->fat_id;
 	f12_meta->end_of_chain_marker = 0xfff;
@@ -63,23 +67,144 @@ size_t lf12_get_partition_size(struct lf12_metadata *f12_meta)
 	return bpb->SectorSize * bpb->LogicalSectors;
 }
 
+uint16_t _lf12_clusters_end(struct lf12_metadata *f12_meta)
+{
+	struct bios_parameter_block *bpb = f12_meta->bpb;
+	long data_start = f12_meta->root_dir_offset + bpb->RootDirEntries * 32;
+	long data_size = (long)bpb->SectorSize * bpb->LogicalSectors -
+		data_start;
+	long end = 2;
+
+	if (data_size > 0) {
+		end += data_size / (bpb->SectorSize * bpb->SectorsPerCluster);
+	}
+	if (end > f12_meta->entry_count) {
+		end = f12_meta->entry_count;
+	}
+
+	return end;
+}
+
 size_t lf12_get_used_bytes(struct lf12_metadata *f12_meta)
 {
 	struct bios_parameter_block *bpb = f12_meta->bpb;
-	uint16_t cluster_count = bpb->LogicalSectors / bpb->SectorsPerCluster;
+	uint16_t end = _lf12_clusters_end(f12_meta);
 
 	size_t used_bytes = bpb->SectorSize *
 		(bpb->ReservedForBoot + bpb->NumberOfFats * bpb->SectorsPerFat)
 		+ bpb->RootDirEntries * 32;
 
-	for (int i = 2; i < cluster_count; i++) {
-		if (f12_meta->fat_entries[i])
-			used_bytes++;
+	for (int i = 2; i < end; i++) {
+		if (LF12_CLUSTER_FREE != f12_meta->fat_entries[i] &&
+		    LF12_CLUSTER_BAD != f12_meta->fat_entries[i]) {
+			used_bytes += bpb->SectorSize * bpb->SectorsPerCluster;
+		}
 	}
 
 	return used_bytes;
 }
 
+enum lf12_error lf12_get_cluster_stats(struct lf12_metadata *f12_meta,
+				       struct lf12_cluster_stats *stats)
+{
+	uint16_t *fat_entries = f12_meta->fat_entries;
+	uint16_t end = _lf12_clusters_end(f12_meta);
+	uint16_t entry, current_cluster;
+	unsigned int free_run = 0;
+	int extents;
+	// Non zero for every cluster, that follows another one in a chain
+	uint8_t *referenced = calloc(end, 1);
+
+	if (NULL == referenced) {
+		return F12_ALLOCATION_ERROR;
+	}
+
+	memset(stats, 0, sizeof(struct lf12_cluster_stats));
+	stats->cluster_count = end - 2;
+
+	for (uint16_t i = 2; i < end; i++) {
+		entry = fat_entries[i];
+		if (LF12_CLUSTER_FREE == entry) {
+			stats->free_clusters++;
+			if (0 == free_run++) {
+				stats->free_extent_count++;
+			}
+			if (free_run > stats->largest_free_extent) {
+				stats->largest_free_extent = free_run;
+			}
+			continue;
+		}
+		free_run = 0;
+		if (LF12_CLUSTER_BAD == entry) {
+			stats->bad_clusters++;
+			continue;
+		}
+		stats->used_clusters++;
+		if (entry >= 2 && entry < end) {
+			referenced[entry] = 1;
+		}
+	}
+
+	// Every used cluster, that no other cluster points to, starts a chain
+	for (uint16_t i = 2; i < end; i++) {
+		entry = fat_entries[i];
+		if (LF12_CLUSTER_FREE == entry || LF12_CLUSTER_BAD == entry ||
+		    referenced[i]) {
+			continue;
+		}
+
+		stats->chain_count++;
+		extents = 1;
+		current_cluster = i;
+		// The length of the walk is bounded to survive cyclic chains
+		for (uint16_t j = 2; j < end; j++) {
+			entry = fat_entries[current_cluster];
+			if (entry < 2 || entry >= end) {
+				break;
+			}
+			if (entry != current_cluster + 1) {
+				extents++;
+			}
+			current_cluster = entry;
+		}
+		stats->extent_count += extents;
+		if (extents > 1) {
+			stats->fragmented_chains++;
+		}
+	}
+
+	free(referenced);
+
+	return F12_SUCCESS;
+}
+
+unsigned int lf12_get_extent_count(struct lf12_metadata *f12_meta,
+				   struct lf12_directory_entry *entry)
+{
+	uint16_t *fat_entries = f12_meta->fat_entries;
+	uint16_t end = _lf12_clusters_end(f12_meta);
+	uint16_t current_cluster = entry->FirstCluster, next_cluster;
+	unsigned int extents = 1;
+
+	if (current_cluster < 2 || current_cluster >= end) {
+		return 0;
+	}
+
+	// The length of the walk is bounded to survive cyclic chains
+	for (uint16_t i = 2; i < end; i++) {
+		next_cluster = fat_entries[current_cluster];
+		if (next_cluster < 2 || next_cluster >= end) {
+			break;
+		}
+		if (next_cluster != current_cluster + 1) {
+			extents++;
+		}
+		current_cluster = next_cluster;
+	}
+
+	return extents;
+}
+
 enum lf12_error lf12_generate_volume_id(uint32_t * volume_id)
 {
 	struct timeval now;
@@ -108,10 +233,10 @@ void lf12_free_metadata(struct lf12_metadata *f12_meta)
 {
 	free(f12_meta->bpb);
 	free(f12_meta->fat_entries);
-	if (f12_meta->root_dir) {
-		lf12_free_entry(f12_meta->root_dir);
-	}
-	free(f12_meta->root_dir);
+	free(f12_meta->dirty_fat_sectors);
+	_lf12_drop_free_space(f12_meta);
+	// The directory tree is released with the arena without walking it
+	_lf12_free_arena(f12_meta->arena);
 	free(f12_meta);
 }
 
@@ -123,7 +248,10 @@ enum lf12_error lf12_create_metadata(struct lf12_metadata **f12_meta)
 	}
 
 	(*f12_meta)->bpb = calloc(1, sizeof(struct bios_parameter_block));
-	if (NULL == (*f12_meta)->bpb) {
+	(*f12_meta)->arena = _lf12_create_arena();
+	if (NULL == (*f12_meta)->bpb || NULL == (*f12_meta)->arena) {
+		free((*f12_meta)->bpb);
+		_lf12_free_arena((*f12_meta)->arena);
 		free(*f12_meta);
 		*f12_meta = NULL;
 
@@ -0,0 +1,14 @@
+#ifndef LF12_METADATA_P_H
+#define LF12_METADATA_P_H
+
+#include "libfat12.h"
+
+/**
+ * Get the number of the first cluster behind the data area of a partition.
+ *
+ * @param f12_meta a pointer to the metadata of the partition
+ * @return the number of the first cluster behind the data area
+ */
+uint16_t _lf12_clusters_end(struct lf12_metadata *f12_meta);
+
+#endif
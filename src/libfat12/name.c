@@ -4,12 +4,14 @@
 #include "libfat12.h"
 #include "name_p.h"
 
-static void convert_short_file_name(const char *name, char *converted_name)
+static void convert_short_file_name(const char *name, size_t length,
+				    char *converted_name)
 {
+	const char *end = name + length;
 	char c;
 	int i = 0;
 
-	while ((c = *(name++)) != '\0' && '.' != c && i < 8) {
+	while (name < end && (c = *(name++)) != '\0' && '.' != c && i < 8) {
 		if (' ' == c && 0 == i) {
 			// Omit leading spaces
 			continue;
@@ -19,18 +21,20 @@ static void convert_short_file_name(const char *name, char *converted_name)
 	}
 }
 
-static void convert_short_file_extension(const char *name, char *converted_name)
+static void convert_short_file_extension(const char *name, size_t length,
+					 char *converted_name)
 {
+	const char *end = name + length;
 	char c;
 	int i = 8;
 
-	name = strchr(name, '.');
+	name = memchr(name, '.', length);
 
 	if (NULL == name) {
 		return;
 	}
 
-	while ((c = *(++name)) != '\0' && i < 11) {
+	while (++name < end && (c = *name) != '\0' && i < 11) {
 		if (' ' == c) {
 			// Omit all spaces in the file extension
 			continue;
@@ -131,14 +135,20 @@ char *lf12_convert_name(const char *name)
 		return NULL;
 	}
 
-	memset(converted_name, ' ', 11);
-
-	convert_short_file_name(name, converted_name);
-	convert_short_file_extension(name, converted_name);
+	_lf12_convert_name_part(name, strlen(name), converted_name);
 
 	return converted_name;
 }
 
+void _lf12_convert_name_part(const char *name, size_t length,
+			     char *converted_name)
+{
+	memset(converted_name, ' ', 11);
+
+	convert_short_file_name(name, length, converted_name);
+	convert_short_file_extension(name, length, converted_name);
+}
+
 enum lf12_error lf12_get_entry_path(struct lf12_directory_entry *entry,
 				    char **path)
 {
@@ -41,4 +41,15 @@ size_t _lf12_get_path_length(struct lf12_directory_entry *entry);
  */
 char _lf12_sanitize_file_name_char(char character);
 
+/**
+ * Convert a part of a filepath into the 8 characters of the short file name
+ * and the 3 characters of the extension without allocating memory.
+ *
+ * @param name a pointer to the part of the filepath
+ * @param length the length of the part, that needs not to be null terminated
+ * @param converted_name a pointer to 11 bytes for the converted name
+ */
+void _lf12_convert_name_part(const char *name, size_t length,
+			     char *converted_name);
+
 #endif
@@ -1,82 +1,20 @@
 #include <stdlib.h>
 #include <string.h>
+#include "directory_entry_p.h"
 #include "libfat12.h"
+#include "name_p.h"
+#include "path_p.h"
 
-enum lf12_error _lf12_build_path(char **input_parts,
-				 int part_count, struct lf12_path *path)
-{
-	enum lf12_error err;
-
-	path->ancestor = NULL;
-
-	char *name = lf12_convert_name(input_parts[0]);
-	if (NULL == name) {
-		return F12_ALLOCATION_ERROR;
-	}
-
-	path->name = malloc(12);
-	if (NULL == path->name) {
-		free(name);
-
-		return F12_ALLOCATION_ERROR;
-	}
-	memcpy(path->name, name, 11);
-	path->name[11] = '\0';
-
-	path->short_file_name = malloc(9);
-	if (NULL == path->short_file_name) {
-		free(name);
-		free(path->name);
-
-		return F12_ALLOCATION_ERROR;
-	}
-	memcpy(path->short_file_name, name, 8);
-	path->short_file_name[8] = '\0';
-
-	path->short_file_extension = malloc(4);
-	if (NULL == path->short_file_extension) {
-		free(name);
-		free(path->name);
-		free(path->short_file_name);
-
-		return F12_ALLOCATION_ERROR;
-	}
-	memcpy(path->short_file_extension, name + 8, 3);
-	path->short_file_extension[3] = '\0';
-	free(name);
-
-	if (1 == part_count) {
-		path->descendant = NULL;
-		return F12_SUCCESS;
-	}
-
-	path->descendant = malloc(sizeof(struct lf12_path));
-	if (NULL == path->descendant) {
-		free(path->name);
-		free(path->short_file_name);
-		free(path->short_file_extension);
-
-		return F12_ALLOCATION_ERROR;
-	}
-
-	err = _lf12_build_path(&input_parts[1], part_count - 1,
-			       path->descendant);
-	if (F12_SUCCESS != err) {
-		free(path->name);
-		free(path->short_file_name);
-		free(path->short_file_extension);
-		free(path->descendant);
-
-		return err;
-	}
-	path->descendant->ancestor = path;
-
-	return F12_SUCCESS;
-}
+// Size of the strings of a path part: the name, the short file name and the
+// short file extension, each with a null terminator
+#define PART_STRINGS_SIZE (12 + 9 + 4)
 
-enum lf12_error _lf12_split_input(const char *input,
-				  char ***input_parts, int *part_count)
+enum lf12_error _lf12_convert_path(const char *input, char (*names)[11],
+				   int capacity, int *part_count)
 {
+	const char *end, *separator;
+
+	*part_count = 0;
 	if (input[0] == '/') {
 		/* omit leading slash */
 		input++;
@@ -85,123 +23,138 @@ enum lf12_error _lf12_split_input(const char *input,
 		return F12_EMPTY_PATH;
 	}
 
-	int input_len = strlen(input) + 1;
-	*part_count = 1;
-	char *rawpath = malloc(input_len);
-	if (NULL == rawpath) {
-		return F12_ALLOCATION_ERROR;
-	}
-
-	memcpy(rawpath, input, input_len);
-
-	if (rawpath[input_len - 2] == '/') {
+	end = input + strlen(input);
+	if (end[-1] == '/') {
 		/* omit slash at the end of the input */
-		rawpath[input_len - 2] = '\0';
-		input_len--;
+		end--;
 	}
 
-	/*
-	 * Replace all slashes with string terminators.
-	 * After that rawpath points to all the elements of the path as seperate strings.
-	 */
-	for (int i = 0; i < input_len; i++) {
-		if (rawpath[i] == '/') {
-			(*part_count)++;
-			rawpath[i] = '\0';
+	while (1) {
+		separator = memchr(input, '/', end - input);
+		if (NULL == separator) {
+			separator = end;
 		}
-	}
-
-	*input_parts = malloc(sizeof(char *) * (*part_count));
-	if (NULL == *input_parts) {
-		free(rawpath);
-		return F12_ALLOCATION_ERROR;
-	}
-
-	(*input_parts)[0] = rawpath;
-
-	int part = 0, i = 0;
-	while (i < (input_len - 2)) {
-		if (rawpath[i++] == '\0') {
-			(*input_parts)[++part] = &rawpath[i];
+		if (*part_count < capacity) {
+			_lf12_convert_name_part(input, separator - input,
+						names[*part_count]);
 		}
+		(*part_count)++;
+		if (separator == end) {
+			return F12_SUCCESS;
+		}
+		input = separator + 1;
 	}
-
-	return F12_SUCCESS;
 }
 
 struct lf12_directory_entry *lf12_entry_from_path(struct lf12_directory_entry
 						  *entry,
 						  struct lf12_path *path)
 {
+	struct lf12_directory_entry *child;
+
 	if (NULL == path) {
 		return entry;
 	}
 
-	for (int i = 0; i < entry->child_count; i++) {
-		if (0 == memcmp(entry->children[i].ShortFileName,
-				path->short_file_name, 8) &&
-		    0 == memcmp(entry->children[i].ShortFileExtension,
-				path->short_file_extension, 3)) {
-			if (NULL == path->descendant) {
-				return &entry->children[i];
-			}
-			return lf12_entry_from_path(&entry->children[i],
-						    path->descendant);
-		}
+	child = _lf12_find_child(entry, path->short_file_name,
+				 path->short_file_extension);
+	if (NULL == child || NULL == path->descendant) {
+		return child;
 	}
 
-	return NULL;
+	return lf12_entry_from_path(child, path->descendant);
 }
 
 enum lf12_error lf12_parse_path(const char *input, struct lf12_path **path)
 {
 	enum lf12_error err;
-
-	char **input_parts = NULL;
-	int input_part_count = 0;
+	struct lf12_path *parts;
+	char (*names)[11];
+	char *strings;
+	int part_count;
 
 	*path = NULL;
-	err = _lf12_split_input(input, &input_parts, &input_part_count);
-
+	err = _lf12_convert_path(input, NULL, 0, &part_count);
 	if (F12_SUCCESS != err) {
 		return err;
 	}
 
-	*path = malloc(sizeof(struct lf12_path));
+	// The structures of all parts and their strings share one allocation
+	parts = malloc(part_count * (sizeof(struct lf12_path) +
+				     PART_STRINGS_SIZE + 11));
+	if (NULL == parts) {
+		return F12_ALLOCATION_ERROR;
+	}
+	strings = (char *)&parts[part_count];
+	names = (char (*)[11])(strings + part_count * PART_STRINGS_SIZE);
+	_lf12_convert_path(input, names, part_count, &part_count);
 
-	if (*path == NULL) {
-		free(input_parts[0]);
-		free(input_parts);
+	for (int i = 0; i < part_count; i++) {
+		parts[i].name = strings;
+		memcpy(parts[i].name, names[i], 11);
+		parts[i].name[11] = '\0';
+		parts[i].short_file_name = strings + 12;
+		memcpy(parts[i].short_file_name, names[i], 8);
+		parts[i].short_file_name[8] = '\0';
+		parts[i].short_file_extension = strings + 21;
+		memcpy(parts[i].short_file_extension, names[i] + 8, 3);
+		parts[i].short_file_extension[3] = '\0';
+		strings += PART_STRINGS_SIZE;
 
-		return F12_ALLOCATION_ERROR;
+		parts[i].ancestor = i > 0 ? &parts[i - 1] : NULL;
+		parts[i].descendant = i + 1 < part_count ? &parts[i + 1] : NULL;
 	}
+	*path = parts;
 
-	err = _lf12_build_path(input_parts, input_part_count, *path);
-	free(input_parts[0]);
-	free(input_parts);
+	return F12_SUCCESS;
+}
 
-	if (F12_SUCCESS != err) {
-		free(path);
+void lf12_free_path(struct lf12_path *path)
+{
+	free(path);
+}
 
+enum lf12_error lf12_parse_compact_path(const char *input,
+					struct lf12_compact_path *path)
+{
+	enum lf12_error err;
+
+	err = _lf12_convert_path(input, path->names, path->capacity,
+				 &path->part_count);
+	if (F12_SUCCESS != err) {
 		return err;
 	}
+	if (path->part_count > path->capacity) {
+		return F12_PATH_TOO_LONG;
+	}
 
 	return F12_SUCCESS;
 }
 
-void lf12_free_path(struct lf12_path *path)
+enum lf12_error lf12_create_compact_path(const char *input,
+					 struct lf12_compact_path **path)
 {
-	if (NULL == path) {
-		return;
+	enum lf12_error err;
+	int part_count;
+
+	*path = NULL;
+	err = _lf12_convert_path(input, NULL, 0, &part_count);
+	if (F12_SUCCESS != err) {
+		return err;
 	}
 
-	if (NULL != path->descendant) {
-		lf12_free_path(path->descendant);
+	*path = malloc(sizeof(struct lf12_compact_path) + part_count * 11);
+	if (NULL == *path) {
+		return F12_ALLOCATION_ERROR;
 	}
+	(*path)->names = (char (*)[11])(*path + 1);
+	(*path)->capacity = part_count;
+
+	return lf12_parse_compact_path(input, *path);
+}
 
-	free(path->name);
-	free(path->short_file_name);
-	free(path->short_file_extension);
+void lf12_free_compact_path(struct lf12_compact_path *path)
+{
 	free(path);
 }
 
@@ -245,49 +198,41 @@ enum lf12_error lf12_path_create_directories(struct lf12_metadata *f12_meta,
 					     struct lf12_path *path)
 {
 	enum lf12_error err;
+	struct lf12_directory_entry *child;
 
-	for (int i = 0; i < entry->child_count; i++) {
-		if (0 == memcmp(entry->children[i].ShortFileName,
-				path->short_file_name, 8) &&
-		    0 == memcmp(entry->children[i].ShortFileExtension,
-				path->short_file_extension, 3)) {
-			if (!lf12_is_directory(&entry->children[i])) {
-				return F12_NOT_A_DIR;
-			}
-
-			if (NULL == path->descendant) {
-				return F12_SUCCESS;
-			}
+	child = _lf12_find_child(entry, path->short_file_name,
+				 path->short_file_extension);
+	if (NULL != child) {
+		if (!lf12_is_directory(child)) {
+			return F12_NOT_A_DIR;
+		}
 
-			return lf12_path_create_directories(f12_meta,
-							    &entry->children[i],
-							    path->descendant);
+		if (NULL == path->descendant) {
+			return F12_SUCCESS;
 		}
+
+		return lf12_path_create_directories(f12_meta, child,
+						    path->descendant);
 	}
 
 	// This directory does not exist, lets create it
-	for (int i = 0; i < entry->child_count; i++) {
-		if (entry->children[i].ShortFileName[0] == 0) {
-			memcpy(&(entry->children[i].ShortFileName),
-			       path->short_file_name, 8);
-			memcpy(&(entry->children[i].ShortFileExtension),
-			       path->short_file_extension, 3);
-			entry->children[i].parent = entry;
-			err = lf12_create_directory_table(f12_meta,
-							  &entry->children[i]);
-			if (err != F12_SUCCESS) {
-				return err;
-			}
+	child = _lf12_find_free_child(entry);
+	if (NULL == child) {
+		return F12_DIR_FULL;
+	}
 
-			if (path->descendant == NULL) {
-				return F12_SUCCESS;
-			}
+	memcpy(&(child->ShortFileName), path->short_file_name, 8);
+	memcpy(&(child->ShortFileExtension), path->short_file_extension, 3);
+	child->parent = entry;
+	_lf12_index_child(entry, child);
+	err = lf12_create_directory_table(f12_meta, child);
+	if (err != F12_SUCCESS) {
+		return err;
+	}
 
-			return lf12_path_create_directories(f12_meta,
-							    &entry->children[i],
-							    path->descendant);
-		}
+	if (path->descendant == NULL) {
+		return F12_SUCCESS;
 	}
 
-	return F12_DIR_FULL;
+	return lf12_path_create_directories(f12_meta, child, path->descendant);
 }
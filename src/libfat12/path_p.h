@@ -2,28 +2,18 @@
 #define LF12_PATH_H
 
 /**
- * Populates a lf12_path structure from an array of directory and file names.
- *
- * @param input_parts a pointer to an array of file and directory names
- * @param part_count the number of file and directory names in the array
- * @param path a pointer to the lf12_path structure to populate
- * @return F12_SUCCESS or any other error that occurred
- */
-enum lf12_error _lf12_build_path(char **input_parts,
-				 int part_count, struct lf12_path *path);
-
-/**
- * Splits a filepath into its components.
+ * Converts the components of a filepath into names in the format of directory
+ * entries without allocating memory.
  *
  * @param input a pointer to the filepath
- * @param input_parts a pointer a array of string pointers. That array will be
- * filled with the components of the input. After use free must be called on
- * the first element of the array and the array itself.
+ * @param names a pointer to memory for capacity names with the 8 characters of
+ * the short file name followed by the 3 characters of the extension
+ * @param capacity the number of names, that fit into the memory
  * @param part_count a pointer to the variable where the number of parts gets
- * written into.
- * @return F12_SUCCESS or any other error that occurred
+ * written into. Parts beyond the capacity are counted but not converted.
+ * @return F12_SUCCESS or F12_EMPTY_PATH if input is empty or "/"
  */
-enum lf12_error _lf12_split_input(const char *input,
-				  char ***input_parts, int *part_count);
+enum lf12_error _lf12_convert_path(const char *input, char (*names)[11],
+				   int capacity, int *part_count);
 
 #endif
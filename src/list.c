@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -9,9 +10,11 @@
 
 #define LIST_DATETIME_WIDTH 21
 #define LIST_DATE_WIDTH 12
+#define LIST_EXTENTS_WIDTH 6
 
 static const char *LIST_FORMAT =
-	"%s%*s|-> %-*s" "%6$*7$s" "%8$*9$s" "%10$*11$s" "%12$*13$s\n";
+	"%*s|-> %-*s" "%5$*6$s" "%7$*8$s" "%9$*10$s" "%11$*12$s"
+	"%13$*14$s\n";
 static const char *LIST_DATETIME_FORMAT = "%Y-%m-%d %H:%M:%S";
 static const char *LIST_DATE_FORMAT = "%Y-%m-%d";
 
@@ -46,8 +49,10 @@ size_t _f12__f12_format_bytes_len(size_t bytes)
 		STRLEN(" GiB  ");
 }
 
-enum lf12_error _f12_list_entry(struct lf12_directory_entry *entry,
-				char **output, struct f12_list_arguments *args)
+enum lf12_error _f12_list_entry(struct lf12_metadata *f12_meta,
+				struct lf12_directory_entry *entry,
+				struct f12_buffer *output,
+				struct f12_list_arguments *args)
 {
 	enum lf12_error err;
 	size_t max_name_width, max_size_width;
@@ -56,7 +61,7 @@ enum lf12_error _f12_list_entry(struct lf12_directory_entry *entry,
 	max_size_width = _f12_list_size_len(entry, args->recursive);
 
 	if (!lf12_is_directory(entry)) {
-		err = _f12_list_f12_entry(entry, output, args, 0,
+		err = _f12_list_f12_entry(f12_meta, entry, output, args, 0,
 					  max_name_width, max_size_width);
 		if (F12_SUCCESS != err) {
 			return err;
@@ -64,8 +69,9 @@ enum lf12_error _f12_list_entry(struct lf12_directory_entry *entry,
 	}
 
 	for (int i = 0; i < entry->child_count; i++) {
-		err = _f12_list_f12_entry(&entry->children[i], output, args, 0,
-					  max_name_width, max_size_width);
+		err = _f12_list_f12_entry(f12_meta, &entry->children[i],
+					  output, args, 0, max_name_width,
+					  max_size_width);
 		if (F12_SUCCESS != err) {
 			return err;
 		}
@@ -74,8 +80,9 @@ enum lf12_error _f12_list_entry(struct lf12_directory_entry *entry,
 	return F12_SUCCESS;
 }
 
-enum lf12_error _f12_list_f12_entry(struct lf12_directory_entry *entry,
-				    char **output,
+enum lf12_error _f12_list_f12_entry(struct lf12_metadata *f12_meta,
+				    struct lf12_directory_entry *entry,
+				    struct f12_buffer *output,
 				    struct f12_list_arguments *args, int depth,
 				    int name_width, int size_width)
 {
@@ -84,8 +91,10 @@ enum lf12_error _f12_list_f12_entry(struct lf12_directory_entry *entry,
 	char creat_buf[LIST_DATETIME_WIDTH] = "";
 	char mod_buf[LIST_DATETIME_WIDTH] = "";
 	char acc_buf[LIST_DATE_WIDTH] = "";
+	char extents_buf[LIST_EXTENTS_WIDTH] = "";
 	char *size_str = "";
-	int creat_pad = 0, mod_pad = 0, acc_pad = 0, size_pad = 0;
+	int creat_pad = 0, mod_pad = 0, acc_pad = 0, size_pad = 0,
+		extents_pad = 0;
 	long usecs;
 	time_t timer;
 	struct tm *timeinfo;
@@ -146,15 +155,22 @@ enum lf12_error _f12_list_f12_entry(struct lf12_directory_entry *entry,
 		name_padding = name_width - 4 - depth;
 	}
 
+	if (args->extents) {
+		snprintf(extents_buf, LIST_EXTENTS_WIDTH, "%u",
+			 lf12_get_extent_count(f12_meta, entry));
+		extents_pad = LIST_EXTENTS_WIDTH;
+		name_padding = name_width - 4 - depth;
+	}
+
 	char *name = lf12_get_entry_file_name(entry);
 	if (NULL == name) {
 		return F12_ALLOCATION_ERROR;
 	}
 
-	esprintf(output, LIST_FORMAT, *output, depth, "",
-		 name_padding, name,
-		 creat_buf, creat_pad, mod_buf, mod_pad, acc_buf, acc_pad,
-		 size_str, size_pad);
+	buffer_printf(output, LIST_FORMAT, depth, "",
+		      name_padding, name,
+		      creat_buf, creat_pad, mod_buf, mod_pad, acc_buf, acc_pad,
+		      size_str, size_pad, extents_buf, extents_pad);
 	free(name);
 	if (args->with_size) {
 		free(size_str);
@@ -163,7 +179,8 @@ enum lf12_error _f12_list_f12_entry(struct lf12_directory_entry *entry,
 	if (args->recursive && lf12_is_directory(entry)
 	    && !lf12_is_dot_dir(entry)) {
 		for (int i = 0; i < entry->child_count; i++) {
-			err = _f12_list_f12_entry(&entry->children[i], output,
+			err = _f12_list_f12_entry(f12_meta,
+						  &entry->children[i], output,
 						  args, depth + 2, name_width,
 						  size_width);
 			if (F12_SUCCESS != err) {
@@ -267,63 +284,57 @@ size_t _f12_list_size_len(struct lf12_directory_entry *root_entry,
 	return max_len;
 }
 
-int f12_list(struct f12_list_arguments *args, char **output)
+int f12_list(struct f12_list_arguments *args, struct f12_buffer *output)
 {
 	struct lf12_directory_entry *entry;
 	enum lf12_error err;
 	struct lf12_metadata *f12_meta = NULL;
-	FILE *fp = NULL;
-	struct lf12_path *path;
+	struct lf12_device *device = NULL;
+	struct lf12_path *path = NULL;
 	int res;
 
-	fp = fopen(args->device_path, "r+");
-	if (EXIT_SUCCESS != (res = open_image(fp, &f12_meta, output))) {
+	device = open_mapped_device(args->device_path);
+	res = open_indexed_image(args->device_path, device, &f12_meta, output,
+				 open_image_lazy);
+	if (EXIT_SUCCESS != res) {
 		return res;
 	}
-	fclose(fp);
-	fp = NULL;
 
-	if (args->path == NULL || args->path[0] == '\0') {
-		err = _f12_list_entry(f12_meta->root_dir, output, args);
-		lf12_free_metadata(f12_meta);
-		f12_meta = NULL;
-		if (F12_SUCCESS != err) {
-			return print_error(fp, f12_meta, output, "%s\n",
-					   strerror(err));
+	if (args->path != NULL && args->path[0] != '\0') {
+		err = lf12_parse_path(args->path, &path);
+		if (F12_EMPTY_PATH == err) {
+			path = NULL;
+		} else if (F12_SUCCESS != err) {
+			return print_error(device, f12_meta, output, "%s\n",
+					   lf12_strerror(err));
 		}
-
-		return EXIT_SUCCESS;
 	}
 
-	err = lf12_parse_path(args->path, &path);
-	if (F12_EMPTY_PATH == err) {
-		err = _f12_list_entry(f12_meta->root_dir, output, args);
-		lf12_free_metadata(f12_meta);
-		f12_meta = NULL;
-		if (F12_SUCCESS != err) {
-			return print_error(fp, f12_meta, output, "%s\n",
-					   strerror(err));
-		}
-
-		return EXIT_SUCCESS;
+	err = lf12_load_entry_from_path(device, f12_meta, path, &entry);
+	lf12_free_path(path);
+	if (F12_FILE_NOT_FOUND == err) {
+		return print_error(device, f12_meta, output,
+				   _("File not found\n"));
+	}
+	if (F12_SUCCESS == err) {
+		// Load the directory tables, that are listed
+		err = lf12_load_directory(device, f12_meta, entry,
+					  args->recursive);
 	}
 	if (F12_SUCCESS != err) {
-		return print_error(fp, f12_meta, output, "%s\n",
+		return print_error(device, f12_meta, output, "%s\n",
 				   lf12_strerror(err));
 	}
+	lf12_close_device(device);
+	device = NULL;
 
-	entry = lf12_entry_from_path(f12_meta->root_dir, path);
-	lf12_free_path(path);
-	if (NULL == entry) {
-		return print_error(fp, f12_meta, output, _("File not found\n"));
-	}
-
-	err = _f12_list_entry(entry, output, args);
+	err = _f12_list_entry(f12_meta, entry, output, args);
 	lf12_free_metadata(f12_meta);
 	f12_meta = NULL;
 	if (F12_SUCCESS == err) {
 		return EXIT_SUCCESS;
 	}
 
-	return print_error(fp, f12_meta, output, "%s\n", lf12_strerror(err));
+	return print_error(device, f12_meta, output, "%s\n",
+			   lf12_strerror(err));
 }
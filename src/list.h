@@ -24,25 +24,29 @@ size_t _f12__f12_format_bytes_len(size_t bytes);
  * Lists a directory or single file on a fat 12 image. If it is a directory, it
  * lists the directory itself and all its childs.
  *
+ * @param f12_meta a pointer to the metadata of the image. It is only used to
+ *                 count the extents of the entries.
  * @param entry a pointer to the lf12_directory_entry structure describing the
  *              entry to list
- * @param output a pointer to the string with the list output. The destination
- *               of the pointer must be freed.
+ * @param output a pointer to the buffer, the list is appended to
  * @param args a pointer to the structure with the list arguments
  * @return any error that occurred or F12_SUCCESS
  */
-enum lf12_error _f12_list_entry(struct lf12_directory_entry *entry,
-				char **output, struct f12_list_arguments *args);
+enum lf12_error _f12_list_entry(struct lf12_metadata *f12_meta,
+				struct lf12_directory_entry *entry,
+				struct f12_buffer *output,
+				struct f12_list_arguments *args);
 
 /**
  * Lists a entry from a directory table of a fat 12 file system. If the entry
  * is a directory, it lists only its childs. If the entry is a file it only lists 
  * the entry itself
  * 
+ * @param f12_meta a pointer to the metadata of the image. It is only used to
+ *                 count the extents of the entries.
  * @param entry a pointer to the lf12_directory_entry structure describing the
  *              entry to list
- * @param output a pointer to the string with the list output. The destination
- *               of the pointer must be freed.
+ * @param output a pointer to the buffer, the list is appended to
  * @param args a pointer to the structure with the list arguments
  * @param depth the depth of indentation of the current given entry in the list
  * @param name_width the width of the longest childs filename including the
@@ -50,8 +54,9 @@ enum lf12_error _f12_list_entry(struct lf12_directory_entry *entry,
  * @param size_width the width of the longest formatted file size
  * @return any error that occurred or F12_SUCCESS
  */
-enum lf12_error _f12_list_f12_entry(struct lf12_directory_entry *entry,
-				    char **output,
+enum lf12_error _f12_list_f12_entry(struct lf12_metadata *f12_meta,
+				    struct lf12_directory_entry *entry,
+				    struct f12_buffer *output,
 				    struct f12_list_arguments *args, int depth,
 				    int name_width, int size_width);
 
@@ -2,11 +2,13 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include "common.h"
 #include "f12.h"
 
 enum f12_command {
 	COMMAND_NONE,
 	COMMAND_CREATE,
+	COMMAND_DEFRAG,
 	COMMAND_DEL,
 	COMMAND_GET,
 	COMMAND_INFO,
@@ -15,7 +17,7 @@ enum f12_command {
 	COMMAND_PUT,
 };
 
-#define NUMBER_OF_COMMANDS 7
+#define NUMBER_OF_COMMANDS 8
 
 enum opts {
 	OPT_CREATE_ROOT_DIR = 256,
@@ -28,9 +30,15 @@ enum opts {
 	OPT_CREATE_ROOT_DIR_ENTRIES,
 	OPT_CREATE_DRIVE_NUMBER,
 	OPT_CREATE_BOOT_FILE,
+	OPT_CREATE_PREALLOCATE,
+	OPT_CREATE_ALLOC,
+	OPT_DEFRAG_DRY_RUN,
 	OPT_DEL_SOFT_DELETE,
 	OPT_INFO_DUMP_BPB,
+	OPT_INFO_COUNTS,
 	OPT_LIST_WITH_SIZE,
+	OPT_LIST_EXTENTS,
+	OPT_PUT_ALLOC,
 	OPT_LIST_CREATION_DATE = 'c',
 	OPT_LIST_MODIFICATION_DATE = 'm',
 	OPT_LIST_ACCESS_DATE = 'a',
@@ -41,6 +49,7 @@ const char *argp_program_bug_address = "Karsten Lehmann <mail@kalehmann.de>";
 
 struct arguments {
 	struct f12_create_arguments *create_arguments;
+	struct f12_defrag_arguments *defrag_arguments;
 	struct f12_del_arguments *del_arguments;
 	struct f12_get_arguments *get_arguments;
 	struct f12_info_arguments *info_arguments;
@@ -97,6 +106,21 @@ static int power_of_two(long n)
 	return nonzeroBits == 1;
 }
 
+static enum lf12_allocation_policy parse_allocation_policy(char *str)
+{
+	if (0 == strcmp("first-fit", str)) {
+		return F12_ALLOC_FIRST_FIT;
+	} else if (0 == strcmp("next-fit", str)) {
+		return F12_ALLOC_NEXT_FIT;
+	} else if (0 == strcmp("best-fit", str)) {
+		return F12_ALLOC_BEST_FIT;
+	}
+
+	fprintf(stderr, _("Unknown allocation policy %s\n"), str);
+
+	exit(EXIT_FAILURE);
+}
+
 error_t parser_create(int key, char *arg, struct argp_state *state)
 {
 	struct arguments *args = state->input;
@@ -200,6 +224,15 @@ error_t parser_create(int key, char *arg, struct argp_state *state)
 		}
 		create_arguments->boot_file = arg;
 
+		return 0;
+	case (OPT_CREATE_PREALLOCATE):
+		create_arguments->preallocate = 1;
+
+		return 0;
+	case (OPT_CREATE_ALLOC):
+		create_arguments->allocation_policy =
+			parse_allocation_policy(arg);
+
 		return 0;
 	}
 
@@ -314,6 +347,26 @@ static struct argp_option create_options[] = {
 				    "be booted"),
 		.group = 0
 	},
+	{
+		.name = "preallocate",
+		.key = OPT_CREATE_PREALLOCATE,
+		.arg = NULL,
+		.flags = 0,
+		.doc = gettext_noop("Reserve the space for the whole image on "
+				    "the disk instead of creating a sparse "
+				    "file"),
+		.group = 0
+	},
+	{
+		.name = "alloc",
+		.key = OPT_CREATE_ALLOC,
+		.arg = "POLICY",
+		.flags = 0,
+		.doc = gettext_noop("How the clusters for new files are chosen "
+				    "(first-fit, next-fit or best-fit). "
+				    "The default value is first-fit."),
+		.group = 0
+	},
 	{
 		.name = "verbose",
 		.key = 'v',
@@ -336,6 +389,56 @@ static struct argp argp_create = {
 	.argp_domain = NULL
 };
 
+error_t parser_defrag(int key, char *arg, struct argp_state *state)
+{
+	(void) arg;		// Suppress unused parameter warning
+	struct arguments *args = state->input;
+	struct f12_defrag_arguments *defrag_arguments = args->defrag_arguments;
+
+	switch (key) {
+	case (OPT_DEFRAG_DRY_RUN):
+		defrag_arguments->dry_run = 1;
+
+		return 0;
+	}
+
+	return ARGP_ERR_UNKNOWN;
+}
+
+// *INDENT-OFF*
+static struct argp_option defrag_options[] = {
+	{
+		.name = "dry-run",
+		.key = OPT_DEFRAG_DRY_RUN,
+		.arg = NULL,
+		.flags = 0,
+		.doc = gettext_noop("Only report how many extents the "
+				    "defragmentation would save without "
+				    "changing the image."),
+		.group = 0
+	},
+	{
+		.name = "verbose",
+		.key = 'v',
+		.arg = NULL,
+		.flags = 0,
+		.doc = NULL,
+		.group = 0
+	},
+	{ 0 }
+};
+// *INDENT-ON*
+
+static struct argp argp_defrag = {
+	.options = defrag_options,
+	.parser = parser_defrag,
+	.args_doc = NULL,
+	.doc = NULL,
+	.children = NULL,
+	.help_filter = NULL,
+	.argp_domain = NULL
+};
+
 error_t parser_del(int key, char *arg, struct argp_state *state)
 {
 	struct arguments *args = state->input;
@@ -448,6 +551,10 @@ error_t parser_info(int key, char *arg, struct argp_state *state)
 	case (OPT_INFO_DUMP_BPB):
 		info_arguments->dump_bpb = 1;
 
+		return 0;
+	case (OPT_INFO_COUNTS):
+		info_arguments->counts = 1;
+
 		return 0;
 	}
 
@@ -465,6 +572,15 @@ static struct argp_option info_options[] = {
 				    "parameter block."),
 		.group = 0
 	},
+	{
+		.name = "counts",
+		.key = OPT_INFO_COUNTS,
+		.arg = NULL,
+		.flags = 0,
+		.doc = gettext_noop("Count the files and directories on the "
+				    "image. This reads all directory tables."),
+		.group = 0
+	},
 	{ 0 }
 };
 // *INDENT-ON*
@@ -507,6 +623,10 @@ error_t parser_list(int key, char *arg, struct argp_state *state)
 	case (OPT_LIST_WITH_SIZE):
 		list_arguments->with_size = 1;
 
+		return 0;
+	case (OPT_LIST_EXTENTS):
+		list_arguments->extents = 1;
+
 		return 0;
 	}
 
@@ -550,6 +670,15 @@ static struct argp_option list_options[] = {
 		.doc = gettext_noop("Show the size of each file."),
 		.group = 0
 	},
+	{
+		.name = "extents",
+		.key = OPT_LIST_EXTENTS,
+		.arg = NULL,
+		.flags = 0,
+		.doc = gettext_noop("Show the number of runs of consecutive "
+				    "clusters each entry is stored in."),
+		.group = 0
+	},
 	{
 		.name = "recursive",
 		.key = 'r',
@@ -626,6 +755,10 @@ error_t parser_put(int key, char *arg, struct argp_state *state)
 	struct f12_put_arguments *put_arguments = args->put_arguments;
 
 	switch (key) {
+	case (OPT_PUT_ALLOC):
+		put_arguments->allocation_policy = parse_allocation_policy(arg);
+
+		return 0;
 	case ARGP_KEY_ARG:
 		if (NULL == put_arguments->source) {
 			put_arguments->source = arg;
@@ -654,6 +787,16 @@ static struct argp_option put_options[] = {
 		.doc = NULL,
 		.group = 0
 	},
+	{
+		.name = "alloc",
+		.key = OPT_PUT_ALLOC,
+		.arg = "POLICY",
+		.flags = 0,
+		.doc = gettext_noop("How the clusters for new files are chosen "
+				    "(first-fit, next-fit or best-fit). "
+				    "The default value is first-fit."),
+		.group = 0
+	},
 	{ 0 }
 };
 // *INDENT-ON*
@@ -706,6 +849,12 @@ static struct argp_child children[] = {
 		.header = "del DEVICE PATH [OPTION...]",
 		.group = 5
 	},
+	{
+		.argp = &argp_defrag,
+		.flags = 0,
+		.header = "defrag DEVICE [OPTION...]",
+		.group = 5
+	},
 	{
 		.argp = &argp_create,
 		.flags = 0,
@@ -762,6 +911,8 @@ int parse_key_arg(char *arg, struct argp_state *state)
 	switch (arguments->command) {
 	case COMMAND_CREATE:
 		return parser_create(ARGP_KEY_ARG, arg, state);
+	case COMMAND_DEFRAG:
+		return parser_defrag(ARGP_KEY_ARG, arg, state);
 	case COMMAND_DEL:
 		return parser_del(ARGP_KEY_ARG, arg, state);
 	case COMMAND_GET:
@@ -851,6 +1002,8 @@ error_t parser(int key, char *arg, struct argp_state *state)
 
 		if (0 == strncmp(arg, "create", 7)) {
 			arguments->command = COMMAND_CREATE;
+		} else if (0 == strncmp(arg, "defrag", 7)) {
+			arguments->command = COMMAND_DEFRAG;
 		} else if (0 == strncmp(arg, "del", 4)) {
 			arguments->command = COMMAND_DEL;
 		} else if (0 == strncmp(arg, "get", 4)) {
@@ -893,6 +1046,7 @@ int main(int argc, char *argv[])
 {
 	struct arguments arguments = { 0 };
 	struct f12_create_arguments create_arguments = { 0 };
+	struct f12_defrag_arguments defrag_arguments = { 0 };
 	struct f12_del_arguments del_arguments = { 0 };
 	struct f12_get_arguments get_arguments = { 0 };
 	struct f12_info_arguments info_arguments = { 0 };
@@ -908,6 +1062,7 @@ int main(int argc, char *argv[])
 #endif
 
 	arguments.create_arguments = &create_arguments;
+	arguments.defrag_arguments = &defrag_arguments;
 	arguments.del_arguments = &del_arguments;
 	arguments.get_arguments = &get_arguments;
 	arguments.info_arguments = &info_arguments;
@@ -917,12 +1072,7 @@ int main(int argc, char *argv[])
 
 	argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
-	char *output = calloc(1, 1);
-	if (NULL == output) {
-		fprintf(stderr, _("Error allocating memory for output\n"));
-
-		return EXIT_FAILURE;
-	}
+	struct f12_buffer output = { 0 };
 	int res = 0;
 
 	switch (arguments.command) {
@@ -931,6 +1081,11 @@ int main(int argc, char *argv[])
 		create_arguments.verbose = arguments.verbose;
 		res = f12_create(&create_arguments, &output);
 		break;
+	case COMMAND_DEFRAG:
+		defrag_arguments.device_path = arguments.device_path;
+		defrag_arguments.verbose = arguments.verbose;
+		res = f12_defrag(&defrag_arguments, &output);
+		break;
 	case COMMAND_DEL:
 		del_arguments.device_path = arguments.device_path;
 		del_arguments.recursive = arguments.recursive;
@@ -967,14 +1122,14 @@ int main(int argc, char *argv[])
 	default:
 		break;
 	}
-	if (NULL != output) {
+	if (NULL != output.data) {
 		if (0 != res) {
-			fprintf(stderr, output);
+			fputs(output.data, stderr);
 		} else {
-			fprintf(stdout, output);
+			fputs(output.data, stdout);
 		}
 
-		free(output);
+		buffer_free(&output);
 	}
 
 	return res;
@@ -1,3 +1,4 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,7 +8,8 @@
 #include "libfat12/libfat12.h"
 
 enum lf12_error _f12_dump_move(struct lf12_directory_entry *src,
-			       struct lf12_directory_entry *dest, char **output)
+			       struct lf12_directory_entry *dest,
+			       struct f12_buffer *output)
 {
 	enum lf12_error err;
 	char *tmp = NULL, *file_name = NULL, *dest_path = NULL, *src_path =
@@ -30,13 +32,8 @@ enum lf12_error _f12_dump_move(struct lf12_directory_entry *src,
 		}
 		file_name = lf12_get_entry_file_name(src);
 
-		if (*output) {
-			esprintf(output, "%s%s -> %s/%s\n", *output,
-				 src_path, dest_path, file_name);
-		} else {
-			esprintf(output, "%s -> %s/%s\n", src_path, dest_path,
-				 file_name);
-		}
+		buffer_printf(output, "%s -> %s/%s\n", src_path, dest_path,
+			      file_name);
 		free(file_name);
 		free(src_path);
 		free(dest_path);
@@ -75,15 +72,9 @@ enum lf12_error _f12_dump_move(struct lf12_directory_entry *src,
 
 			return err;
 		}
-		if (*output) {
-			esprintf(output, "%s%s", *output, src_path);
-		} else {
-			esprintf(output, "%s", src_path);
-		}
-
 		file_name = lf12_get_entry_file_name(src);
-		esprintf(output, "%s -> %s/%s%s\n", *output,
-			 dest_path, file_name, src_path + src_offset);
+		buffer_printf(output, "%s -> %s/%s%s\n", src_path, dest_path,
+			      file_name, src_path + src_offset);
 		free(file_name);
 		free(src_path);
 
@@ -105,29 +96,31 @@ enum lf12_error _f12_dump_move(struct lf12_directory_entry *src,
 	return F12_SUCCESS;
 }
 
-int f12_move(struct f12_move_arguments *args, char **output)
+int f12_move(struct f12_move_arguments *args, struct f12_buffer *output)
 {
 	enum lf12_error err;
 	struct lf12_metadata *f12_meta = NULL;
-	FILE *fp = NULL;
+	struct lf12_device *device = NULL;
 	int res;
 	struct lf12_path *src, *dest;
 	struct lf12_directory_entry *src_entry, *dest_entry;
 
-	fp = fopen(args->device_path, "r+");
-	if (EXIT_SUCCESS != (res = open_image(fp, &f12_meta, output))) {
+	device = open_device(args->device_path, O_RDWR);
+	res = open_indexed_image(args->device_path, device, &f12_meta, output,
+				 open_image);
+	if (EXIT_SUCCESS != res) {
 		return res;
 	}
 
 	err = lf12_parse_path(args->source, &src);
 	if (F12_EMPTY_PATH == err) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("Can not move the root directory\n"));
 	}
 	if (F12_SUCCESS != err) {
 		lf12_free_path(src);
 
-		return print_error(fp, f12_meta, output, "%s\n",
+		return print_error(device, f12_meta, output, "%s\n",
 				   lf12_strerror(err));
 	}
 
@@ -135,25 +128,26 @@ int f12_move(struct f12_move_arguments *args, char **output)
 	if (F12_SUCCESS != err && F12_EMPTY_PATH != err) {
 		lf12_free_path(src);
 
-		return print_error(fp, f12_meta, output, "%s\n",
+		return print_error(device, f12_meta, output, "%s\n",
 				   lf12_strerror(err));
 	}
 
 	switch (lf12_path_get_parent(src, dest)) {
 	case F12_PATHS_FIRST:
-		esprintf(output,
-			 _("Can not move the directory into a child\n"));
+		buffer_clear(output);
+		buffer_printf(output,
+			      _("Can not move the directory into a child\n"));
 		lf12_free_path(src);
 		lf12_free_path(dest);
 		lf12_free_metadata(f12_meta);
-		fclose(fp);
+		lf12_close_device(device);
 
 		return EXIT_FAILURE;
 	case F12_PATHS_EQUAL:
 		lf12_free_path(src);
 		lf12_free_path(dest);
 		lf12_free_metadata(f12_meta);
-		fclose(fp);
+		lf12_close_device(device);
 
 		return EXIT_SUCCESS;
 	default:
@@ -165,7 +159,7 @@ int f12_move(struct f12_move_arguments *args, char **output)
 	if (NULL == src_entry) {
 		lf12_free_path(dest);
 
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("File or directory %s not found\n"),
 				   args->source);
 	}
@@ -174,14 +168,14 @@ int f12_move(struct f12_move_arguments *args, char **output)
 	    && src_entry->child_count > 2) {
 		lf12_free_path(dest);
 
-		return print_error(fp, f12_meta, output, "%s\n",
+		return print_error(device, f12_meta, output, "%s\n",
 				   lf12_strerror(F12_IS_DIR));
 	}
 
 	dest_entry = lf12_entry_from_path(f12_meta->root_dir, dest);
 	lf12_free_path(dest);
 	if (NULL == dest_entry) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("File or directory %s not found\n"),
 				   args->destination);
 	}
@@ -189,25 +183,28 @@ int f12_move(struct f12_move_arguments *args, char **output)
 	if (args->verbose) {
 		err = _f12_dump_move(src_entry, dest_entry, output);
 		if (err != F12_SUCCESS) {
-			return print_error(fp, f12_meta, output,
+			return print_error(device, f12_meta, output,
 					   _("Error: %s\n"),
 					   lf12_strerror(err));
 		}
 	}
 	if (F12_SUCCESS != (err = lf12_move_entry(src_entry, dest_entry))) {
-		return print_error(fp, f12_meta, output, _("Error: %s\n"),
+		return print_error(device, f12_meta, output, _("Error: %s\n"),
 				   lf12_strerror(err));
 	}
 
-	err = lf12_write_metadata(fp, f12_meta);
-	lf12_free_metadata(f12_meta);
-	fclose(fp);
-
+	err = lf12_write_metadata(device, f12_meta);
+	if (F12_SUCCESS == err) {
+		// Write the cached blocks back to the image
+		err = lf12_device_flush(device);
+	}
 	if (F12_SUCCESS != err) {
-		esprintf(output, _("Error: %s\n"), lf12_strerror(err));
-
-		return EXIT_FAILURE;
+		return print_error(device, f12_meta, output, _("Error: %s\n"),
+				   lf12_strerror(err));
 	}
+	lf12_close_device(device);
+	update_index(args->device_path, f12_meta);
+	lf12_free_metadata(f12_meta);
 
 	return EXIT_SUCCESS;
 }
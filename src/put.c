@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,33 +9,41 @@
 #include "f12.h"
 #include "libfat12/libfat12.h"
 
-int f12_put(struct f12_put_arguments *args, char **output)
+int f12_put(struct f12_put_arguments *args, struct f12_buffer *output)
 {
 	enum lf12_error err;
-	FILE *fp = NULL, *src = NULL;
+	struct lf12_device *device = NULL;
+	FILE *src = NULL;
 	int res;
 	struct lf12_metadata *f12_meta = NULL;
 	struct lf12_path *dest;
 	suseconds_t created = time_usec();
 	struct stat sb;
 
-	fp = fopen(args->device_path, "r+");
-	if (EXIT_SUCCESS != (res = open_image(fp, &f12_meta, output))) {
+	device = open_device(args->device_path, O_RDWR);
+	res = open_indexed_image(args->device_path, device, &f12_meta, output,
+				 open_image);
+	if (EXIT_SUCCESS != res) {
 		return res;
 	}
+	f12_meta->allocation_policy = args->allocation_policy;
 
-	if (0 != stat(args->source, &sb)) {
-		return print_error(fp, f12_meta, output,
+	if (0 == strcmp(args->source, "-")) {
+		// Read the file from the standard input
+		memset(&sb, 0, sizeof(struct stat));
+		sb.st_mode = S_IFIFO;
+	} else if (0 != stat(args->source, &sb)) {
+		return print_error(device, f12_meta, output,
 				   _("Can not open source file\n"));
 	}
 
 	err = lf12_parse_path(args->destination, &dest);
 	if (F12_EMPTY_PATH == err) {
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("Can not replace root directory\n"));
 	}
 	if (F12_SUCCESS != err) {
-		return print_error(fp, f12_meta, output, "%s\n",
+		return print_error(device, f12_meta, output, "%s\n",
 				   lf12_strerror(err));
 	}
 
@@ -42,51 +51,61 @@ int f12_put(struct f12_put_arguments *args, char **output)
 		if (!args->recursive) {
 			lf12_free_path(dest);
 
-			return print_error(fp, f12_meta, output, "%s\n",
+			return print_error(device, f12_meta, output, "%s\n",
 					   lf12_strerror(F12_IS_DIR));
 		}
-		res = _f12_walk_dir(fp, args, f12_meta, created, output);
+		res = _f12_walk_dir(device, args, f12_meta, created, output);
 		if (res) {
 			lf12_free_path(dest);
 
-			return print_error(fp, f12_meta, output, "%s\n",
+			return print_error(device, f12_meta, output, "%s\n",
 					   lf12_strerror(err));
 		}
-	} else if (S_ISREG(sb.st_mode)) {
-		if (NULL == (src = fopen(args->source, "r"))) {
+	} else if (S_ISREG(sb.st_mode) || S_ISFIFO(sb.st_mode) ||
+		   S_ISCHR(sb.st_mode)) {
+		if (0 == strcmp(args->source, "-")) {
+			src = stdin;
+		} else if (NULL == (src = fopen(args->source, "r"))) {
 			lf12_free_path(dest);
 
-			return print_error(fp, f12_meta, output,
+			return print_error(device, f12_meta, output,
 					   _("Can not open source file\n"));
 		}
 
-		err = lf12_create_file(fp, f12_meta, dest, src, created);
+		err = lf12_create_file(device, f12_meta, dest, src, created);
+		if (stdin != src) {
+			fclose(src);
+		}
 		if (F12_SUCCESS != err) {
 			lf12_free_path(dest);
 
-			return print_error(fp, f12_meta, output, "%s\n",
+			return print_error(device, f12_meta, output, "%s\n",
 					   lf12_strerror(err));
 		}
 		if (args->verbose) {
-			esprintf(output, "%s -> %s\n", args->source,
-				 args->destination);
+			buffer_printf(output, "%s -> %s\n", args->source,
+				      args->destination);
 		}
 	} else {
 		lf12_free_path(dest);
 
-		return print_error(fp, f12_meta, output,
+		return print_error(device, f12_meta, output,
 				   _("Source file has unsupported type\n"));
 	}
 
 	lf12_free_path(dest);
-	err = lf12_write_metadata(fp, f12_meta);
-	lf12_free_metadata(f12_meta);
-	fclose(fp);
+	err = lf12_write_metadata(device, f12_meta);
+	if (F12_SUCCESS == err) {
+		// Write the cached blocks back to the image
+		err = lf12_device_flush(device);
+	}
 	if (F12_SUCCESS != err) {
-		esprintf(output, _("Error: %s\n"), lf12_strerror(err));
-
-		return EXIT_FAILURE;
+		return print_error(device, f12_meta, output, _("Error: %s\n"),
+				   lf12_strerror(err));
 	}
+	lf12_close_device(device);
+	update_index(args->device_path, f12_meta);
+	lf12_free_metadata(f12_meta);
 
 	return EXIT_SUCCESS;
 }
@@ -1,4 +1,5 @@
 #include <check.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "../src/common.h"
 #include "tests.h"
@@ -23,12 +24,42 @@ START_TEST(test_f12__f12_format_bytes)
 END_TEST
 // *INDENT-ON*
 
+START_TEST(test_f12_buffer_printf)
+{
+	struct f12_buffer buffer = { 0 };
+	char expected[1001];
+
+	ck_assert_int_eq(5, buffer_printf(&buffer, "%s", "Hello"));
+	ck_assert_int_eq(8, buffer_printf(&buffer, ", %s!", "World"));
+	ck_assert_str_eq("Hello, World!", buffer.data);
+	ck_assert_uint_eq(13, buffer.length);
+
+	buffer_clear(&buffer);
+	ck_assert_str_eq("", buffer.data);
+
+	// Grow the buffer past its initial capacity
+	for (int i = 0; i < 100; i++) {
+		ck_assert_int_eq(10, buffer_printf(&buffer, "%09d\n", i));
+		snprintf(expected + i * 10, 11, "%09d\n", i);
+	}
+	ck_assert_str_eq(expected, buffer.data);
+	ck_assert_uint_eq(1000, buffer.length);
+	ck_assert(buffer.capacity > buffer.length);
+
+	buffer_free(&buffer);
+	ck_assert_ptr_null(buffer.data);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
 TCase *f12_common_case(void)
 {
 	TCase *tc_f12_common;
 
 	tc_f12_common = tcase_create("f12 common");
 	tcase_add_test(tc_f12_common, test_f12__f12_format_bytes);
+	tcase_add_test(tc_f12_common, test_f12_buffer_printf);
 
 	return tc_f12_common;
 }
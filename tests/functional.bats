@@ -185,6 +185,7 @@ fi
     [[ "$output" == *"info DEVICE"* ]]
     [[ "$output" == *"get DEVICE"* ]]
     [[ "$output" == *"del DEVICE"* ]]
+    [[ "$output" == *"defrag DEVICE"* ]]
     [[ "$output" == *"create DEVICE"* ]]
 }
 
@@ -285,6 +286,14 @@ fi
     [[ "${BASH_REMATCH[1]}" == "0xfe" ]]
 }
 
+@test "I can preallocate the space for a fat12 image when I create it" {
+    _run "${BINARY}" create "${TEST_IMAGE}" --size=1440 --preallocate
+    [[ "$status" -eq 0 ]]
+    [[ "$(stat -c %s "${TEST_IMAGE}")" -eq 1474560 ]]
+    _run "${BINARY}" info "${TEST_IMAGE}"
+    [[ "$status" -eq 0 ]]
+}
+
 @test "I can use a local folder as root directory when I create a fat12 image" {
     _run "${BINARY}" create "${TEST_IMAGE}" --root-dir=tests/fixtures/TEST
     [[ "$status" -eq 0 ]]
@@ -339,6 +348,42 @@ fi
     [[ "$output" == *"The boot file can not be in a subdirectory"* ]]
 }
 
+@test "I can defragment a fat12 image" {
+    checksum="$(md5sum LICENSE.txt | awk '{ print $1 }')"
+    _run "${BINARY}" put "${TEST_IMAGE}" LICENSE.txt FIRST.TXT
+    _run "${BINARY}" put "${TEST_IMAGE}" tests/fixtures/TEST/TEST.DAT SECOND.DAT
+    _run "${BINARY}" del "${TEST_IMAGE}" FIRST.TXT
+    _run "${BINARY}" put "${TEST_IMAGE}" LICENSE.txt LICENSE.TXT
+    [[ "$status" -eq 0 ]]
+    _run "${BINARY}" defrag "${TEST_IMAGE}" --dry-run
+    [[ "$status" -eq 0 ]]
+    [[ "$output" =~ Extents\ saved:[[:space:]]+([0-9]+) ]]
+    [[ "${BASH_REMATCH[1]}" -gt 0 ]]
+    _run "${BINARY}" defrag "${TEST_IMAGE}"
+    [[ "$status" -eq 0 ]]
+    _run "${BINARY}" get "${TEST_IMAGE}" LICENSE.TXT "${TMP_DIR}"/license.txt
+    [[ "$status" -eq 0 ]]
+    [[ "$checksum" == "$(md5sum ${TMP_DIR}/license.txt | awk '{ print $1 }')" ]]
+    _run "${BINARY}" defrag "${TEST_IMAGE}" --dry-run
+    [[ "$output" =~ Extents\ saved:[[:space:]]+0 ]]
+}
+
+@test "I can not defragment a fat12 image, that can not be written" {
+    _run "${BINARY}" put "${TEST_IMAGE}" LICENSE.txt FIRST.TXT
+    _run "${BINARY}" put "${TEST_IMAGE}" tests/fixtures/TEST/TEST.DAT SECOND.DAT
+    _run "${BINARY}" del "${TEST_IMAGE}" FIRST.TXT
+    _run "${BINARY}" put "${TEST_IMAGE}" LICENSE.txt LICENSE.TXT
+    [[ "$status" -eq 0 ]]
+    cp "${TEST_IMAGE}" "${TMP_DIR}"/original.img
+    # Writing the image fails, as no file may grow beyond zero bytes
+    trap '' XFSZ
+    ulimit -S -f 0
+    _run "${BINARY}" defrag "${TEST_IMAGE}"
+    ulimit -S -f unlimited
+    [[ "$status" -eq 1 ]]
+    cmp "${TEST_IMAGE}" "${TMP_DIR}"/original.img
+}
+
 @test "I can delete a file from a fat12 image" {
     _run "${BINARY}" del "${TEST_IMAGE}" FOLDER1/DATA.DAT
     [[ "$status" -eq 0 ]]
@@ -381,13 +426,13 @@ fi
 }
 
 @test "I can decrease the number of files by deleting one" {
-    _run "${BINARY}" info "${TEST_IMAGE}"
+    _run "${BINARY}" info "${TEST_IMAGE}" --counts
     [[ "$status" -eq 0 ]]
     [[ "$output" =~ ${FILE_COUNT_REGEX} ]]
     OLD_FILE_COUNT="${BASH_REMATCH[1]}"
     _run "${BINARY}" del "${TEST_IMAGE}" FOLDER1/DATA.DAT
     [[ "$status" -eq 0 ]]
-    _run "${BINARY}" info "${TEST_IMAGE}"
+    _run "${BINARY}" info "${TEST_IMAGE}" --counts
     [[ "$status" -eq 0 ]]
     [[ "$output" =~ ${FILE_COUNT_REGEX} ]]
     NEW_FILE_COUNT="${BASH_REMATCH[1]}"
@@ -395,13 +440,13 @@ fi
 }
 
 @test "I can decrease the number of directories by deleting one" {
-    _run "${BINARY}" info "${TEST_IMAGE}"
+    _run "${BINARY}" info "${TEST_IMAGE}" --counts
     [[ "$status" -eq 0 ]]
     [[ "$output" =~ ${DIR_COUNT_REGEX} ]]
     OLD_DIR_COUNT="${BASH_REMATCH[1]}"
     _run "${BINARY}" del "${TEST_IMAGE}" --recursive FOLDER2
     [[ "$status" -eq 0 ]]
-    _run "${BINARY}" info "${TEST_IMAGE}"
+    _run "${BINARY}" info "${TEST_IMAGE}" --counts
     [[ "$status" -eq 0 ]]
     [[ "$output" =~ ${DIR_COUNT_REGEX} ]]
     NEW_DIR_COUNT="${BASH_REMATCH[1]}"
@@ -423,6 +468,67 @@ fi
     [[ "$checksum" == "$(md5sum ${TMP_DIR}/license.txt | awk '{ print $1 }')" ]]
 }
 
+@test "I can put a file from the standard input on a fat12 image" {
+    checksum="$(md5sum LICENSE.txt | awk '{ print $1 }')"
+    _run "${BINARY}" put "${TEST_IMAGE}" - TEXT.TXT < LICENSE.txt
+    [[ "$status" -eq 0 ]]
+    _run "${BINARY}" get "${TEST_IMAGE}" TEXT.TXT "${TMP_DIR}"/license.txt
+    [[ "$status" -eq 0 ]]
+    [[ "$checksum" == "$(md5sum ${TMP_DIR}/license.txt | awk '{ print $1 }')" ]]
+}
+
+@test "I can put an empty file on a fat12 image" {
+    touch "${TMP_DIR}"/empty.txt
+    _run "${BINARY}" put "${TEST_IMAGE}" "${TMP_DIR}"/empty.txt EMPTY.TXT
+    [[ "$status" -eq 0 ]]
+    _run "${BINARY}" get "${TEST_IMAGE}" EMPTY.TXT "${TMP_DIR}"/copy.txt
+    [[ "$status" -eq 0 ]]
+    [[ -f "${TMP_DIR}"/copy.txt ]]
+    [[ ! -s "${TMP_DIR}"/copy.txt ]]
+}
+
+@test "I can choose how the clusters of a file are allocated" {
+    checksum="$(md5sum LICENSE.txt | awk '{ print $1 }')"
+    for policy in first-fit next-fit best-fit; do
+        _run "${BINARY}" put --alloc="${policy}" "${TEST_IMAGE}" LICENSE.txt "${policy}.TXT"
+        [[ "$status" -eq 0 ]]
+        _run "${BINARY}" get "${TEST_IMAGE}" "${policy}.TXT" "${TMP_DIR}"/license.txt
+        [[ "$status" -eq 0 ]]
+        [[ "$checksum" == "$(md5sum ${TMP_DIR}/license.txt | awk '{ print $1 }')" ]]
+    done
+    _run "${BINARY}" put --alloc=worst-fit "${TEST_IMAGE}" LICENSE.txt WORST.TXT
+    [[ "$status" -eq 1 ]]
+}
+
+@test "I can fill a fat12 image with every allocation policy without growing it" {
+    head -c $(( 100 * 512 )) /dev/urandom > "${TMP_DIR}"/first.bin
+    head -c $(( 2700 * 512 )) /dev/urandom > "${TMP_DIR}"/large.bin
+    head -c $(( 60 * 512 )) /dev/urandom > "${TMP_DIR}"/second.bin
+    head -c $(( 87 * 512 )) /dev/urandom > "${TMP_DIR}"/rest.bin
+    checksum="$(md5sum ${TMP_DIR}/rest.bin | awk '{ print $1 }')"
+    for policy in first-fit next-fit best-fit; do
+        image="${TMP_DIR}/${policy}.img"
+        _run "${BINARY}" create "${image}" --size=1440
+        [[ "$status" -eq 0 ]]
+        _run "${BINARY}" put "${image}" "${TMP_DIR}"/first.bin FIRST.BIN
+        [[ "$status" -eq 0 ]]
+        _run "${BINARY}" put "${image}" "${TMP_DIR}"/large.bin LARGE.BIN
+        [[ "$status" -eq 0 ]]
+        _run "${BINARY}" del "${image}" FIRST.BIN
+        [[ "$status" -eq 0 ]]
+        # Fill the gap at the start and the clusters at the end of the data area
+        _run "${BINARY}" put --alloc="${policy}" "${image}" "${TMP_DIR}"/second.bin SECOND.BIN
+        [[ "$status" -eq 0 ]]
+        _run "${BINARY}" put --alloc="${policy}" "${image}" "${TMP_DIR}"/rest.bin REST.BIN
+        [[ "$status" -eq 0 ]]
+        [[ "$(stat -c %s ${image})" -eq 1474560 ]]
+        _run "${BINARY}" get "${image}" REST.BIN "${TMP_DIR}"/rest.out
+        [[ "$status" -eq 0 ]]
+        [[ "$checksum" == "$(md5sum ${TMP_DIR}/rest.out | awk '{ print $1 }')" ]]
+        rm "${TMP_DIR}"/rest.out
+    done
+}
+
 @test "I can get a directory from a fat12 image" {
     _run "${BINARY}" get "${TEST_IMAGE}" FOLDER1/SUBDIR "${TMP_DIR}"/subdir --recursive
     [[ "$status" -eq 0 ]]
@@ -455,6 +561,16 @@ fi
     [[ "$status" -eq 0 ]]
     [[ "$output" == *"Partition size"* ]]
     [[ "$output" == *"Used bytes"* ]]
+    [[ "$output" == *"Free bytes"* ]]
+    [[ "$output" == *"Fragmented chains"* ]]
+    [[ "$output" == *"Free extents"* ]]
+    [[ "$output" == *"Largest free extent"* ]]
+    [[ "$output" != *"Files"* ]]
+}
+
+@test "I can count the files and directories on a fat12 image" {
+    _run "${BINARY}" info "${TEST_IMAGE}" --counts
+    [[ "$status" -eq 0 ]]
     [[ "$output" == *"Files"* ]]
     [[ "$output" == *"Directories"* ]]
 }
@@ -544,6 +660,19 @@ fi
     [[ "$output" == "|-> TEXT.TXT 7 bytes" ]]
 }
 
+@test "I can list the number of extents of files" {
+    _run "${BINARY}" put "${TEST_IMAGE}" LICENSE.txt FIRST.TXT
+    _run "${BINARY}" put "${TEST_IMAGE}" tests/fixtures/TEST/TEST.DAT SECOND.DAT
+    _run "${BINARY}" del "${TEST_IMAGE}" FIRST.TXT
+    _run "${BINARY}" put "${TEST_IMAGE}" LICENSE.txt LICENSE.TXT
+    _run "${BINARY}" list --extents "${TEST_IMAGE}" SECOND.DAT
+    [[ "$status" -eq 0 ]]
+    [[ "$output" =~ SECOND.DAT[[:space:]]+1$ ]]
+    _run "${BINARY}" list --extents "${TEST_IMAGE}" LICENSE.TXT
+    [[ "$output" =~ LICENSE.TXT[[:space:]]+([0-9]+)$ ]]
+    [[ "${BASH_REMATCH[1]}" -gt 1 ]]
+}
+
 @test "I can list a single file" {
     _run "${BINARY}" list "${TEST_IMAGE}" FILE.BIN
     [[ "$status" -eq 0 ]]
@@ -653,6 +782,18 @@ fi
     [[ "$output" == *"Can not move the directory into a child"* ]]
 }
 
+@test "I can not move a file on a fat12 image, that can not be written" {
+    cp "${TEST_IMAGE}" "${TMP_DIR}"/original.img
+    # Writing the metadata fails, as no file may grow beyond zero bytes
+    trap '' XFSZ
+    ulimit -S -f 0
+    _run "${BINARY}" move "${TEST_IMAGE}" FILE.BIN FOLDER2
+    ulimit -S -f unlimited
+    [[ "$status" -eq 1 ]]
+    [[ "$output" == *"File too large"* ]]
+    cmp "${TEST_IMAGE}" "${TMP_DIR}"/original.img
+}
+
 @test "I can have source and destination be the same directory when using move" {
     _run "${BINARY}" move --recursive "${TEST_IMAGE}" FOLDER1 FOLDER1
     [[ "$status" -eq 0 ]]
@@ -763,14 +904,42 @@ fi
     [[ "$output" == *"Can not replace root directory"* ]]
 }
 
-@test "I can increase the number of files by putting one to the image" {
+@test "I can not put a file on a full fat12 image" {
+    _run "${BINARY}" list "${TEST_IMAGE}" --recursive
+    OLD_LIST="${output}"
+    _run "${BINARY}" info "${TEST_IMAGE}"
+    OLD_INFO="${output}"
+    head -c 2000000 /dev/zero > "${TMP_DIR}"/large.bin
+    _run "${BINARY}" put "${TEST_IMAGE}" "${TMP_DIR}"/large.bin LARGE.BIN
+    [[ "$status" -eq 1 ]]
+    [[ "$output" == *"The image is full"* ]]
+    # The changes of the failed operation are not written to the image
+    _run "${BINARY}" list "${TEST_IMAGE}" --recursive
+    [[ "$output" == "${OLD_LIST}" ]]
     _run "${BINARY}" info "${TEST_IMAGE}"
+    [[ "$output" == "${OLD_INFO}" ]]
+}
+
+@test "I can not put a file on a fat12 image, that can not be written" {
+    cp "${TEST_IMAGE}" "${TMP_DIR}"/original.img
+    # Writing the metadata fails, as no file may grow beyond zero bytes
+    trap '' XFSZ
+    ulimit -S -f 0
+    _run "${BINARY}" put "${TEST_IMAGE}" /dev/null EMPTY.TXT
+    ulimit -S -f unlimited
+    [[ "$status" -eq 1 ]]
+    [[ "$output" == *"File too large"* ]]
+    cmp "${TEST_IMAGE}" "${TMP_DIR}"/original.img
+}
+
+@test "I can increase the number of files by putting one to the image" {
+    _run "${BINARY}" info "${TEST_IMAGE}" --counts
     [[ "$status" -eq 0 ]]
     [[ "$output" =~ ${FILE_COUNT_REGEX} ]]
     OLD_FILE_COUNT="${BASH_REMATCH[1]}"
     _run "${BINARY}" put "${TEST_IMAGE}" tests/fixtures/TEST/DATA.BIN NEWF.ILE
     [[ "$status" -eq 0 ]]
-    _run "${BINARY}" info "${TEST_IMAGE}"
+    _run "${BINARY}" info "${TEST_IMAGE}" --counts
     [[ "$status" -eq 0 ]]
     [[ "$output" =~ ${FILE_COUNT_REGEX} ]]
     NEW_FILE_COUNT="${BASH_REMATCH[1]}"
@@ -779,13 +948,13 @@ fi
 
 
 @test "I can increase the number of directories by putting one to the image" {
-    _run "${BINARY}" info "${TEST_IMAGE}"
+    _run "${BINARY}" info "${TEST_IMAGE}" --counts
     [[ "$status" -eq 0 ]]
     [[ "$output" =~ ${DIR_COUNT_REGEX} ]]
     OLD_DIR_COUNT="${BASH_REMATCH[1]}"
     _run "${BINARY}" put "${TEST_IMAGE}" --recursive tests/fixtures/TEST/SUBDIR1 NEWDIR1
     [[ "$status" -eq 0 ]]
-    _run "${BINARY}" info "${TEST_IMAGE}"
+    _run "${BINARY}" info "${TEST_IMAGE}" --counts
     [[ "$status" -eq 0 ]]
     [[ "$output" =~ ${DIR_COUNT_REGEX} ]]
     NEW_DIR_COUNT="${BASH_REMATCH[1]}"
@@ -800,3 +969,21 @@ fi
     [[ "$output" == *"NEWDIR/SUBDIR2/FILE2.TXT"* ]]
     [[ "$output" == *"NEWDIR/TEST.DAT"* ]]
 }
+
+@test "I see the changes to a fat12 image when the index of its metadata is enabled" {
+    export F12_INDEX=1
+    _run "${BINARY}" list "${TEST_IMAGE}" --recursive
+    [[ "$status" -eq 0 ]]
+    [[ -f "${TEST_IMAGE}.f12idx" ]]
+    _run "${BINARY}" put "${TEST_IMAGE}" tests/fixtures/data.txt /INDEXED/DATA.TXT
+    [[ "$status" -eq 0 ]]
+    _run "${BINARY}" list "${TEST_IMAGE}" --recursive
+    [[ "$status" -eq 0 ]]
+    [[ "$output" == *"INDEXED"* ]]
+    [[ "$output" == *"DATA.TXT"* ]]
+    _run "${BINARY}" del "${TEST_IMAGE}" --recursive /INDEXED
+    [[ "$status" -eq 0 ]]
+    _run "${BINARY}" list "${TEST_IMAGE}"
+    [[ "$status" -eq 0 ]]
+    [[ "$output" != *"INDEXED"* ]]
+}
@@ -0,0 +1,99 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../../src/libfat12/fat_p.h"
+#include "../../src/libfat12/io_p.h"
+
+// The largest possible file allocation table of a fat12 partition
+#define ENTRY_COUNT 4086
+#define FAT_SIZE ((ENTRY_COUNT * 3 + 1) / 2)
+#define DEFAULT_ROUNDS 20000
+
+static uint16_t entries[ENTRY_COUNT];
+static char fat[FAT_SIZE];
+// Keeps the compiler from dropping the benchmarked calls
+static volatile uint16_t sink;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void decode_per_entry(const char *fat, uint16_t *entries, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		entries[i] = _lf12_read_fat_entry(fat, i);
+	}
+}
+
+static void bench_decode(const char *name,
+			 void (*decode)(const char *, uint16_t *, size_t),
+			 long rounds)
+{
+	double start = now(), seconds;
+
+	for (long i = 0; i < rounds; i++) {
+		decode(fat, entries, ENTRY_COUNT);
+		sink = entries[i % ENTRY_COUNT];
+	}
+	seconds = now() - start;
+
+	printf("%-24s %10.1f ns/table %8.1f MiB/s\n", name,
+	       seconds * 1e9 / rounds,
+	       rounds * (double)FAT_SIZE / seconds / (1024 * 1024));
+}
+
+static void bench_encode(const char *name,
+			 void (*encode)(const uint16_t *, size_t, char *),
+			 long rounds)
+{
+	double start = now(), seconds;
+
+	for (long i = 0; i < rounds; i++) {
+		encode(entries, ENTRY_COUNT, fat);
+		sink = fat[i % FAT_SIZE];
+	}
+	seconds = now() - start;
+
+	printf("%-24s %10.1f ns/table %8.1f MiB/s\n", name,
+	       seconds * 1e9 / rounds,
+	       rounds * (double)FAT_SIZE / seconds / (1024 * 1024));
+}
+
+/*
+ * Measures the codec for the file allocation table on a table with the
+ * maximum number of entries. The optional argument is the number of rounds.
+ */
+int main(int argc, char **argv)
+{
+	long rounds = DEFAULT_ROUNDS;
+
+	if (argc > 1) {
+		rounds = strtol(argv[1], NULL, 10);
+	}
+	if (rounds <= 0) {
+		fprintf(stderr, "Usage: %s [ROUNDS]\n", argv[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	srand(12);
+	for (int i = 0; i < ENTRY_COUNT; i++) {
+		entries[i] = rand() & 0xfff;
+	}
+	_lf12_encode_fat_scalar(entries, ENTRY_COUNT, fat);
+
+	bench_decode("decode per entry", decode_per_entry, rounds);
+	bench_decode("decode scalar", _lf12_decode_fat_scalar, rounds);
+	bench_decode("decode", _lf12_decode_fat, rounds);
+	bench_encode("encode scalar", _lf12_encode_fat_scalar, rounds);
+	bench_encode("encode", _lf12_encode_fat, rounds);
+
+	return EXIT_SUCCESS;
+}
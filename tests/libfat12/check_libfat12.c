@@ -6,16 +6,35 @@
 Suite *libfat12_suite(void)
 {
 	Suite *s;
-	TCase *tc_libfat12_directory, *tc_libfat12_io, *tc_libfat12_metadata,
-		*tc_libfat12_name, *tc_libfat12_path;
+	TCase *tc_libfat12_allocation, *tc_libfat12_arena, *tc_libfat12_cache,
+		*tc_libfat12_defrag, *tc_libfat12_device, *tc_libfat12_dir_table,
+		*tc_libfat12_directory, *tc_libfat12_fat, *tc_libfat12_index,
+		*tc_libfat12_io, *tc_libfat12_metadata, *tc_libfat12_name,
+		*tc_libfat12_path;
 
 	s = suite_create("libfat12");
+	tc_libfat12_allocation = libfat12_allocation_case();
+	tc_libfat12_arena = libfat12_arena_case();
+	tc_libfat12_cache = libfat12_cache_case();
+	tc_libfat12_defrag = libfat12_defrag_case();
+	tc_libfat12_device = libfat12_device_case();
+	tc_libfat12_dir_table = libfat12_dir_table_case();
 	tc_libfat12_directory = libfat12_directory_case();
+	tc_libfat12_fat = libfat12_fat_case();
+	tc_libfat12_index = libfat12_index_case();
 	tc_libfat12_io = libfat12_io_case();
 	tc_libfat12_metadata = libfat12_metadata_case();
 	tc_libfat12_name = libfat12_name_case();
 	tc_libfat12_path = libfat12_path_case();
+	suite_add_tcase(s, tc_libfat12_allocation);
+	suite_add_tcase(s, tc_libfat12_arena);
+	suite_add_tcase(s, tc_libfat12_cache);
+	suite_add_tcase(s, tc_libfat12_defrag);
+	suite_add_tcase(s, tc_libfat12_device);
+	suite_add_tcase(s, tc_libfat12_dir_table);
 	suite_add_tcase(s, tc_libfat12_directory);
+	suite_add_tcase(s, tc_libfat12_fat);
+	suite_add_tcase(s, tc_libfat12_index);
 	suite_add_tcase(s, tc_libfat12_io);
 	suite_add_tcase(s, tc_libfat12_metadata);
 	suite_add_tcase(s, tc_libfat12_name);
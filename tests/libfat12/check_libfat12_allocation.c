@@ -0,0 +1,194 @@
+#include <check.h>
+#include <stdlib.h>
+
+#include "tests.h"
+#include "../../src/libfat12/allocation_p.h"
+#include "../../src/libfat12/io_p.h"
+#include "../../src/libfat12/libfat12.h"
+
+static struct lf12_metadata *create_metadata(uint16_t entry_count)
+{
+	struct lf12_metadata *f12_meta =
+		calloc(1, sizeof(struct lf12_metadata));
+
+	ck_assert_ptr_nonnull(f12_meta);
+	f12_meta->bpb = calloc(1, sizeof(struct bios_parameter_block));
+	ck_assert_ptr_nonnull(f12_meta->bpb);
+	// A data area, that starts at the beginning of the partition and holds
+	// a cluster for every entry of the file allocation table
+	f12_meta->bpb->SectorSize = 512;
+	f12_meta->bpb->SectorsPerCluster = 1;
+	f12_meta->bpb->LogicalSectors = entry_count - 2;
+	f12_meta->entry_count = entry_count;
+	f12_meta->end_of_chain_marker = 0xfff;
+	f12_meta->fat_entries = calloc(entry_count, sizeof(uint16_t));
+	ck_assert_ptr_nonnull(f12_meta->fat_entries);
+
+	return f12_meta;
+}
+
+static void free_metadata(struct lf12_metadata *f12_meta)
+{
+	_lf12_drop_free_space(f12_meta);
+	free(f12_meta->fat_entries);
+	free(f12_meta->bpb);
+	free(f12_meta);
+}
+
+START_TEST(test_lf12_get_free_cluster_count)
+{
+	struct lf12_metadata *f12_meta = create_metadata(20);
+
+	f12_meta->fat_entries[4] = 5;
+	f12_meta->fat_entries[5] = 0xfff;
+	ck_assert_int_eq(16, _lf12_get_free_cluster_count(f12_meta));
+
+	// The index follows the changes of the file allocation table
+	_lf12_set_fat_entry(f12_meta, 10, 0xfff);
+	ck_assert_int_eq(15, _lf12_get_free_cluster_count(f12_meta));
+	_lf12_set_fat_entry(f12_meta, 10, 0xfff);
+	ck_assert_int_eq(15, _lf12_get_free_cluster_count(f12_meta));
+	_lf12_set_fat_entry(f12_meta, 4, 0);
+	_lf12_set_fat_entry(f12_meta, 5, 0);
+	ck_assert_int_eq(17, _lf12_get_free_cluster_count(f12_meta));
+
+	free_metadata(f12_meta);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_next_free_cluster)
+{
+	struct lf12_metadata *f12_meta = create_metadata(12);
+
+	for (int i = 2; i < 12; i++) {
+		f12_meta->fat_entries[i] = 0xfff;
+	}
+	f12_meta->fat_entries[3] = 0;
+	f12_meta->fat_entries[7] = 0;
+	f12_meta->fat_entries[8] = 0;
+
+	ck_assert_int_eq(3, _lf12_next_free_cluster(f12_meta, 0));
+	ck_assert_int_eq(7, _lf12_next_free_cluster(f12_meta, 3));
+	ck_assert_int_eq(8, _lf12_next_free_cluster(f12_meta, 7));
+	// The search wraps around at the end of the table
+	ck_assert_int_eq(3, _lf12_next_free_cluster(f12_meta, 8));
+
+	// Freeing a cluster between two free extents joins them
+	_lf12_set_fat_entry(f12_meta, 4, 0);
+	_lf12_set_fat_entry(f12_meta, 6, 0);
+	_lf12_set_fat_entry(f12_meta, 5, 0);
+	ck_assert_int_eq(5, _lf12_next_free_cluster(f12_meta, 4));
+	ck_assert_int_eq(6, _lf12_next_free_cluster(f12_meta, 5));
+
+	// Using a cluster inside a free extent splits it
+	_lf12_set_fat_entry(f12_meta, 5, 0xfff);
+	ck_assert_int_eq(6, _lf12_next_free_cluster(f12_meta, 4));
+	ck_assert_int_eq(5, _lf12_get_free_cluster_count(f12_meta));
+
+	for (int i = 2; i < 12; i++) {
+		_lf12_set_fat_entry(f12_meta, i, 0xfff);
+	}
+	ck_assert_int_eq(0, _lf12_next_free_cluster(f12_meta, 0));
+
+	free_metadata(f12_meta);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_create_cluster_chain)
+{
+	struct lf12_metadata *f12_meta = create_metadata(12);
+	uint16_t first_cluster;
+
+	f12_meta->fat_entries[3] = 0xfff;
+	first_cluster = _lf12_create_cluster_chain(f12_meta, 3);
+	ck_assert_int_eq(2, first_cluster);
+	ck_assert_int_eq(4, f12_meta->fat_entries[2]);
+	ck_assert_int_eq(5, f12_meta->fat_entries[4]);
+	ck_assert_int_eq(0xfff, f12_meta->fat_entries[5]);
+
+	// Chains larger than the free space are not created
+	ck_assert_int_eq(0, _lf12_create_cluster_chain(f12_meta, 7));
+	ck_assert_int_eq(6, _lf12_get_free_cluster_count(f12_meta));
+
+	free_metadata(f12_meta);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_choose_free_cluster)
+{
+	struct lf12_metadata *f12_meta = create_metadata(20);
+
+	// Free extents at 3-6, 9-10 and 13-19
+	for (int i = 2; i < 20; i++) {
+		if (2 == i || 7 == i || 8 == i || 11 == i || 12 == i) {
+			f12_meta->fat_entries[i] = 0xfff;
+		}
+	}
+
+	ck_assert_int_eq(3, _lf12_choose_free_cluster(f12_meta, 0, 2));
+	// A chain is continued behind its last cluster
+	ck_assert_int_eq(10, _lf12_choose_free_cluster(f12_meta, 9, 5));
+
+	f12_meta->allocation_policy = F12_ALLOC_BEST_FIT;
+	ck_assert_int_eq(9, _lf12_choose_free_cluster(f12_meta, 0, 2));
+	ck_assert_int_eq(3, _lf12_choose_free_cluster(f12_meta, 0, 3));
+	ck_assert_int_eq(13, _lf12_choose_free_cluster(f12_meta, 0, 5));
+	// The largest extent is used if none is large enough
+	ck_assert_int_eq(13, _lf12_choose_free_cluster(f12_meta, 0, 10));
+	ck_assert_int_eq(13, _lf12_choose_free_cluster(f12_meta, 0, 0));
+	ck_assert_int_eq(13, _lf12_choose_free_cluster(f12_meta, 6, 5));
+
+	f12_meta->allocation_policy = F12_ALLOC_NEXT_FIT;
+	_lf12_set_fat_entry(f12_meta, 9, 0xfff);
+	ck_assert_int_eq(10, _lf12_choose_free_cluster(f12_meta, 0, 1));
+	_lf12_set_fat_entry(f12_meta, 19, 0xfff);
+	ck_assert_int_eq(3, _lf12_choose_free_cluster(f12_meta, 0, 1));
+
+	free_metadata(f12_meta);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_free_clusters_end_with_data_area)
+{
+	struct lf12_metadata *f12_meta = create_metadata(20);
+
+	// Only the clusters 2 to 11 lie in the data area
+	f12_meta->bpb->LogicalSectors = 10;
+	ck_assert_int_eq(10, _lf12_get_free_cluster_count(f12_meta));
+	ck_assert_int_eq(2, _lf12_next_free_cluster(f12_meta, 11));
+	ck_assert_int_eq(0, _lf12_create_cluster_chain(f12_meta, 11));
+
+	// Entries behind the data area are never free
+	_lf12_set_fat_entry(f12_meta, 15, 0xfff);
+	_lf12_set_fat_entry(f12_meta, 15, 0);
+	ck_assert_int_eq(10, _lf12_get_free_cluster_count(f12_meta));
+
+	free_metadata(f12_meta);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+TCase *libfat12_allocation_case(void)
+{
+	TCase *tc_libfat12_allocation;
+
+	tc_libfat12_allocation = tcase_create("libfat12 allocation");
+	tcase_add_test(tc_libfat12_allocation,
+		       test_lf12_get_free_cluster_count);
+	tcase_add_test(tc_libfat12_allocation, test_lf12_next_free_cluster);
+	tcase_add_test(tc_libfat12_allocation, test_lf12_create_cluster_chain);
+	tcase_add_test(tc_libfat12_allocation, test_lf12_choose_free_cluster);
+	tcase_add_test(tc_libfat12_allocation,
+		       test_lf12_free_clusters_end_with_data_area);
+
+	return tc_libfat12_allocation;
+}
@@ -0,0 +1,79 @@
+#include <check.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "tests.h"
+#include "../../src/libfat12/arena_p.h"
+
+static int is_zeroed(const char *memory, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		if (0 != memory[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+START_TEST(test_lf12_arena_alloc)
+{
+	struct lf12_arena *arena = _lf12_create_arena();
+	char *memory, *previous = NULL;
+
+	ck_assert_ptr_nonnull(arena);
+
+	// Odd sizes must not break the alignment of the following allocations
+	for (size_t size = 1; size < 4096; size += 37) {
+		memory = _lf12_arena_alloc(arena, size);
+		ck_assert_ptr_nonnull(memory);
+		ck_assert_uint_eq(0, (uintptr_t) memory %
+				  _Alignof(max_align_t));
+		ck_assert_int_eq(1, is_zeroed(memory, size));
+		ck_assert_ptr_ne(previous, memory);
+		memory[size - 1] = 1;
+		previous = memory;
+	}
+
+	_lf12_free_arena(arena);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_arena_alloc_large)
+{
+	struct lf12_arena *arena = _lf12_create_arena();
+	char *small, *large, *after;
+	size_t large_size = 1024 * 1024;
+
+	ck_assert_ptr_nonnull(arena);
+
+	small = _lf12_arena_alloc(arena, 16);
+	ck_assert_ptr_nonnull(small);
+	large = _lf12_arena_alloc(arena, large_size);
+	ck_assert_ptr_nonnull(large);
+	ck_assert_int_eq(1, is_zeroed(large, large_size));
+	large[large_size - 1] = 1;
+	// The large allocation does not waste the rest of the current block
+	after = _lf12_arena_alloc(arena, 16);
+	ck_assert_ptr_eq(small + 16, after);
+
+	_lf12_free_arena(arena);
+	_lf12_free_arena(NULL);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+TCase *libfat12_arena_case(void)
+{
+	TCase *tc_libfat12_arena;
+
+	tc_libfat12_arena = tcase_create("libfat12 arena");
+	tcase_add_test(tc_libfat12_arena, test_lf12_arena_alloc);
+	tcase_add_test(tc_libfat12_arena, test_lf12_arena_alloc_large);
+
+	return tc_libfat12_arena;
+}
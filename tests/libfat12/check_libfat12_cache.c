@@ -0,0 +1,135 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/libfat12/libfat12.h"
+#include "tests.h"
+
+START_TEST(test_lf12_cached_device_write_back)
+{
+	enum lf12_error err;
+	struct lf12_device *backing, *device;
+	char image[64] = { 0 };
+	char zeros[64] = { 0 };
+	char read_back[8];
+
+	err = lf12_open_memory_device(image, sizeof(image), &backing);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_open_cached_device(backing, 16, 4, &device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	// A write spanning two blocks stays in the cache
+	err = lf12_device_write(device, "CACHED", 6, 13);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(image, zeros, sizeof(image));
+
+	err = lf12_device_read(device, read_back, 6, 13);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(read_back, "CACHED", 6);
+
+	err = lf12_device_flush(device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(image + 13, "CACHED", 6);
+
+	// Reads past the end of the device fail
+	err = lf12_device_read(device, read_back, 8, 60);
+	ck_assert_int_eq(err, F12_IO_ERROR);
+
+	err = lf12_close_device(device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_cached_device_eviction)
+{
+	enum lf12_error err;
+	struct lf12_device *backing, *device;
+	char image[64] = { 0 };
+	char read_back[4];
+
+	err = lf12_open_memory_device(image, sizeof(image), &backing);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_open_cached_device(backing, 16, 2, &device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	err = lf12_device_write(device, "AAAA", 4, 0);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_write(device, "BBBB", 4, 16);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_int_eq(image[0], 0);
+
+	// The third block evicts the least recently used first block
+	err = lf12_device_write(device, "CCCC", 4, 32);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(image, "AAAA", 4);
+	ck_assert_int_eq(image[16], 0);
+
+	// Reading the first block again loads the written back data
+	err = lf12_device_read(device, read_back, 4, 0);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(read_back, "AAAA", 4);
+
+	// Closing the device writes all remaining blocks back
+	err = lf12_close_device(device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(image + 16, "BBBB", 4);
+	ck_assert_mem_eq(image + 32, "CCCC", 4);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_cached_device_drop)
+{
+	enum lf12_error err;
+	struct lf12_device *backing, *device;
+	char image[64] = { 0 };
+	char zeros[64] = { 0 };
+	char read_back[4];
+	off_t size;
+
+	err = lf12_open_memory_device(image, 48, &backing);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_open_cached_device(backing, 16, 2, &device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	err = lf12_device_write(device, "AAAA", 4, 0);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_write(device, "BBBB", 4, 16);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	// The third block evicts and writes back the first block
+	err = lf12_device_write(device, "CCCC", 4, 32);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	// Dropped blocks are not written back, evicted blocks stay written
+	err = lf12_device_drop(device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_read(device, read_back, 4, 16);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(read_back, zeros, 4);
+	err = lf12_device_size(device, &size);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_int_eq(size, 48);
+
+	err = lf12_close_device(device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(image, "AAAA", 4);
+	ck_assert_mem_eq(image + 4, zeros, sizeof(image) - 4);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+TCase *libfat12_cache_case(void)
+{
+	TCase *tc_libfat12_cache;
+
+	tc_libfat12_cache = tcase_create("libfat12 cache");
+	tcase_add_test(tc_libfat12_cache, test_lf12_cached_device_write_back);
+	tcase_add_test(tc_libfat12_cache, test_lf12_cached_device_eviction);
+	tcase_add_test(tc_libfat12_cache, test_lf12_cached_device_drop);
+
+	return tc_libfat12_cache;
+}
@@ -0,0 +1,257 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tests.h"
+#include "../../src/libfat12/io_p.h"
+#include "../../src/libfat12/libfat12.h"
+
+static struct lf12_metadata *create_metadata(struct lf12_device *device)
+{
+	enum lf12_error err;
+	struct lf12_metadata *f12_meta;
+	struct bios_parameter_block *bpb;
+
+	err = lf12_create_metadata(&f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	bpb = f12_meta->bpb;
+	bpb->SectorSize = 512;
+	bpb->SectorsPerCluster = 1;
+	bpb->ReservedForBoot = 1;
+	bpb->NumberOfFats = 1;
+	bpb->SectorsPerFat = 1;
+	bpb->RootDirEntries = 16;
+	bpb->LogicalSectors = 64;
+	bpb->LargeSectors = 64;
+	f12_meta->root_dir_offset = 2 * 512;
+	err = lf12_create_root_dir_meta(f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_create_image(device, f12_meta, F12_CREATE_ZEROED);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	return f12_meta;
+}
+
+static struct lf12_directory_entry *create_entry(struct lf12_metadata
+						 *f12_meta, const char *name)
+{
+	enum lf12_error err;
+	struct lf12_directory_entry *entry;
+	struct lf12_path *path;
+
+	err = lf12_parse_path(name, &path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_create_entry_from_path(f12_meta, path, &entry);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	lf12_free_path(path);
+
+	return entry;
+}
+
+static void link_clusters(struct lf12_metadata *f12_meta,
+			  struct lf12_directory_entry *entry,
+			  const uint16_t *clusters, int count)
+{
+	entry->FirstCluster = clusters[0];
+	entry->FileSize = count * 512;
+	for (int i = 0; i < count - 1; i++) {
+		f12_meta->fat_entries[clusters[i]] = clusters[i + 1];
+	}
+	f12_meta->fat_entries[clusters[count - 1]] = 0xfff;
+}
+
+static void fill_clusters(char *image, struct lf12_metadata *f12_meta,
+			  const uint16_t *clusters, int count, char first)
+{
+	for (int i = 0; i < count; i++) {
+		memset(image + _lf12_cluster_offset(clusters[i], f12_meta),
+		       first + i, 512);
+	}
+}
+
+START_TEST(test_lf12_defragment)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	struct lf12_directory_entry *x, *w, *z;
+	struct lf12_defrag_stats stats;
+	const uint16_t x_clusters[] = { 2, 3 };
+	const uint16_t w_clusters[] = { 4, 5, 10, 11 };
+	const uint16_t z_clusters[] = { 7, 8, 9 };
+	const uint16_t new_z_clusters[] = { 9, 10, 11 };
+	char expected[512];
+	char *image = calloc(64, 512);
+
+	ck_assert_ptr_nonnull(image);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	f12_meta = create_metadata(device);
+
+	x = create_entry(f12_meta, "X");
+	w = create_entry(f12_meta, "W");
+	z = create_entry(f12_meta, "Z");
+	link_clusters(f12_meta, x, x_clusters, 2);
+	link_clusters(f12_meta, w, w_clusters, 4);
+	link_clusters(f12_meta, z, z_clusters, 3);
+	fill_clusters(image, f12_meta, w_clusters, 4, 'a');
+	fill_clusters(image, f12_meta, z_clusters, 3, 'A');
+	// A bad cluster stays where it is
+	f12_meta->fat_entries[6] = LF12_CLUSTER_BAD;
+	memset(image + _lf12_cluster_offset(6, f12_meta), 0xee, 512);
+
+	err = lf12_defragment(device, f12_meta, 1, &stats);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_int_eq(3, stats.chain_count);
+	ck_assert_int_eq(4, stats.extents_before);
+	ck_assert_int_eq(4, stats.extents_after);
+	ck_assert_int_eq(5, stats.moved_clusters);
+	// A dry run changes nothing
+	ck_assert_int_eq(10, f12_meta->fat_entries[5]);
+	ck_assert_int_eq(7, z->FirstCluster);
+
+	err = lf12_defragment(device, f12_meta, 0, &stats);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_int_eq(2, x->FirstCluster);
+	ck_assert_int_eq(4, w->FirstCluster);
+	ck_assert_int_eq(7, f12_meta->fat_entries[5]);
+	ck_assert_int_eq(8, f12_meta->fat_entries[7]);
+	ck_assert_int_eq(0xfff, f12_meta->fat_entries[8]);
+	ck_assert_int_eq(9, z->FirstCluster);
+	ck_assert_int_eq(10, f12_meta->fat_entries[9]);
+	ck_assert_int_eq(11, f12_meta->fat_entries[10]);
+	ck_assert_int_eq(0xfff, f12_meta->fat_entries[11]);
+	ck_assert_int_eq(LF12_CLUSTER_BAD, f12_meta->fat_entries[6]);
+	ck_assert_int_eq(1, f12_meta->root_dir->dirty);
+
+	// The data moved with the clusters
+	memset(expected, 'c', 512);
+	ck_assert_mem_eq(image + _lf12_cluster_offset(7, f12_meta),
+			 expected, 512);
+	for (int i = 0; i < 3; i++) {
+		memset(expected, 'A' + i, 512);
+		ck_assert_mem_eq(image +
+				 _lf12_cluster_offset(new_z_clusters[i],
+						      f12_meta), expected, 512);
+	}
+	memset(expected, 0xee, 512);
+	ck_assert_mem_eq(image + _lf12_cluster_offset(6, f12_meta),
+			 expected, 512);
+
+	lf12_free_metadata(f12_meta);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_defragment_directories)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	struct lf12_directory_entry *x, *d, *e, *f;
+	struct lf12_defrag_stats stats;
+	char *image = calloc(64, 512);
+
+	ck_assert_ptr_nonnull(image);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	f12_meta = create_metadata(device);
+
+	x = create_entry(f12_meta, "X");
+	x->FirstCluster = _lf12_create_cluster_chain(f12_meta, 1);
+	create_entry(f12_meta, "D/E/G");
+	f = create_entry(f12_meta, "D/F");
+	f->FirstCluster = _lf12_create_cluster_chain(f12_meta, 1);
+	d = f->parent;
+	e = &d->children[2];
+	ck_assert_int_eq(3, d->FirstCluster);
+	ck_assert_int_eq(19, e->FirstCluster);
+	ck_assert_int_eq(35, f->FirstCluster);
+	d->children[0].FirstCluster = d->FirstCluster;
+	e->children[0].FirstCluster = e->FirstCluster;
+	e->children[1].FirstCluster = d->FirstCluster;
+	err = lf12_unlink_entry(device, f12_meta, x);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	e->dirty = 0;
+
+	err = lf12_defragment(device, f12_meta, 0, &stats);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_int_eq(3, stats.chain_count);
+	ck_assert_int_eq(17, stats.moved_clusters);
+
+	// The files of a directory follow its table
+	ck_assert_int_eq(2, d->FirstCluster);
+	ck_assert_int_eq(18, f->FirstCluster);
+	ck_assert_int_eq(19, e->FirstCluster);
+	// The dot directories point to the new position
+	ck_assert_int_eq(2, d->children[0].FirstCluster);
+	ck_assert_int_eq(19, e->children[0].FirstCluster);
+	ck_assert_int_eq(2, e->children[1].FirstCluster);
+	ck_assert_int_eq(1, e->dirty);
+
+	err = lf12_write_metadata(device, f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	lf12_free_metadata(f12_meta);
+	err = lf12_read_metadata(device, &f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	d = &f12_meta->root_dir->children[1];
+	ck_assert_mem_eq(d->ShortFileName, "D       ", 8);
+	ck_assert_int_eq(2, d->FirstCluster);
+	ck_assert_int_eq(2, d->children[2].children[1].FirstCluster);
+	ck_assert_mem_eq(d->children[3].ShortFileName, "F       ", 8);
+	ck_assert_int_eq(18, d->children[3].FirstCluster);
+
+	lf12_free_metadata(f12_meta);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_defragment_invalid_chain)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	struct lf12_directory_entry *x, *y;
+	struct lf12_defrag_stats stats;
+	const uint16_t x_clusters[] = { 2, 3 };
+	char *image = calloc(64, 512);
+
+	ck_assert_ptr_nonnull(image);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	f12_meta = create_metadata(device);
+
+	x = create_entry(f12_meta, "X");
+	y = create_entry(f12_meta, "Y");
+	link_clusters(f12_meta, x, x_clusters, 2);
+	// Two files share a cluster
+	y->FirstCluster = 3;
+
+	err = lf12_defragment(device, f12_meta, 0, &stats);
+	ck_assert_int_eq(F12_INVALID_CHAIN, err);
+
+	lf12_free_metadata(f12_meta);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+TCase *libfat12_defrag_case(void)
+{
+	TCase *tc_libfat12_defrag;
+
+	tc_libfat12_defrag = tcase_create("libfat12 defrag");
+	tcase_add_test(tc_libfat12_defrag, test_lf12_defragment);
+	tcase_add_test(tc_libfat12_defrag, test_lf12_defragment_directories);
+	tcase_add_test(tc_libfat12_defrag, test_lf12_defragment_invalid_chain);
+
+	return tc_libfat12_defrag;
+}
@@ -0,0 +1,208 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../../src/libfat12/libfat12.h"
+#include "tests.h"
+
+START_TEST(test_lf12_memory_device)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	char buffer[16] = { 0 };
+	char data[4] = { 'F', 'A', 'T', '!' };
+	char read_back[4];
+	off_t size;
+
+	err = lf12_open_memory_device(buffer, sizeof(buffer), &device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	err = lf12_device_size(device, &size);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_int_eq(size, 16);
+
+	err = lf12_device_write(device, data, 4, 12);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(buffer + 12, data, 4);
+
+	err = lf12_device_read(device, read_back, 4, 12);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(read_back, data, 4);
+
+	// Accesses beyond the end of the buffer must fail
+	err = lf12_device_write(device, data, 4, 13);
+	ck_assert_int_eq(err, F12_IO_ERROR);
+	err = lf12_device_read(device, read_back, 4, 16);
+	ck_assert_int_eq(err, F12_IO_ERROR);
+
+	ck_assert_ptr_eq(lf12_device_map(device, 4, 12), buffer + 12);
+	ck_assert_ptr_null(lf12_device_map(device, 4, 13));
+
+	// The memory device writes vectors buffer by buffer
+	struct iovec iov[2] = {
+		{.iov_base = data,.iov_len = 2 },
+		{.iov_base = data + 3,.iov_len = 1 },
+	};
+	err = lf12_device_writev(device, iov, 2, 0);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(buffer, "FA!", 3);
+
+	err = lf12_close_device(device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_fd_device)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	FILE *fp = tmpfile();
+	char data[4] = { 'F', 'A', 'T', '!' };
+	char read_back[4];
+	off_t size;
+
+	ck_assert_ptr_nonnull(fp);
+
+	err = lf12_open_fd_device(dup(fileno(fp)), &device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	err = lf12_device_write(device, data, 4, 508);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	err = lf12_device_size(device, &size);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_int_eq(size, 512);
+
+	err = lf12_device_read(device, read_back, 4, 508);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(read_back, data, 4);
+
+	// Reading past the end of the file must fail
+	err = lf12_device_read(device, read_back, 4, 510);
+	ck_assert_int_eq(err, F12_IO_ERROR);
+
+	// The file descriptor device does not map the image into the memory
+	ck_assert_ptr_null(lf12_device_map(device, 4, 508));
+
+	struct iovec iov[2] = {
+		{.iov_base = data,.iov_len = 2 },
+		{.iov_base = data + 3,.iov_len = 1 },
+	};
+	err = lf12_device_writev(device, iov, 2, 100);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_read(device, read_back, 3, 100);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(read_back, "FA!", 3);
+
+	// Growing the device appends zeros
+	err = lf12_device_resize(device, 1024, 0);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_size(device, &size);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_int_eq(size, 1024);
+	err = lf12_device_read(device, read_back, 4, 1020);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(read_back, "\0\0\0\0", 4);
+
+	// Discarded ranges read as zeros
+	err = lf12_device_discard(device, 64, 64);
+	if (F12_UNSUPPORTED != err) {
+		ck_assert_int_eq(err, F12_SUCCESS);
+		err = lf12_device_read(device, read_back, 3, 100);
+		ck_assert_int_eq(err, F12_SUCCESS);
+		ck_assert_mem_eq(read_back, "\0\0\0", 3);
+	}
+
+	err = lf12_device_resize(device, 512, 1);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_size(device, &size);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_int_eq(size, 512);
+
+	err = lf12_close_device(device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	err = lf12_open_mmap_device(dup(fileno(fp)), 1, &device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	err = lf12_device_read(device, read_back, 4, 508);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(read_back, data, 4);
+	ck_assert_mem_eq(lf12_device_map(device, 4, 508), data, 4);
+
+	err = lf12_device_write(device, "FAT?", 4, 0);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	err = lf12_close_device(device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	ck_assert_int_eq(4, pread(fileno(fp), read_back, 4, 0));
+	ck_assert_mem_eq(read_back, "FAT?", 4);
+
+	fclose(fp);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_device_copy)
+{
+	enum lf12_error err;
+	struct lf12_device *device, *cached;
+	FILE *image = tmpfile();
+	FILE *file = tmpfile();
+	char read_back[4];
+
+	ck_assert_ptr_nonnull(image);
+	ck_assert_ptr_nonnull(file);
+	ck_assert_int_eq(4, pwrite(fileno(file), "FAT!", 4, 0));
+
+	err = lf12_open_fd_device(dup(fileno(image)), &device);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_write(device, "1234", 4, 508);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	err = lf12_open_cached_device(device, 16, 4, &cached);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	// Data copied into the device replaces its cached blocks
+	err = lf12_device_read(cached, read_back, 4, 508);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_copy_from_fd(cached, fileno(file), 4, 508);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_read(cached, read_back, 4, 508);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_mem_eq(read_back, "FAT!", 4);
+
+	// Modified cached blocks are written back before they are copied
+	err = lf12_device_write(cached, "F", 1, 511);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	err = lf12_device_copy_to_fd(cached, fileno(file), 4, 508);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_int_eq(4, pread(fileno(file), read_back, 4, 4));
+	ck_assert_mem_eq(read_back, "FATF", 4);
+
+	err = lf12_close_device(cached);
+	ck_assert_int_eq(err, F12_SUCCESS);
+
+	fclose(image);
+	fclose(file);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+TCase *libfat12_device_case(void)
+{
+	TCase *tc_libfat12_device;
+
+	tc_libfat12_device = tcase_create("libfat12 device");
+	tcase_add_test(tc_libfat12_device, test_lf12_memory_device);
+	tcase_add_test(tc_libfat12_device, test_lf12_fd_device);
+	tcase_add_test(tc_libfat12_device, test_lf12_device_copy);
+
+	return tc_libfat12_device;
+}
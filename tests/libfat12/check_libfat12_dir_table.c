@@ -0,0 +1,166 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tests.h"
+#include "../../src/libfat12/io_p.h"
+#include "../../src/libfat12/libfat12.h"
+
+static struct lf12_metadata *create_metadata(struct lf12_device *device)
+{
+	enum lf12_error err;
+	struct lf12_metadata *f12_meta;
+	struct bios_parameter_block *bpb;
+
+	err = lf12_create_metadata(&f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	bpb = f12_meta->bpb;
+	bpb->SectorSize = 512;
+	bpb->SectorsPerCluster = 1;
+	bpb->ReservedForBoot = 1;
+	bpb->NumberOfFats = 1;
+	bpb->SectorsPerFat = 1;
+	bpb->RootDirEntries = 16;
+	bpb->LogicalSectors = 64;
+	bpb->LargeSectors = 64;
+	f12_meta->root_dir_offset = 2 * 512;
+	err = lf12_create_root_dir_meta(f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_create_image(device, f12_meta, F12_CREATE_ZEROED);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	return f12_meta;
+}
+
+static struct lf12_directory_entry *create_entry(struct lf12_metadata
+						 *f12_meta, const char *name)
+{
+	enum lf12_error err;
+	struct lf12_directory_entry *entry;
+	struct lf12_path *path;
+
+	err = lf12_parse_path(name, &path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_create_entry_from_path(f12_meta, path, &entry);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	lf12_free_path(path);
+
+	return entry;
+}
+
+START_TEST(test_lf12_open_dir_table)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	struct lf12_directory_entry *x, *y, *f;
+	struct lf12_dir_table *table;
+	const char *raw_entry;
+	char *image = calloc(64, 512);
+
+	ck_assert_ptr_nonnull(image);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	f12_meta = create_metadata(device);
+
+	x = create_entry(f12_meta, "X");
+	x->FirstCluster = _lf12_create_cluster_chain(f12_meta, 1);
+	y = create_entry(f12_meta, "Y");
+	y->FirstCluster = _lf12_create_cluster_chain(f12_meta, 1);
+	y->FileSize = 123;
+	err = lf12_unlink_entry(device, f12_meta, x);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	// The table of D starts in the cluster of X and continues behind Y
+	f = create_entry(f12_meta, "D/F");
+	ck_assert_int_eq(2, f->parent->FirstCluster);
+	err = lf12_write_metadata(device, f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	err = lf12_open_dir_table(device, f12_meta, 0, &table);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_int_eq(16, lf12_dir_table_size(table));
+	ck_assert_int_eq(2, lf12_dir_table_child_count(table));
+	ck_assert_int_eq(2, lf12_dir_table_find_free(table));
+	// D took the entry of X
+	raw_entry = lf12_dir_table_entry(table, 0);
+	ck_assert_mem_eq("D          ", raw_entry, 11);
+	ck_assert_int_eq(1, lf12_raw_entry_is_directory(raw_entry));
+	ck_assert_int_eq(0, lf12_raw_entry_is_dot_dir(raw_entry));
+	ck_assert_int_eq(2, lf12_raw_entry_first_cluster(raw_entry));
+	raw_entry = lf12_dir_table_entry(table, 1);
+	ck_assert_mem_eq("Y          ", raw_entry, 11);
+	ck_assert_int_eq(0, lf12_raw_entry_is_directory(raw_entry));
+	ck_assert_int_eq(3, lf12_raw_entry_first_cluster(raw_entry));
+	ck_assert_int_eq(123, lf12_raw_entry_file_size(raw_entry));
+	ck_assert_int_eq(1, lf12_raw_entry_is_empty(lf12_dir_table_entry(table,
+									  2)));
+	lf12_close_dir_table(table);
+
+	err = lf12_open_dir_table(device, f12_meta, 2, &table);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	// The table fills its 16 clusters
+	ck_assert_int_eq(256, lf12_dir_table_size(table));
+	ck_assert_int_eq(3, lf12_dir_table_child_count(table));
+	ck_assert_int_eq(1, lf12_raw_entry_is_dot_dir(lf12_dir_table_entry
+						       (table, 0)));
+	ck_assert_int_eq(1, lf12_raw_entry_is_dot_dir(lf12_dir_table_entry
+						       (table, 1)));
+	ck_assert_mem_eq("F          ", lf12_dir_table_entry(table, 2), 11);
+	lf12_close_dir_table(table);
+
+	err = lf12_open_dir_table(device, f12_meta, 1, &table);
+	ck_assert_int_eq(F12_INVALID_CHAIN, err);
+
+	lf12_free_metadata(f12_meta);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_count_entries)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	int file_count, dir_count;
+	char *image = calloc(64, 512);
+
+	ck_assert_ptr_nonnull(image);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	f12_meta = create_metadata(device);
+
+	create_entry(f12_meta, "A");
+	create_entry(f12_meta, "D/E/G");
+	create_entry(f12_meta, "D/F");
+	err = lf12_write_metadata(device, f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	err = lf12_count_entries(device, f12_meta, &file_count, &dir_count);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_int_eq(lf12_get_file_count(f12_meta->root_dir), file_count);
+	ck_assert_int_eq(lf12_get_directory_count(f12_meta->root_dir),
+			 dir_count);
+	ck_assert_int_eq(3, file_count);
+	ck_assert_int_eq(2, dir_count);
+
+	lf12_free_metadata(f12_meta);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+TCase *libfat12_dir_table_case(void)
+{
+	TCase *tc_libfat12_dir_table;
+
+	tc_libfat12_dir_table = tcase_create("libfat12 dir_table");
+	tcase_add_test(tc_libfat12_dir_table, test_lf12_open_dir_table);
+	tcase_add_test(tc_libfat12_dir_table, test_lf12_count_entries);
+
+	return tc_libfat12_dir_table;
+}
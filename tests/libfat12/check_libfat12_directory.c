@@ -1,8 +1,10 @@
 #include <check.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "tests.h"
+#include "../../src/libfat12/directory_entry_p.h"
 #include "../../src/libfat12/libfat12.h"
 
 /*
@@ -170,6 +172,85 @@ START_TEST(test_lf12_move_entry)
 END_TEST
 // *INDENT-ON*
 
+START_TEST(test_lf12_find_child)
+{
+	struct lf12_directory_entry *child;
+
+	ck_assert_ptr_eq(&dir->children[5],
+			 _lf12_find_child(dir, "FILE3   ", "TXT"));
+	ck_assert_ptr_null(_lf12_find_child(dir, "FILE3   ", "D  "));
+
+	// The index follows removed and added children
+	_lf12_unindex_child(dir, &dir->children[5]);
+	memset(&dir->children[5], 0, sizeof(struct lf12_directory_entry));
+	ck_assert_ptr_null(_lf12_find_child(dir, "FILE3   ", "TXT"));
+	ck_assert_ptr_eq(&dir->children[6],
+			 _lf12_find_child(dir, "FILE4   ", "D  "));
+
+	child = _lf12_find_free_child(dir);
+	ck_assert_ptr_eq(&dir->children[5], child);
+	memcpy(child->ShortFileName, "NEW     ", 8);
+	memcpy(child->ShortFileExtension, "TXT", 3);
+	_lf12_index_child(dir, child);
+	ck_assert_ptr_eq(child, _lf12_find_child(dir, "NEW     ", "TXT"));
+	ck_assert_ptr_eq(&dir->children[7], _lf12_find_free_child(dir));
+
+	// Moved entries are found in their new directory only
+	lf12_move_entry(&dir->children[3], &dir->children[0]);
+	ck_assert_ptr_null(_lf12_find_child(dir, "FILE1   ", "TXT"));
+	ck_assert_ptr_eq(&dir->children[0].children[3],
+			 _lf12_find_child(&dir->children[0], "FILE1   ",
+					  "TXT"));
+	ck_assert_ptr_eq(&dir->children[3], _lf12_find_free_child(dir));
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_find_child_many)
+{
+	struct lf12_directory_entry big_dir = { 0 };
+	char name[9];
+
+	big_dir.FileAttributes = LF12_ATTR_SUBDIRECTORY;
+	big_dir.child_count = 224;
+	big_dir.children = calloc(224, sizeof(struct lf12_directory_entry));
+	ck_assert_ptr_nonnull(big_dir.children);
+	for (int i = 0; i < 224; i++) {
+		snprintf(name, sizeof(name), "N%03d    ", i);
+		memcpy(big_dir.children[i].ShortFileName, name, 8);
+		memcpy(big_dir.children[i].ShortFileExtension, "   ", 3);
+		big_dir.children[i].parent = &big_dir;
+	}
+
+	// Remove every third child
+	for (int i = 0; i < 224; i += 3) {
+		_lf12_find_child(&big_dir, "N000    ", "   ");
+		_lf12_unindex_child(&big_dir, &big_dir.children[i]);
+		memset(&big_dir.children[i], 0,
+		       sizeof(struct lf12_directory_entry));
+	}
+
+	for (int i = 0; i < 224; i++) {
+		snprintf(name, sizeof(name), "N%03d    ", i);
+		if (0 == i % 3) {
+			ck_assert_ptr_null(_lf12_find_child(&big_dir, name,
+							    "   "));
+		} else {
+			ck_assert_ptr_eq(&big_dir.children[i],
+					 _lf12_find_child(&big_dir, name,
+							  "   "));
+		}
+	}
+	ck_assert_ptr_eq(&big_dir.children[0],
+			 _lf12_find_free_child(&big_dir));
+
+	lf12_free_entry(&big_dir);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
 TCase *libfat12_directory_case(void)
 {
 	TCase *tc_libfat12_directory;
@@ -183,6 +264,8 @@ TCase *libfat12_directory_case(void)
 	tcase_add_test(tc_libfat12_directory, test_lf12_get_file_count);
 	tcase_add_test(tc_libfat12_directory, test_lf12_get_directory_count);
 	tcase_add_test(tc_libfat12_directory, test_lf12_move_entry);
+	tcase_add_test(tc_libfat12_directory, test_lf12_find_child);
+	tcase_add_test(tc_libfat12_directory, test_lf12_find_child_many);
 
 	return tc_libfat12_directory;
 }
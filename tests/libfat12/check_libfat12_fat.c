@@ -0,0 +1,104 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tests.h"
+#include "../../src/libfat12/fat_p.h"
+#include "../../src/libfat12/io_p.h"
+
+START_TEST(test_lf12_decode_fat)
+{
+	uint16_t entries[5];
+	// Test File Allocation Table with 5 clusters: 0x123, 0xabc, 0x161,
+	// 0x315, 0xfff
+	const char fat[] = {
+		0x23, 0xc1, 0xab, 0x61, 0x51, 0x31, 0xff, 0x0f,
+	};
+
+	_lf12_decode_fat(fat, entries, 5);
+	ck_assert_int_eq(0x123, entries[0]);
+	ck_assert_int_eq(0xabc, entries[1]);
+	ck_assert_int_eq(0x161, entries[2]);
+	ck_assert_int_eq(0x315, entries[3]);
+	ck_assert_int_eq(0xfff, entries[4]);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_encode_fat)
+{
+	const uint16_t entries[] = { 0x123, 0xabc, 0x161, 0x315, 0xfff };
+	const char expected[] = {
+		0x23, 0xc1, 0xab, 0x61, 0x51, 0x31, 0xff, 0x0f,
+	};
+	char fat[8];
+
+	_lf12_encode_fat(entries, 5, fat);
+	ck_assert_mem_eq(expected, fat, 8);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_fat_codec)
+{
+	// Cover the tails of the vector implementations and a full table
+	const size_t counts[] = { 0, 1, 2, 3, 10, 11, 12, 19, 20, 27, 4086 };
+	uint16_t *entries, *decoded;
+	char *fat, *scalar_fat;
+	size_t count, fat_size;
+
+	srand(12);
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		count = counts[c];
+		fat_size = (count * 3 + 1) / 2;
+		// Allocate one byte more, so that malloc never returns NULL
+		entries = malloc(count * sizeof(uint16_t) + 1);
+		decoded = malloc(count * sizeof(uint16_t) + 1);
+		fat = malloc(fat_size + 1);
+		scalar_fat = malloc(fat_size + 1);
+		ck_assert_ptr_nonnull(entries);
+		ck_assert_ptr_nonnull(decoded);
+		ck_assert_ptr_nonnull(fat);
+		ck_assert_ptr_nonnull(scalar_fat);
+
+		for (size_t i = 0; i < count; i++) {
+			entries[i] = rand() & 0xfff;
+		}
+
+		_lf12_encode_fat(entries, count, fat);
+		_lf12_encode_fat_scalar(entries, count, scalar_fat);
+		ck_assert_mem_eq(scalar_fat, fat, fat_size);
+		for (size_t i = 0; i < count; i++) {
+			ck_assert_int_eq(entries[i],
+					 _lf12_read_fat_entry(fat, i));
+		}
+
+		_lf12_decode_fat(fat, decoded, count);
+		ck_assert_mem_eq(entries, decoded, count * sizeof(uint16_t));
+		memset(decoded, 0, count * sizeof(uint16_t));
+		_lf12_decode_fat_scalar(fat, decoded, count);
+		ck_assert_mem_eq(entries, decoded, count * sizeof(uint16_t));
+
+		free(entries);
+		free(decoded);
+		free(fat);
+		free(scalar_fat);
+	}
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+TCase *libfat12_fat_case(void)
+{
+	TCase *tc_libfat12_fat;
+
+	tc_libfat12_fat = tcase_create("libfat12 fat");
+	tcase_add_test(tc_libfat12_fat, test_lf12_decode_fat);
+	tcase_add_test(tc_libfat12_fat, test_lf12_encode_fat);
+	tcase_add_test(tc_libfat12_fat, test_lf12_fat_codec);
+
+	return tc_libfat12_fat;
+}
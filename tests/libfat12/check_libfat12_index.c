@@ -0,0 +1,198 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/libfat12/libfat12.h"
+#include "tests.h"
+
+static struct lf12_metadata *create_image(struct lf12_device *device)
+{
+	enum lf12_error err;
+	struct lf12_metadata *f12_meta;
+	struct bios_parameter_block *bpb;
+	struct lf12_directory_entry *entry;
+	struct lf12_path *path;
+
+	err = lf12_create_metadata(&f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	bpb = f12_meta->bpb;
+	bpb->SectorSize = 512;
+	bpb->SectorsPerCluster = 1;
+	bpb->ReservedForBoot = 1;
+	bpb->NumberOfFats = 1;
+	bpb->SectorsPerFat = 1;
+	bpb->RootDirEntries = 16;
+	bpb->LogicalSectors = 64;
+	bpb->LargeSectors = 64;
+	f12_meta->root_dir_offset = 2 * 512;
+	err = lf12_create_root_dir_meta(f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_create_image(device, f12_meta, F12_CREATE_ZEROED);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	err = lf12_parse_path("A/B/FILE.TXT", &path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_create_entry_from_path(f12_meta, path, &entry);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	lf12_free_path(path);
+	err = lf12_write_metadata(device, f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	return f12_meta;
+}
+
+START_TEST(test_lf12_read_index)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta, *indexed_meta;
+	struct lf12_directory_entry *dir_a, *dir_b;
+	struct lf12_index_key key = { 1, 2, 64 * 512, 3, 4 };
+	char *image = calloc(64, 512);
+	FILE *index = tmpfile();
+
+	ck_assert_ptr_nonnull(image);
+	ck_assert_ptr_nonnull(index);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	f12_meta = create_image(device);
+
+	err = lf12_write_index(fileno(index), &key, f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_read_index(fileno(index), &key, &indexed_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	ck_assert_int_eq(512, indexed_meta->bpb->SectorSize);
+	ck_assert_int_eq(f12_meta->root_dir_offset,
+			 indexed_meta->root_dir_offset);
+	ck_assert_int_eq(f12_meta->entry_count, indexed_meta->entry_count);
+	ck_assert_mem_eq(f12_meta->fat_entries, indexed_meta->fat_entries,
+			 f12_meta->entry_count * sizeof(uint16_t));
+	ck_assert_int_eq(f12_meta->end_of_chain_marker,
+			 indexed_meta->end_of_chain_marker);
+
+	// Nothing of the restored metadata needs to be written to the image
+	ck_assert_int_eq(0, indexed_meta->bpb_dirty);
+	ck_assert_int_eq(0, indexed_meta->root_dir->dirty);
+	for (int i = 0; i < indexed_meta->bpb->SectorsPerFat; i++) {
+		ck_assert_int_eq(0, indexed_meta->dirty_fat_sectors[i]);
+	}
+
+	// The whole directory tree is restored
+	dir_a = &indexed_meta->root_dir->children[0];
+	ck_assert_mem_eq(dir_a->ShortFileName, "A       ", 8);
+	ck_assert_int_eq(f12_meta->root_dir->children[0].FirstCluster,
+			 dir_a->FirstCluster);
+	ck_assert_ptr_nonnull(dir_a->children);
+	ck_assert_ptr_eq(dir_a->children, dir_a->children[0].children);
+	dir_b = &dir_a->children[2];
+	ck_assert_mem_eq(dir_b->ShortFileName, "B       ", 8);
+	ck_assert_ptr_eq(dir_a, dir_b->parent);
+	ck_assert_ptr_eq(dir_a->children, dir_b->children[1].children);
+	ck_assert_mem_eq(dir_b->children[2].ShortFileName, "FILE    ", 8);
+	ck_assert_mem_eq(dir_b->children[2].ShortFileExtension, "TXT", 3);
+	lf12_free_metadata(indexed_meta);
+
+	// An index of another state of the image is rejected
+	key.mtime_nsec++;
+	err = lf12_read_index(fileno(index), &key, &indexed_meta);
+	ck_assert_int_eq(F12_STALE_INDEX, err);
+
+	fclose(index);
+	lf12_free_metadata(f12_meta);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_read_index_lazy)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	struct lf12_directory_entry *dir_a;
+	struct lf12_index_key key = { 0 };
+	char *image = calloc(64, 512);
+	FILE *index = tmpfile();
+
+	ck_assert_ptr_nonnull(image);
+	ck_assert_ptr_nonnull(index);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	f12_meta = create_image(device);
+	lf12_free_metadata(f12_meta);
+
+	err = lf12_read_metadata_lazy(device, &f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_write_index(fileno(index), &key, f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	lf12_free_metadata(f12_meta);
+
+	err = lf12_read_index(fileno(index), &key, &f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	// Directories, that were not loaded, are loaded from the image
+	dir_a = &f12_meta->root_dir->children[0];
+	ck_assert_mem_eq(dir_a->ShortFileName, "A       ", 8);
+	ck_assert_ptr_null(dir_a->children);
+	err = lf12_load_directory(device, f12_meta, dir_a, 1);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_mem_eq(dir_a->children[2].ShortFileName, "B       ", 8);
+
+	fclose(index);
+	lf12_free_metadata(f12_meta);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_read_index_inconsistent_header)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	struct lf12_index_key key = { 0 };
+	char *image = calloc(64, 512);
+	FILE *index = tmpfile();
+
+	ck_assert_ptr_nonnull(image);
+	ck_assert_ptr_nonnull(index);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	f12_meta = create_image(device);
+
+	// The root directory in the header does not fit into the index
+	f12_meta->bpb->RootDirEntries = 0xffff;
+	err = lf12_write_index(fileno(index), &key, f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	lf12_free_metadata(f12_meta);
+
+	err = lf12_read_index(fileno(index), &key, &f12_meta);
+	ck_assert_int_eq(F12_STALE_INDEX, err);
+	ck_assert_ptr_null(f12_meta);
+
+	fclose(index);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+TCase *libfat12_index_case(void)
+{
+	TCase *tc_libfat12_index;
+
+	tc_libfat12_index = tcase_create("libfat12 index");
+	tcase_add_test(tc_libfat12_index, test_lf12_read_index);
+	tcase_add_test(tc_libfat12_index, test_lf12_read_index_lazy);
+	tcase_add_test(tc_libfat12_index,
+		       test_lf12_read_index_inconsistent_header);
+
+	return tc_libfat12_index;
+}
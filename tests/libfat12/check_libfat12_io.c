@@ -1,6 +1,7 @@
 #include <check.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../../src/libfat12/io_p.h"
 #include "tests.h"
@@ -35,6 +36,42 @@ START_TEST(test_lf12_read_fat_entry)
 END_TEST
 // *INDENT-ON*
 
+START_TEST(test_lf12_set_fat_entry)
+{
+	enum lf12_error err;
+	struct lf12_metadata *f12_meta;
+	uint16_t fat_entries[400] = { 0 };
+	uint8_t dirty_fat_sectors[2] = { 0 };
+
+	err = lf12_create_metadata(&f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	f12_meta->bpb->SectorSize = 512;
+	f12_meta->bpb->SectorsPerFat = 2;
+	f12_meta->fat_entries = fat_entries;
+	f12_meta->dirty_fat_sectors = dirty_fat_sectors;
+
+	// Entry 2 is stored in the bytes 3 and 4 of the first sector
+	_lf12_set_fat_entry(f12_meta, 2, 0xfff);
+	ck_assert_int_eq(0xfff, fat_entries[2]);
+	ck_assert_int_eq(1, dirty_fat_sectors[0]);
+	ck_assert_int_eq(0, dirty_fat_sectors[1]);
+
+	// Entry 341 is stored in the bytes 511 and 512 and spans both sectors
+	dirty_fat_sectors[0] = 0;
+	_lf12_set_fat_entry(f12_meta, 341, 0x155);
+	ck_assert_int_eq(0x155, fat_entries[341]);
+	ck_assert_int_eq(1, dirty_fat_sectors[0]);
+	ck_assert_int_eq(1, dirty_fat_sectors[1]);
+
+	f12_meta->fat_entries = NULL;
+	f12_meta->dirty_fat_sectors = NULL;
+	lf12_free_metadata(f12_meta);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
 START_TEST(test_lf12_cluster_offset)
 {
 	int offset;
@@ -99,6 +136,45 @@ START_TEST(test_lf12_get_cluster_chain_length)
 END_TEST
 // *INDENT-ON*
 
+START_TEST(test_lf12_get_extent)
+{
+	uint16_t cluster = 2, extent_length;
+	enum lf12_error err;
+	struct lf12_metadata *f12_meta;
+	uint16_t fat_entries[] = {
+		0xff0,
+		0xfff,
+		0x3,
+		0x4,
+		0x8,
+		0x0,
+		0x0,
+		0x0,
+		0xfff,
+	};
+
+	err = lf12_create_metadata(&f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	f12_meta->fat_entries = fat_entries;
+	f12_meta->end_of_chain_marker = 0xfff;
+
+	// Clusters 2, 3 and 4 are consecutive, the chain continues at 8
+	extent_length = _lf12_get_extent(&cluster, f12_meta);
+	ck_assert_int_eq(3, extent_length);
+	ck_assert_int_eq(8, cluster);
+
+	extent_length = _lf12_get_extent(&cluster, f12_meta);
+	ck_assert_int_eq(1, extent_length);
+	ck_assert_int_eq(0xfff, cluster);
+
+	f12_meta->fat_entries = NULL;
+	lf12_free_metadata(f12_meta);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
 START_TEST(test_lf12_get_cluster_size)
 {
 	size_t cluster_size;
@@ -232,6 +308,10 @@ START_TEST(test_lf12_create_cluster_chain)
 	err = lf12_create_metadata(&f12_meta);
 	ck_assert_int_eq(F12_SUCCESS, err);
 
+	// A data area at the beginning of the partition with the clusters 2 to 9
+	f12_meta->bpb->SectorSize = 512;
+	f12_meta->bpb->SectorsPerCluster = 1;
+	f12_meta->bpb->LogicalSectors = 8;
 	f12_meta->entry_count = 10;
 	f12_meta->fat_entries = fat_entries;
 
@@ -248,18 +328,173 @@ START_TEST(test_lf12_create_cluster_chain)
 END_TEST
 // *INDENT-ON*
 
+/*
+ * Create the metadata for a small image with 64 sectors of 512 bytes, one
+ * sector per cluster and a single file allocation table.
+ */
+static struct lf12_metadata *create_small_metadata(void)
+{
+	enum lf12_error err;
+	struct lf12_metadata *f12_meta;
+	struct bios_parameter_block *bpb;
+
+	err = lf12_create_metadata(&f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	bpb = f12_meta->bpb;
+	bpb->SectorSize = 512;
+	bpb->SectorsPerCluster = 1;
+	bpb->ReservedForBoot = 1;
+	bpb->NumberOfFats = 1;
+	bpb->SectorsPerFat = 1;
+	bpb->RootDirEntries = 16;
+	bpb->LogicalSectors = 64;
+	bpb->LargeSectors = 64;
+	f12_meta->root_dir_offset = 2 * 512;
+	err = lf12_create_root_dir_meta(f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	return f12_meta;
+}
+
+START_TEST(test_lf12_unlink_entry)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	struct bios_parameter_block *bpb;
+	struct lf12_directory_entry *entry;
+	char *image = calloc(64, 512);
+	char zeros[512] = { 0 };
+	off_t cluster_offset;
+
+	ck_assert_ptr_nonnull(image);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	f12_meta = create_small_metadata();
+	bpb = f12_meta->bpb;
+
+	entry = &f12_meta->root_dir->children[0];
+	memcpy(entry->ShortFileName, "DATA    ", 8);
+	memcpy(entry->ShortFileExtension, "BIN", 3);
+	entry->FirstCluster = _lf12_create_cluster_chain(f12_meta, 3);
+	entry->FileSize = 3 * 512;
+	ck_assert_int_eq(2, entry->FirstCluster);
+	cluster_offset = _lf12_cluster_offset(2, f12_meta);
+	memset(image + cluster_offset, 0xaa, 3 * 512);
+
+	f12_meta->root_dir->dirty = 0;
+	memset(f12_meta->dirty_fat_sectors, 0, bpb->SectorsPerFat);
+
+	err = lf12_unlink_entry(device, f12_meta, entry);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	// The clusters are freed and erased, the entry is removed
+	for (int i = 2; i < 5; i++) {
+		ck_assert_int_eq(0, f12_meta->fat_entries[i]);
+		ck_assert_mem_eq(image + cluster_offset + (i - 2) * 512,
+				 zeros, 512);
+	}
+	ck_assert_int_eq(1, lf12_entry_is_empty(entry));
+	ck_assert_int_eq(1, f12_meta->root_dir->dirty);
+	ck_assert_int_eq(1, f12_meta->dirty_fat_sectors[0]);
+
+	lf12_free_metadata(f12_meta);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_read_metadata_lazy)
+{
+	enum lf12_error err;
+	struct lf12_device *device;
+	struct lf12_metadata *f12_meta;
+	struct lf12_directory_entry *entry, *dir_a;
+	struct lf12_path *path;
+	char names[3][11];
+	struct lf12_compact_path compact_path = { names, 3, 0 };
+	char *image = calloc(64, 512);
+
+	ck_assert_ptr_nonnull(image);
+	err = lf12_open_memory_device(image, 64 * 512, &device);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	f12_meta = create_small_metadata();
+	err = lf12_create_image(device, f12_meta, F12_CREATE_ZEROED);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_parse_path("A/B/FILE.TXT", &path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_create_entry_from_path(f12_meta, path, &entry);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_write_metadata(device, f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	lf12_free_metadata(f12_meta);
+
+	err = lf12_read_metadata_lazy(device, &f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	// Only the root directory is loaded
+	dir_a = &f12_meta->root_dir->children[0];
+	ck_assert_mem_eq(dir_a->ShortFileName, "A       ", 8);
+	ck_assert_ptr_null(dir_a->children);
+
+	err = lf12_load_entry_from_path(device, f12_meta, path, &entry);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_mem_eq(entry->ShortFileName, "FILE    ", 8);
+	ck_assert_mem_eq(entry->ShortFileExtension, "TXT", 3);
+	ck_assert_ptr_nonnull(dir_a->children);
+	lf12_free_path(path);
+
+	err = lf12_parse_path("A/C", &path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_load_entry_from_path(device, f12_meta, path, &entry);
+	ck_assert_int_eq(F12_FILE_NOT_FOUND, err);
+	lf12_free_path(path);
+
+	err = lf12_parse_compact_path("/A/B/", &compact_path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_load_entry_from_compact_path(device, f12_meta,
+						&compact_path, &entry);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_mem_eq(entry->ShortFileName, "B       ", 8);
+	compact_path.part_count = 0;
+	err = lf12_load_entry_from_compact_path(device, f12_meta,
+						&compact_path, &entry);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_ptr_eq(f12_meta->root_dir, entry);
+	err = lf12_parse_compact_path("A/B/NOFILE", &compact_path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	err = lf12_load_entry_from_compact_path(device, f12_meta,
+						&compact_path, &entry);
+	ck_assert_int_eq(F12_FILE_NOT_FOUND, err);
+
+	lf12_free_metadata(f12_meta);
+	lf12_close_device(device);
+	free(image);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
 TCase *libfat12_io_case(void)
 {
 	TCase *tc_libfat12_io;
 
 	tc_libfat12_io = tcase_create("libfat12 io");
 	tcase_add_test(tc_libfat12_io, test_lf12_read_fat_entry);
+	tcase_add_test(tc_libfat12_io, test_lf12_set_fat_entry);
 	tcase_add_test(tc_libfat12_io, test_lf12_cluster_offset);
 	tcase_add_test(tc_libfat12_io, test_lf12_get_cluster_chain_length);
+	tcase_add_test(tc_libfat12_io, test_lf12_get_extent);
 	tcase_add_test(tc_libfat12_io, test_lf12_get_cluster_size);
 	tcase_add_test(tc_libfat12_io, test_lf12_get_cluster_chain_size);
 	tcase_add_test(tc_libfat12_io, test_lf12_read_dir_entry);
 	tcase_add_test(tc_libfat12_io, test_lf12_create_cluster_chain);
+	tcase_add_test(tc_libfat12_io, test_lf12_unlink_entry);
+	tcase_add_test(tc_libfat12_io, test_lf12_read_metadata_lazy);
 
 	return tc_libfat12_io;
 }
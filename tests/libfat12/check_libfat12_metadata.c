@@ -92,6 +92,114 @@ START_TEST(test_lf12_read_entry_timestamp)
 END_TEST
 // *INDENT-ON*
 
+START_TEST(test_lf12_get_cluster_stats)
+{
+	enum lf12_error err;
+	struct lf12_metadata *f12_meta;
+	struct bios_parameter_block *bpb;
+	struct lf12_cluster_stats stats;
+	uint16_t *fat_entries;
+
+	err = lf12_create_metadata(&f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	bpb = f12_meta->bpb;
+	bpb->SectorSize = 512;
+	bpb->SectorsPerCluster = 1;
+	bpb->ReservedForBoot = 1;
+	bpb->NumberOfFats = 1;
+	bpb->SectorsPerFat = 1;
+	bpb->RootDirEntries = 16;
+	bpb->LogicalSectors = 64;
+	f12_meta->root_dir_offset = 2 * 512;
+	err = lf12_create_root_dir_meta(f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	// A contiguous chain, a fragmented chain around a bad cluster and a
+	// chain with a single cluster
+	fat_entries = f12_meta->fat_entries;
+	fat_entries[2] = 3;
+	fat_entries[3] = 4;
+	fat_entries[4] = 0xfff;
+	fat_entries[5] = 7;
+	fat_entries[6] = LF12_CLUSTER_BAD;
+	fat_entries[7] = 0xfff;
+	fat_entries[8] = 0xfff;
+
+	err = lf12_get_cluster_stats(f12_meta, &stats);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_uint_eq(61, stats.cluster_count);
+	ck_assert_uint_eq(6, stats.used_clusters);
+	ck_assert_uint_eq(54, stats.free_clusters);
+	ck_assert_uint_eq(1, stats.bad_clusters);
+	ck_assert_uint_eq(3, stats.chain_count);
+	ck_assert_uint_eq(1, stats.fragmented_chains);
+	ck_assert_uint_eq(4, stats.extent_count);
+	ck_assert_uint_eq(1, stats.free_extent_count);
+	ck_assert_uint_eq(54, stats.largest_free_extent);
+
+	// Freeing the single cluster chain splits the free space
+	fat_entries[8] = LF12_CLUSTER_FREE;
+	fat_entries[20] = 0xfff;
+	err = lf12_get_cluster_stats(f12_meta, &stats);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_uint_eq(2, stats.free_extent_count);
+	ck_assert_uint_eq(42, stats.largest_free_extent);
+
+	// The metadata area and six clusters are used
+	ck_assert_uint_eq(3 * 512 + 6 * 512, lf12_get_used_bytes(f12_meta));
+
+	lf12_free_metadata(f12_meta);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_get_extent_count)
+{
+	enum lf12_error err;
+	struct lf12_metadata *f12_meta;
+	struct bios_parameter_block *bpb;
+	struct lf12_directory_entry entry = { 0 };
+	uint16_t *fat_entries;
+
+	err = lf12_create_metadata(&f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	bpb = f12_meta->bpb;
+	bpb->SectorSize = 512;
+	bpb->SectorsPerCluster = 1;
+	bpb->ReservedForBoot = 1;
+	bpb->NumberOfFats = 1;
+	bpb->SectorsPerFat = 1;
+	bpb->RootDirEntries = 16;
+	bpb->LogicalSectors = 64;
+	f12_meta->root_dir_offset = 2 * 512;
+	err = lf12_create_root_dir_meta(f12_meta);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	fat_entries = f12_meta->fat_entries;
+	fat_entries[2] = 3;
+	fat_entries[3] = 10;
+	fat_entries[10] = 11;
+	fat_entries[11] = 5;
+	fat_entries[5] = 0xfff;
+	// A cyclic chain
+	fat_entries[20] = 21;
+	fat_entries[21] = 20;
+
+	ck_assert_uint_eq(0, lf12_get_extent_count(f12_meta, &entry));
+	entry.FirstCluster = 2;
+	ck_assert_uint_eq(3, lf12_get_extent_count(f12_meta, &entry));
+	entry.FirstCluster = 5;
+	ck_assert_uint_eq(1, lf12_get_extent_count(f12_meta, &entry));
+	entry.FirstCluster = 20;
+	ck_assert(lf12_get_extent_count(f12_meta, &entry) > 1);
+
+	lf12_free_metadata(f12_meta);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
 TCase *libfat12_metadata_case(void)
 {
 	TCase *tc_libfat12_metadata;
@@ -101,6 +209,8 @@ TCase *libfat12_metadata_case(void)
 	tcase_add_test(tc_libfat12_metadata,
 		       test_lf12_generate_entry_timestamp);
 	tcase_add_test(tc_libfat12_metadata, test_lf12_read_entry_timestamp);
+	tcase_add_test(tc_libfat12_metadata, test_lf12_get_cluster_stats);
+	tcase_add_test(tc_libfat12_metadata, test_lf12_get_extent_count);
 
 	return tc_libfat12_metadata;
 }
@@ -5,60 +5,29 @@
 #include "../../src/libfat12/path_p.h"
 #include "tests.h"
 
-START_TEST(test_lf12_build_path)
+START_TEST(test_lf12_convert_path)
 {
-	char *input_parts[] = {
-		"TEST",
-		"FOO",
-		"BAR.BIN"
-	};
-	enum lf12_error err;
-	struct lf12_path *path = malloc(sizeof(struct lf12_path));
-
-	ck_assert_ptr_nonnull(path);
-	err = _lf12_build_path(input_parts, 3, path);
-
-	ck_assert_str_eq(path->name, "TEST       ");
-	ck_assert_str_eq(path->short_file_name, "TEST    ");
-	ck_assert_str_eq(path->short_file_extension, "   ");
-	ck_assert_ptr_nonnull(path->descendant);
-	ck_assert_ptr_null(path->ancestor);
-
-	path = path->descendant;
-
-	ck_assert_str_eq(path->name, "FOO        ");
-	ck_assert_str_eq(path->short_file_name, "FOO     ");
-	ck_assert_str_eq(path->short_file_extension, "   ");
-	ck_assert_ptr_nonnull(path->descendant);
-	ck_assert_ptr_nonnull(path->ancestor);
-
-	path = path->descendant;
-
-	ck_assert_str_eq(path->name, "BAR     BIN");
-	ck_assert_str_eq(path->short_file_name, "BAR     ");
-	ck_assert_str_eq(path->short_file_extension, "BIN");
-	ck_assert_ptr_null(path->descendant);
-	ck_assert_ptr_nonnull(path->ancestor);
-
-	lf12_free_path(path);
-}
-// *INDENT-OFF*
-END_TEST
-// *INDENT-ON*
-
-START_TEST(test_lf12_split_input)
-{
-	char **input_parts;
+	char names[3][11];
 	int part_count;
 	enum lf12_error err;
 
-	err = _lf12_split_input("TEST/FOO/BAR", &input_parts, &part_count);
+	err = _lf12_convert_path("TEST/FOO/bar.bin", names, 3, &part_count);
 
 	ck_assert_int_eq(err, F12_SUCCESS);
 	ck_assert_int_eq(part_count, 3);
-	ck_assert_str_eq(input_parts[0], "TEST");
-	ck_assert_str_eq(input_parts[1], "FOO");
-	ck_assert_str_eq(input_parts[2], "BAR");
+	ck_assert_mem_eq(names[0], "TEST       ", 11);
+	ck_assert_mem_eq(names[1], "FOO        ", 11);
+	ck_assert_mem_eq(names[2], "BAR     BIN", 11);
+
+	// Parts beyond the capacity are only counted
+	err = _lf12_convert_path("/A.B/C/", names, 1, &part_count);
+	ck_assert_int_eq(err, F12_SUCCESS);
+	ck_assert_int_eq(part_count, 2);
+	ck_assert_mem_eq(names[0], "A       B  ", 11);
+
+	err = _lf12_convert_path("/", names, 3, &part_count);
+	ck_assert_int_eq(err, F12_EMPTY_PATH);
+	ck_assert_int_eq(part_count, 0);
 }
 // *INDENT-OFF*
 END_TEST
@@ -87,6 +56,91 @@ START_TEST(test_lf12_parse_path)
 END_TEST
 // *INDENT-ON*
 
+START_TEST(test_lf12_parse_path_parts)
+{
+	enum lf12_error err;
+	struct lf12_path *path, *part;
+
+	err = lf12_parse_path("TEST/FOO/BAR.BIN", &path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+
+	part = path;
+	ck_assert_str_eq(part->name, "TEST       ");
+	ck_assert_str_eq(part->short_file_name, "TEST    ");
+	ck_assert_str_eq(part->short_file_extension, "   ");
+	ck_assert_ptr_nonnull(part->descendant);
+	ck_assert_ptr_null(part->ancestor);
+
+	part = part->descendant;
+
+	ck_assert_str_eq(part->name, "FOO        ");
+	ck_assert_str_eq(part->short_file_name, "FOO     ");
+	ck_assert_str_eq(part->short_file_extension, "   ");
+	ck_assert_ptr_nonnull(part->descendant);
+	ck_assert_ptr_eq(path, part->ancestor);
+
+	part = part->descendant;
+
+	ck_assert_str_eq(part->name, "BAR     BIN");
+	ck_assert_str_eq(part->short_file_name, "BAR     ");
+	ck_assert_str_eq(part->short_file_extension, "BIN");
+	ck_assert_ptr_null(part->descendant);
+	ck_assert_ptr_nonnull(part->ancestor);
+
+	lf12_free_path(path);
+
+	err = lf12_parse_path("/", &path);
+	ck_assert_int_eq(F12_EMPTY_PATH, err);
+	ck_assert_ptr_null(path);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_parse_compact_path)
+{
+	enum lf12_error err;
+	char names[2][11];
+	struct lf12_compact_path path = { names, 2, 0 };
+
+	err = lf12_parse_compact_path("/DIR/FILE.TXT", &path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_int_eq(2, path.part_count);
+	ck_assert_mem_eq(names[0], "DIR        ", 11);
+	ck_assert_mem_eq(names[1], "FILE    TXT", 11);
+
+	err = lf12_parse_compact_path("/A/B/C", &path);
+	ck_assert_int_eq(F12_PATH_TOO_LONG, err);
+	ck_assert_int_eq(3, path.part_count);
+
+	err = lf12_parse_compact_path("", &path);
+	ck_assert_int_eq(F12_EMPTY_PATH, err);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
+START_TEST(test_lf12_create_compact_path)
+{
+	enum lf12_error err;
+	struct lf12_compact_path *path;
+
+	err = lf12_create_compact_path("A/B/C/D.E", &path);
+	ck_assert_int_eq(F12_SUCCESS, err);
+	ck_assert_int_eq(4, path->part_count);
+	ck_assert_int_eq(4, path->capacity);
+	ck_assert_mem_eq(path->names[0], "A          ", 11);
+	ck_assert_mem_eq(path->names[3], "D       E  ", 11);
+	lf12_free_compact_path(path);
+
+	err = lf12_create_compact_path("/", &path);
+	ck_assert_int_eq(F12_EMPTY_PATH, err);
+	ck_assert_ptr_null(path);
+}
+// *INDENT-OFF*
+END_TEST
+// *INDENT-ON*
+
 START_TEST(test_lf12_path_get_parent)
 {
 	struct lf12_path *path_a, *path_b, *path_c;
@@ -115,9 +169,11 @@ TCase *libfat12_path_case(void)
 	TCase *tc_libfat12_path;
 
 	tc_libfat12_path = tcase_create("libfat12 path");
-	tcase_add_test(tc_libfat12_path, test_lf12_build_path);
-	tcase_add_test(tc_libfat12_path, test_lf12_split_input);
+	tcase_add_test(tc_libfat12_path, test_lf12_convert_path);
 	tcase_add_test(tc_libfat12_path, test_lf12_parse_path);
+	tcase_add_test(tc_libfat12_path, test_lf12_parse_path_parts);
+	tcase_add_test(tc_libfat12_path, test_lf12_parse_compact_path);
+	tcase_add_test(tc_libfat12_path, test_lf12_create_compact_path);
 	tcase_add_test(tc_libfat12_path, test_lf12_path_get_parent);
 
 	return tc_libfat12_path;
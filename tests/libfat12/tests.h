@@ -3,8 +3,23 @@
 
 #include <check.h>
 
+TCase *libfat12_allocation_case(void);
+TCase *libfat12_arena_case(void);
+
+TCase *libfat12_cache_case(void);
+
+TCase *libfat12_defrag_case(void);
+
+TCase *libfat12_device_case(void);
+
+TCase *libfat12_dir_table_case(void);
+
 TCase *libfat12_directory_case(void);
 
+TCase *libfat12_fat_case(void);
+
+TCase *libfat12_index_case(void);
+
 TCase *libfat12_io_case(void);
 
 TCase *libfat12_metadata_case(void);